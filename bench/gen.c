@@ -0,0 +1,266 @@
+// writes the generated rule files and inputs of the benchmarks to a
+// directory. the output only depends on the size of the inputs, so runs can
+// be compared.
+//
+// usage: gen <directory> [input bytes]
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static uint64_t state = 0x9e3779b97f4a7c15u;
+
+// xorshift64*.
+static unsigned rnd(unsigned n) {
+  state ^= state >> 12;
+  state ^= state << 25;
+  state ^= state >> 27;
+  return (unsigned)((state * 0x2545f4914f6cdd1du) >> 33) % n;
+}
+
+static const char *pick(const char *const *words, size_t n) {
+  return words[rnd(n)];
+}
+#define PICK(words) pick(words, sizeof(words) / sizeof(words[0]))
+
+static FILE *create(const char *dir, const char *name) {
+  char path[1024];
+  snprintf(path, sizeof(path), "%s/%s", dir, name);
+  FILE *f = fopen(path, "w");
+  if (!f) {
+    fprintf(stderr, "ERROR: could not write \"%s\"\n", path);
+    exit(1);
+  }
+  return f;
+}
+
+// keywords: distinct pronounceable words, with many shared prefixes and
+// suffixes like real keyword sets.
+
+#define MAX_WORDS 1024
+static char words[MAX_WORDS][16];
+static size_t n_words;
+
+static void make_word(char *w) {
+  static const char consonants[] = "bcdfghklmnprstvz";
+  static const char vowels[] = "aeiou";
+  size_t len = 0;
+  for (unsigned s = 0, n = 2 + rnd(3); s < n; s++) {
+    w[len++] = consonants[rnd(sizeof(consonants) - 1)];
+    w[len++] = vowels[rnd(sizeof(vowels) - 1)];
+    if (rnd(3) == 0)
+      w[len++] = consonants[rnd(sizeof(consonants) - 1)];
+  }
+  w[len] = '\0';
+}
+
+static void make_words(size_t n) {
+  while (n_words < n) {
+    char w[16];
+    make_word(w);
+    size_t i = 0;
+    for (; i < n_words && strcmp(words[i], w); i++)
+      ;
+    if (i == n_words)
+      strcpy(words[n_words++], w);
+  }
+}
+
+static void keyword_rules(const char *dir) {
+  FILE *f = create(dir, "keywords.txt");
+  static const size_t sizes[] = {50, 200, 400};
+  make_words(800);
+  for (size_t s = 0; s < 3; s++) {
+    fprintf(f, "kw%zu ", sizes[s]);
+    for (size_t i = 0; i < sizes[s]; i++)
+      fprintf(f, "%s%s", i ? "|" : "", words[i]);
+    fputc('\n', f);
+  }
+  // the same words, but not a plain alternation of literals.
+  fprintf(f, "kwident [a-z]+-(");
+  for (size_t i = 0; i < 200; i++)
+    fprintf(f, "%s%s", i ? "|" : "", words[i]);
+  fprintf(f, ")\n");
+  fclose(f);
+}
+
+// `(a|b)*a(a|b){n}`: the DFA remembers the last n + 1 bytes, 2^(n+1) states.
+static void blowup_rules(const char *dir) {
+  FILE *f = create(dir, "blowup.txt");
+  for (unsigned n = 2; n <= 10; n += 2) {
+    fprintf(f, "blow%u (a|b)*a", n);
+    for (unsigned i = 0; i < n; i++)
+      fprintf(f, "(a|b)");
+    fputc('\n', f);
+  }
+  // the reversed family is small as a DFA, but not as a simplified NFA.
+  fprintf(f, "rev10 ");
+  for (unsigned i = 0; i < 10; i++)
+    fprintf(f, "(a|b)");
+  fprintf(f, "a(a|b)*\n");
+  fclose(f);
+}
+
+// nested repetitions and parentheses, over the letters a to f.
+static void nested(FILE *f, unsigned depth) {
+  if (depth == 0) {
+    fputc('a', f);
+    return;
+  }
+  fputc('(', f);
+  nested(f, depth - 1);
+  fprintf(f, "|%c)%c%c", 'a' + depth % 6, depth % 2 ? '*' : '+',
+          'a' + (depth + 3) % 6);
+}
+
+static void nesting_rules(const char *dir) {
+  FILE *f = create(dir, "nesting.txt");
+  for (unsigned depth = 4; depth <= 64; depth *= 2) {
+    fprintf(f, "deep%u ", depth);
+    nested(f, depth);
+    fputc('\n', f);
+  }
+  fprintf(f, "parens64 ");
+  for (unsigned i = 0; i < 64; i++)
+    fputc('(', f);
+  fputc('a', f);
+  for (unsigned i = 0; i < 64; i++)
+    fprintf(f, ")%c", i % 3 ? '+' : '*');
+  fputc('\n', f);
+  fprintf(f, "stars32 (((a*b*)*c*)*(d|e*)*)*");
+  for (unsigned i = 0; i < 32; i++)
+    fprintf(f, "(%c|f)*", 'a' + i % 5);
+  fputc('\n', f);
+  fclose(f);
+}
+
+// classes spanning many bytes, or many UTF-8 sequences.
+static void wide_rules(const char *dir) {
+  FILE *f = create(dir, "wide.txt");
+  fprintf(f, "line [\\x01-\\t\\x0b-\\xff]+\n");
+  fprintf(f, "nonascii [\\u{80}-\\u{10ffff}]+\n");
+  fprintf(f, "codepoint [\\u{1}-\\u{10ffff}]\n");
+  fprintf(f, "cjk [\\u{4e00}-\\u{9fff}]+\n");
+  fprintf(f, "latin [a-zA-Zà-öø-ÿĀ-ſ]+\n");
+  fprintf(f, "scripts [a-zA-Zα-ωΑ-Ωа-яА-Яא-ת\\u{4e00}-\\u{9fff}]+\n");
+  fprintf(f, "notspace ~([\\x01-\\xff]*[\\s\\n][\\x01-\\xff]*)\n");
+  fclose(f);
+}
+
+// realistic input: C-like source.
+static void c_input(const char *dir, size_t size) {
+  static const char *const types[] = {"int", "char", "unsigned long",
+                                      "double", "struct node *", "void *"};
+  static const char *const keywords[] = {"if", "while", "for", "return",
+                                         "switch", "sizeof"};
+  static const char *const ops[] = {"+", "-", "*", "/", "==", "!=", "<=",
+                                    "&&", "||", "<<", "->", "%"};
+  FILE *f = create(dir, "c.txt");
+  make_words(800);
+  for (size_t n = 0; n < size;) {
+    unsigned indent = 2 * rnd(4);
+    int len = 0;
+    switch (rnd(8)) {
+    case 0:
+      len = fprintf(f, "%*s/* %s %s %s. */\n", indent, "", words[rnd(800)],
+                    words[rnd(800)], words[rnd(800)]);
+      break;
+    case 1:
+      len = fprintf(f, "%*s%s %s_%s = %u;\n", indent, "", PICK(types),
+                    words[rnd(800)], words[rnd(800)], rnd(100000));
+      break;
+    case 2:
+      len = fprintf(f, "%*s%s (%s %s 0x%x) {\n", indent, "", PICK(keywords),
+                    words[rnd(800)], PICK(ops), rnd(65536));
+      break;
+    case 3:
+      len = fprintf(f, "%*sprintf(\"%s: %%d\\n\", %s->%s[%u]);\n", indent,
+                    "", words[rnd(800)], words[rnd(800)], words[rnd(800)],
+                    rnd(64));
+      break;
+    case 4:
+      len = fprintf(f, "%*s%s = %s %s %u.%ue%u; // %s\n", indent, "",
+                    words[rnd(800)], words[rnd(800)], PICK(ops), rnd(1000),
+                    rnd(1000), rnd(20), words[rnd(800)]);
+      break;
+    case 5:
+      len = fprintf(f, "%*s}\n", indent, "");
+      break;
+    default:
+      len = fprintf(f, "%*s%s(%s, %s %s %s);\n", indent, "", words[rnd(800)],
+                    words[rnd(800)], words[rnd(800)], PICK(ops),
+                    words[rnd(800)]);
+    }
+    n += len;
+  }
+  fclose(f);
+}
+
+// realistic input: prose in several scripts.
+static void text_input(const char *dir, size_t size) {
+  static const char *const pool[] = {
+      "the",      "of",     "automaton", "état",    "größe",  "λόγος",
+      "αβγ",      "язык",   "строка",    "שלום",    "文字",   "正则表达式",
+      "naïve",    "façade", "Ærø",       "Ελλάδα",  "Москва", "数据",
+      "déjà",     "über",   "ñandú",     "café",    "and",    "with"};
+  static const char *const punctuation[] = {" ", " ", " ", ", ", ". ", "\n"};
+  FILE *f = create(dir, "text.txt");
+  for (size_t n = 0; n < size;)
+    n += fprintf(f, "%s%s", PICK(pool), PICK(punctuation));
+  fclose(f);
+}
+
+// adversarial input: runs of `letters` that keep every nested repetition
+// alive, separated by spaces so that matches end.
+static void runs_input(const char *dir, const char *name, const char *letters,
+                       size_t size) {
+  FILE *f = create(dir, name);
+  size_t n_letters = strlen(letters);
+  for (size_t n = 0; n < size;) {
+    unsigned len = 1 + rnd(64);
+    for (unsigned i = 0; i < len; i++)
+      fputc(letters[rnd(n_letters)], f);
+    fputc(rnd(8) ? ' ' : '\n', f);
+    n += len + 1;
+  }
+  fclose(f);
+}
+
+// adversarial input for keyword sets: words that share a long prefix with a
+// keyword and then differ, so every match fails late.
+static void near_input(const char *dir, size_t size) {
+  FILE *f = create(dir, "near.txt");
+  make_words(800);
+  for (size_t n = 0; n < size;) {
+    char w[17];
+    strcpy(w, words[rnd(800)]);
+    size_t len = strlen(w);
+    if (rnd(4))
+      w[len - 1] = w[len - 1] == 'z' ? 'y' : 'z';
+    else
+      w[len++] = 'q', w[len] = '\0';
+    n += fprintf(f, "%s ", w);
+  }
+  fclose(f);
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s <directory> [input bytes]\n", argv[0]);
+    return 1;
+  }
+  const char *dir = argv[1];
+  size_t size = argc > 2 ? strtoull(argv[2], NULL, 10) : 1 << 20;
+
+  keyword_rules(dir);
+  blowup_rules(dir);
+  nesting_rules(dir);
+  wide_rules(dir);
+
+  c_input(dir, size);
+  text_input(dir, size);
+  runs_input(dir, "ab.txt", "ab", size);
+  runs_input(dir, "letters.txt", "abcdef", size);
+  near_input(dir, size);
+  return 0;
+}
@@ -0,0 +1,70 @@
+#!/bin/sh
+# builds the benchmark corpus, compiles every rule file with --stats=json,
+# measures the throughput of each backend on the inputs that go with it, and
+# writes everything to bench/out/results.json.
+#
+# BENCH_SIZE sets the size of the generated inputs in bytes (1 MiB), and
+# BENCH_MIN_TIME the seconds spent on each measurement (0.2).
+# BENCH_SCANNER_CFLAGS is how the generated code is compiled.
+set -e
+
+OUT=bench/out
+CC=${CC:-gcc}
+BENCH_CFLAGS=${BENCH_CFLAGS:--O3 -march=native}
+SCANNER_CFLAGS=${BENCH_SCANNER_CFLAGS:--O2 -march=native}
+mkdir -p $OUT
+
+$CC -Wall -Wextra -std=c11 $BENCH_CFLAGS bench/gen.c -o $OUT/gen
+$CC -Wall -Wextra -std=c11 $BENCH_CFLAGS -Isrc bench/throughput.c \
+  lib/libregex_automata.a -ldl -pthread -o $OUT/throughput
+$OUT/gen $OUT ${BENCH_SIZE:-1048576}
+cp bench/lexer.txt $OUT/lexer.txt
+
+# realistic inputs first, then adversarial ones.
+inputs() {
+  case $1 in
+  lexer) echo c.txt text.txt ;;
+  keywords) echo c.txt near.txt ;;
+  blowup) echo ab.txt ;;
+  nesting) echo letters.txt ;;
+  wide) echo text.txt c.txt ;;
+  esac
+}
+
+RULES="lexer keywords blowup nesting wide"
+for r in $RULES; do
+  echo "== $r" >&2
+  bin/dfa --stats=json --emit-binary $OUT/$r.txt > $OUT/$r.stats.json
+  mv $OUT/$r.txt.c $OUT/$r.scan.c
+  bin/dfa -s $OUT/$r.txt > /dev/null
+  mv $OUT/$r.txt.c $OUT/$r.search.c
+  for kind in scan search; do
+    $CC $SCANNER_CFLAGS -shared -fPIC $OUT/$r.$kind.c -o $OUT/$r.txt.$kind.so &
+  done
+  wait
+
+  files=
+  for i in $(inputs $r); do
+    files="$files $OUT/$i"
+  done
+  $OUT/throughput $OUT/$r.txt $files > $OUT/$r.throughput.json
+done
+
+{
+  echo '{"compile": {'
+  sep=
+  for r in $RULES; do
+    printf '%s"%s": ' "$sep" $r
+    cat $OUT/$r.stats.json
+    sep=,
+  done
+  echo '}, "throughput": {'
+  sep=
+  for r in $RULES; do
+    printf '%s"%s": ' "$sep" $r
+    cat $OUT/$r.throughput.json
+    sep=,
+  done
+  echo '}}'
+} > $OUT/results.json
+echo "results written to $OUT/results.json" >&2
@@ -0,0 +1,183 @@
+// measures how fast every backend tokenizes inputs with the rules of a file,
+// and writes the results as a JSON array.
+//
+// usage: throughput <rules> <input>...
+//
+// next to <rules> it expects <rules>.scan.so and <rules>.search.so, built
+// from the code generated without and with -s, and <rules>.bin from
+// --emit-binary. the anchored backends split the input into the longest
+// matches, skipping a byte where nothing matches; `searcher` jumps from the
+// end of a match to the end of the next one, and is skipped for regexes
+// matching the empty string, where it would stop at once.
+#define _POSIX_C_SOURCE 200809L
+#include "regex_automata.h"
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef unsigned long (*generated_fn)(const char *s);
+
+typedef enum { SCANNER, SEARCHER, TABLE, BINARY, N_BACKENDS } backend;
+
+static const char *const backend_names[N_BACKENDS] = {"scanner", "searcher",
+                                                      "table", "binary"};
+
+typedef struct {
+  generated_fn fn[2]; // the scanner and the searcher
+  ra_regex *re;
+  const ra_binary *bin;
+  long bin_index;
+} rule;
+
+static double now(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static char *read_file(const char *name, size_t *len) {
+  FILE *f = fopen(name, "rb");
+  if (!f)
+    return NULL;
+  fseek(f, 0, SEEK_END);
+  *len = ftell(f);
+  rewind(f);
+  char *s = malloc(*len + 1);
+  *len = fread(s, 1, *len, f);
+  s[*len] = '\0';
+  fclose(f);
+  return s;
+}
+
+// the number of matches in one pass over `s`.
+static size_t pass(const rule *r, backend b, const char *s, size_t len) {
+  size_t matches = 0;
+  if (b == SEARCHER) {
+    for (size_t pos = 0, n; pos < len && (n = r->fn[1](s + pos)); pos += n)
+      matches++;
+    return matches;
+  }
+
+  for (size_t pos = 0; pos < len;) {
+    size_t n = 0;
+    if (b == SCANNER)
+      n = r->fn[0](s + pos);
+    else if (b == TABLE)
+      ra_match(r->re, s + pos, len - pos, &n);
+    else
+      ra_binary_match(r->bin, r->bin_index, s + pos, len - pos, &n);
+    matches += n != 0;
+    pos += n ? n : 1;
+  }
+  return matches;
+}
+
+static void *open_generated(const char *rules, const char *suffix) {
+  char name[1024];
+  snprintf(name, sizeof(name), "%s.%s.so", rules, suffix);
+  void *h = dlopen(name, RTLD_NOW);
+  if (!h)
+    fprintf(stderr, "WARNING: %s\n", dlerror());
+  return h;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    fprintf(stderr, "usage: %s <rules> <input>...\n", argv[0]);
+    return 1;
+  }
+  const char *rules = argv[1];
+  const char *min_time_env = getenv("BENCH_MIN_TIME");
+  double min_time = min_time_env ? atof(min_time_env) : 0.2;
+
+  void *generated[2] = {open_generated(rules, "scan"),
+                        open_generated(rules, "search")};
+  char bin_name[1024];
+  snprintf(bin_name, sizeof(bin_name), "%s.bin", rules);
+  ra_binary bin;
+  int have_bin = ra_binary_open(bin_name, &bin) == RA_OK;
+
+  FILE *f = fopen(rules, "r");
+  if (!f) {
+    fprintf(stderr, "ERROR: could not open \"%s\"\n", rules);
+    return 1;
+  }
+
+  printf("[");
+  int first = 1;
+  char *line = NULL;
+  size_t line_cap = 0;
+  ssize_t l;
+  while ((l = getline(&line, &line_cap, f)) != -1) {
+    if (l > 0 && line[l - 1] == '\n')
+      line[--l] = '\0';
+    char *space = strchr(line, ' ');
+    if (!space)
+      continue;
+    *space = '\0';
+    const char *name = line, *regex = space + 1;
+
+    rule r = {.bin = &bin, .bin_index = -1};
+    static const char *const prefixes[2] = {"scan_", "search_"};
+    for (int k = 0; k < 2; k++) {
+      char symbol[256];
+      snprintf(symbol, sizeof(symbol), "%s%s", prefixes[k], name);
+      if (generated[k])
+        *(void **)&r.fn[k] = dlsym(generated[k], symbol);
+    }
+    size_t n;
+    if (ra_compile(regex, strlen(regex), 0, &r.re, NULL) == RA_OK &&
+        ra_match(r.re, "", 0, &n))
+      r.fn[1] = NULL;
+    if (have_bin)
+      r.bin_index = ra_binary_find(&bin, name);
+
+    for (int i = 2; i < argc; i++) {
+      size_t len;
+      char *s = read_file(argv[i], &len);
+      if (!s) {
+        fprintf(stderr, "ERROR: could not open \"%s\"\n", argv[i]);
+        return 1;
+      }
+      const char *input = strrchr(argv[i], '/');
+      input = input ? input + 1 : argv[i];
+
+      for (backend b = 0; b < N_BACKENDS; b++) {
+        if ((b == SCANNER && !r.fn[0]) || (b == SEARCHER && !r.fn[1]) ||
+            (b == TABLE && !r.re) || (b == BINARY && r.bin_index < 0))
+          continue;
+
+        size_t passes = 0, matches = 0;
+        double start = now(), elapsed;
+        do {
+          matches = pass(&r, b, s, len);
+          passes++;
+        } while ((elapsed = now() - start) < min_time);
+        double gb_per_s = (double)len * passes / elapsed / 1e9;
+
+        printf("%s\n  {\"rule\": \"%s\", \"input\": \"%s\", \"backend\": "
+               "\"%s\", \"bytes\": %zu, \"passes\": %zu, \"seconds\": %.6f, "
+               "\"gb_per_s\": %.4f, \"matches\": %zu}",
+               first ? "" : ",", name, input, backend_names[b], len, passes,
+               elapsed, gb_per_s, matches);
+        first = 0;
+        fprintf(stderr, "%-12s %-12s %-9s %8.3f GB/s %10zu matches\n", name,
+                input, backend_names[b], gb_per_s, matches);
+      }
+      free(s);
+    }
+    ra_free(r.re);
+  }
+  printf("\n]\n");
+
+  free(line);
+  fclose(f);
+  if (have_bin)
+    ra_binary_close(&bin);
+  for (int k = 0; k < 2; k++)
+    if (generated[k])
+      dlclose(generated[k]);
+  return 0;
+}
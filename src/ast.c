@@ -0,0 +1,574 @@
+#define _POSIX_C_SOURCE 200809L
+#include "ast.h"
+#include "utf8.h"
+#include <ctype.h>
+#include <stdio.h>
+
+#define A_VEC(...) VEC(ast *, NULL, ##__VA_ARGS__)
+
+ast *ast_new(ast_kind kind) {
+  ast *a = calloc(sizeof(ast), 1);
+  a->kind = kind;
+  a->children = A_VEC();
+  return a;
+}
+
+ast *ast_new_set(const byte_set *set) {
+  ast *a = ast_new(AST_SET);
+  a->set = *set;
+  return a;
+}
+
+ast *ast_new_unary(ast_kind kind, ast *child) {
+  ast *a = ast_new(kind);
+  ast_append(a, child);
+  return a;
+}
+
+void ast_append(ast *parent, ast *child) { vec_insert(&parent->children, &child); }
+
+ast *ast_child(const ast *a, size_t index) {
+  assert(index < a->children.size);
+  return *(ast **)elem_at(&a->children, index);
+}
+
+ast *ast_clone(const ast *a) {
+  ast *r = ast_new(a->kind);
+  r->set = a->set;
+  r->group = a->group;
+  r->name = a->name ? strdup(a->name) : NULL;
+  r->min = a->min;
+  r->max = a->max;
+  ITER(ast *, c, &a->children) { ast_append(r, ast_clone(*c)); }
+  return r;
+}
+
+ast *ast_reverse(const ast *a) {
+  ast *r = ast_new(a->kind);
+  r->set = a->set;
+  r->group = a->group;
+  r->name = a->name ? strdup(a->name) : NULL;
+  r->min = a->min;
+  r->max = a->max;
+  // a concatenation is the only node whose children come in order.
+  size_t n = a->children.size;
+  for (size_t i = 0; i < n; i++) {
+    size_t from = a->kind == AST_CONCAT ? n - 1 - i : i;
+    ast_append(r, ast_reverse(ast_child(a, from)));
+  }
+  return r;
+}
+
+void ast_free(ast *a) {
+  if (!a)
+    return;
+  ITER(ast *, c, &a->children) { ast_free(*c); }
+  destroy(&a->children);
+  free(a->name);
+  free(a);
+}
+
+int ast_cmp(const ast *a, const ast *b) {
+  if (a->kind != b->kind)
+    return (int)a->kind - (int)b->kind;
+  if (a->kind == AST_SET)
+    return memcmp(a->set.bits, b->set.bits, sizeof(a->set.bits));
+  if (a->kind == AST_CAPTURE && a->group != b->group)
+    return a->group < b->group ? -1 : 1;
+  if (a->kind == AST_REPEAT && a->min != b->min)
+    return a->min < b->min ? -1 : 1;
+  if (a->kind == AST_REPEAT && a->max != b->max)
+    return a->max < b->max ? -1 : 1;
+  if (a->children.size != b->children.size)
+    return a->children.size < b->children.size ? -1 : 1;
+  for (size_t i = 0; i < a->children.size; i++) {
+    int r = ast_cmp(ast_child(a, i), ast_child(b, i));
+    if (r)
+      return r;
+  }
+  return 0;
+}
+
+unsigned ast_groups(const ast *a, const char **names) {
+  unsigned n = 0;
+  if (a->kind == AST_CAPTURE) {
+    n = a->group + 1;
+    if (names)
+      names[a->group] = a->name;
+  }
+  ITER(ast *, c, &a->children) {
+    unsigned m = ast_groups(*c, names);
+    n = m > n ? m : n;
+  }
+  return n;
+}
+
+// `x{n,}` is built as n - 1 copies of `x` and `x+`, `x{n,m}` as m copies,
+// the last m - n of them optional.
+static size_t repeat_copies(const ast *a) {
+  if (a->max == REPEAT_UNBOUNDED)
+    return a->min ? a->min : 1;
+  return a->max;
+}
+
+size_t ast_nfa_size(const ast *a) {
+  size_t n = 0;
+  ITER(ast *, c, &a->children) { n += ast_nfa_size(*c); }
+
+  switch (a->kind) {
+  case AST_EMPTY:
+  case AST_SET:
+    return 2;
+  case AST_CONCAT:
+    // children are linked by epsilon moves, no new states.
+    return a->children.size ? n : 2;
+  case AST_ALT:
+  case AST_STAR:
+  case AST_PLUS:
+    return n + 2;
+  case AST_AND:
+  case AST_DIFF:
+  case AST_NOT:
+    // the size of the product is only known once it is built, this is the
+    // size of the operands.
+    return n + 2;
+  case AST_CAPTURE:
+    return n;
+  case AST_REPEAT:
+    return n * repeat_copies(a) + 2;
+  }
+  return n;
+}
+
+void ast_print(const ast *a, FILE *stream) {
+  static const char kinds[] = {
+      [AST_EMPTY] = 'e', [AST_SET] = 's', [AST_CONCAT] = 'c',
+      [AST_ALT] = 'a',   [AST_STAR] = '*', [AST_PLUS] = '+',
+      [AST_AND] = '&',   [AST_DIFF] = '-', [AST_NOT] = '~',
+      [AST_CAPTURE] = 'g', [AST_REPEAT] = 'r',
+  };
+  fputc(kinds[a->kind], stream);
+  if (a->kind == AST_CAPTURE)
+    fprintf(stream, "%u", a->group);
+  if (a->kind == AST_REPEAT && a->max == REPEAT_UNBOUNDED)
+    fprintf(stream, "{%u,}", a->min);
+  else if (a->kind == AST_REPEAT)
+    fprintf(stream, "{%u,%u}", a->min, a->max);
+  if (a->kind == AST_SET) {
+    // the runs of bytes in the set, in hex.
+    fputc('[', stream);
+    for (unsigned c = 0; c < 256; c++) {
+      if (!byte_set_has(&a->set, c))
+        continue;
+      unsigned last = c;
+      while (last < 255 && byte_set_has(&a->set, last + 1))
+        last++;
+      fprintf(stream, "%02x-%02x,", c, last);
+      c = last;
+    }
+    fputc(']', stream);
+  }
+  if (a->children.size) {
+    fputc('(', stream);
+    ITER(ast *, c, &a->children) { ast_print(*c, stream); }
+    fputc(')', stream);
+  }
+}
+
+const char escape_sequences[] = {
+    ['n'] = '\n', ['t'] = '\t', ['s'] = ' ',  ['('] = '(',  [')'] = ')',
+    ['*'] = '*',  ['+'] = '+',  ['['] = '[',  [']'] = ']',  ['|'] = '|',
+    ['\\'] = '\\', ['-'] = '-',  ['&'] = '&',  ['~'] = '~',  ['{'] = '{',
+    ['}'] = '}',
+};
+
+typedef struct {
+  const char *s;
+  size_t len;
+  size_t i;
+  parse_error *err;
+  // the names of the groups opened so far, in `s`.
+  size_t group_start[MAX_GROUPS];
+  size_t group_len[MAX_GROUPS];
+  unsigned n_groups;
+} parser;
+
+static ast *parse_alt(parser *p);
+
+static int at_end(const parser *p) { return p->i >= p->len; }
+
+// records the first error, the parsing functions then unwind returning NULL.
+static void *fail(parser *p, const char *message) {
+  if (!p->err->message) {
+    p->err->message = message;
+    p->err->offset = p->i;
+  }
+  return NULL;
+}
+
+static int failed(const parser *p) { return p->err->message != NULL; }
+
+static ast *literal(unsigned char c) {
+  byte_set s = {0};
+  byte_set_insert(&s, c);
+  return ast_new_set(&s);
+}
+
+static unsigned parse_hex(parser *p, size_t max_digits) {
+  unsigned value = 0;
+  size_t digits = 0;
+  for (; digits < max_digits && !at_end(p) && isxdigit(p->s[p->i]); digits++) {
+    char h = p->s[p->i++];
+    value = value * 16 + (isdigit(h) ? h - '0' : tolower(h) - 'a' + 10);
+  }
+  if (digits == 0)
+    fail(p, "expected a hexadecimal number");
+  return value;
+}
+
+// a single character of the regex: an escape sequence, a UTF-8 encoded code
+// point, or a byte that is not valid UTF-8. `raw` is set in the last case,
+// and for `\xHH` escapes, which also stand for a byte.
+static uint32_t parse_char(parser *p, int *raw) {
+  const unsigned char *s = (const unsigned char *)p->s + p->i;
+  uint32_t cp;
+  *raw = 0;
+
+  if (s[0] == '\\') {
+    if (p->i + 1 >= p->len) {
+      fail(p, "dangling escape at the end of the regex");
+      return 0;
+    }
+    p->i += 2;
+    switch (s[1]) {
+    case 'x':
+      *raw = 1;
+      cp = parse_hex(p, 2);
+      break;
+    case 'u':
+      if (at_end(p) || p->s[p->i++] != '{') {
+        fail(p, "expected '{' after '\\u'");
+        return 0;
+      }
+      cp = parse_hex(p, 6);
+      if (at_end(p) || p->s[p->i++] != '}') {
+        fail(p, "expected '}' to close '\\u{'");
+        return 0;
+      }
+      if (cp > UTF8_MAX || (cp >= 0xD800 && cp <= 0xDFFF))
+        fail(p, "invalid code point");
+      break;
+    default:
+      cp = (unsigned char)s[1] < sizeof escape_sequences
+               ? (unsigned char)escape_sequences[(unsigned char)s[1]]
+               : '\0';
+      if (cp == '\0')
+        fail(p, "unknown char escape code");
+    }
+    if (cp == '\0')
+      fail(p, "the NUL character can not be matched");
+    return cp;
+  }
+  if (s[0] == '\0') {
+    fail(p, "the NUL character can not be matched");
+    return 0;
+  }
+
+  size_t n = utf8_decode(s, p->len - p->i, &cp);
+  if (n == 0) {
+    *raw = 1;
+    n = 1;
+    cp = s[0];
+  }
+  p->i += n;
+  return cp;
+}
+
+static ast *code_point(uint32_t cp, int raw) {
+  if (raw || cp < 0x80)
+    return literal(cp);
+
+  unsigned char bytes[4];
+  size_t n = utf8_encode(cp, bytes);
+  ast *a = ast_new(AST_CONCAT);
+  for (size_t i = 0; i < n; i++)
+    ast_append(a, literal(bytes[i]));
+  return a;
+}
+
+// `[a-zα-ω_]`: any number of characters and ranges. code points past ASCII
+// become alternations of UTF-8 byte sequences.
+static ast *parse_class(parser *p) {
+  byte_set bytes = {0};
+  ast *alt = ast_new(AST_ALT);
+
+  do {
+    int raw_first, raw_last;
+    uint32_t first = parse_char(p, &raw_first);
+    uint32_t last = first;
+    raw_last = raw_first;
+    if (p->i + 1 < p->len && p->s[p->i] == '-' && p->s[p->i + 1] != ']') {
+      p->i++;
+      last = parse_char(p, &raw_last);
+    }
+
+    // a range with a byte at either end is a range of bytes.
+    int raw = raw_first || raw_last;
+    if (first > last)
+      fail(p, "invalid range in class");
+    else if (raw && last > 0xFF)
+      fail(p, "class ranges can not mix bytes and code points");
+    if (failed(p)) {
+      ast_free(alt);
+      return NULL;
+    }
+
+    uint32_t byte_limit = raw ? 0xFF : 0x7F;
+    for (uint32_t c = first; c <= last && c <= byte_limit; c++)
+      if (c)
+        byte_set_insert(&bytes, c);
+    if (!raw && last >= 0x80)
+      utf8_sequences(first < 0x80 ? 0x80 : first, last, alt);
+  } while (!at_end(p) && p->s[p->i] != ']');
+
+  if (at_end(p)) {
+    ast_free(alt);
+    return fail(p, "unclosed square brackets");
+  }
+  p->i++;
+
+  if (alt->children.size == 0) {
+    ast_free(alt);
+    return ast_new_set(&bytes);
+  }
+  for (unsigned i = 0; i < 4; i++) {
+    if (bytes.bits[i]) {
+      ast_append(alt, ast_new_set(&bytes));
+      break;
+    }
+  }
+  return alt;
+}
+
+// `(?<name>`, the opening of a capture group, whose name is made of
+// letters and digits.
+static int parse_group_name(parser *p, char **name) {
+  size_t start = p->i += 3;
+  while (!at_end(p) && isalnum((unsigned char)p->s[p->i]))
+    p->i++;
+  if (p->i == start) {
+    fail(p, "expected the name of the group");
+    return 0;
+  }
+  if (at_end(p) || p->s[p->i] != '>') {
+    fail(p, "expected '>' after the name of the group");
+    return 0;
+  }
+  size_t len = p->i++ - start;
+
+  for (unsigned g = 0; g < p->n_groups; g++) {
+    if (p->group_len[g] == len &&
+        !memcmp(p->s + p->group_start[g], p->s + start, len)) {
+      fail(p, "duplicate group name");
+      return 0;
+    }
+  }
+  if (p->n_groups == MAX_GROUPS) {
+    fail(p, "too many capture groups");
+    return 0;
+  }
+  p->group_start[p->n_groups] = start;
+  p->group_len[p->n_groups++] = len;
+  *name = strndup(p->s + start, len);
+  return 1;
+}
+
+static ast *parse_atom(parser *p) {
+  int raw;
+  switch (p->s[p->i]) {
+  case '(': {
+    char *name = NULL;
+    unsigned group = p->n_groups;
+    if (p->i + 2 < p->len && p->s[p->i + 1] == '?' && p->s[p->i + 2] == '<') {
+      if (!parse_group_name(p, &name))
+        return NULL;
+    } else {
+      p->i++;
+    }
+    ast *inner = parse_alt(p);
+    if (!inner) {
+      free(name);
+      return NULL;
+    }
+    if (at_end(p) || p->s[p->i] != ')') {
+      free(name);
+      ast_free(inner);
+      return fail(p, "unclosed parentheses");
+    }
+    p->i++;
+    if (!name)
+      return inner;
+    ast *capture = ast_new_unary(AST_CAPTURE, inner);
+    capture->group = group;
+    capture->name = name;
+    return capture;
+  }
+  case ']':
+    return fail(p, "closing square brackets without opening");
+  case '[':
+    p->i++;
+    if (at_end(p))
+      return fail(p, "unclosed square brackets");
+    return parse_class(p);
+  default: {
+    uint32_t cp = parse_char(p, &raw);
+    if (failed(p))
+      return NULL;
+    return code_point(cp, raw);
+  }
+  }
+}
+
+// a decimal number of at most MAX_REPEAT, or -1.
+static long parse_bound(parser *p) {
+  long n = -1;
+  while (!at_end(p) && isdigit((unsigned char)p->s[p->i])) {
+    n = (n < 0 ? 0 : n) * 10 + (p->s[p->i++] - '0');
+    if (n > MAX_REPEAT) {
+      fail(p, "the bound of the repetition is too large");
+      return -1;
+    }
+  }
+  return n;
+}
+
+// `{n}`, `{n,}` or `{n,m}`. returns 0 without moving if there is no such
+// repetition here, as a `{` that is not followed by one is a literal.
+static int parse_bounds(parser *p, unsigned *min, unsigned *max) {
+  size_t start = p->i++;
+  long n = parse_bound(p), m = n;
+  if (failed(p))
+    return -1;
+  if (n >= 0 && !at_end(p) && p->s[p->i] == ',') {
+    p->i++;
+    m = parse_bound(p);
+    if (failed(p))
+      return -1;
+  }
+  if (n < 0 || at_end(p) || p->s[p->i] != '}') {
+    p->i = start;
+    return 0;
+  }
+  p->i++;
+  if (m >= 0 && m < n) {
+    p->i = start;
+    fail(p, "the repetition has a minimum above its maximum");
+    return -1;
+  }
+  *min = n;
+  *max = m < 0 ? REPEAT_UNBOUNDED : (unsigned)m;
+  return 1;
+}
+
+static ast *parse_postfix(parser *p) {
+  ast *a;
+  if (p->s[p->i] == '~') {
+    p->i++;
+    if (at_end(p) || (p->s[p->i] && strchr("|&-)", p->s[p->i])))
+      return fail(p, "nothing to complement");
+    a = parse_postfix(p);
+    if (a && ast_groups(a, NULL)) {
+      ast_free(a);
+      return fail(p, "capture groups can not be complemented");
+    }
+    return a ? ast_new_unary(AST_NOT, a) : NULL;
+  }
+  if (p->s[p->i] == '*' || p->s[p->i] == '+')
+    return fail(p, "nothing to repeat");
+
+  a = parse_atom(p);
+  while (a && !at_end(p)) {
+    if (p->s[p->i] == '*' || p->s[p->i] == '+') {
+      a = ast_new_unary(p->s[p->i++] == '*' ? AST_STAR : AST_PLUS, a);
+    } else if (p->s[p->i] == '{') {
+      unsigned min, max;
+      int bounds = parse_bounds(p, &min, &max);
+      if (bounds < 0) {
+        ast_free(a);
+        return NULL;
+      }
+      if (!bounds)
+        break;
+      a = ast_new_unary(AST_REPEAT, a);
+      a->min = min;
+      a->max = max;
+    } else {
+      break;
+    }
+  }
+  return a;
+}
+
+static ast *parse_concat(parser *p) {
+  ast *a = ast_new(AST_CONCAT);
+  while (!at_end(p) && !(p->s[p->i] && strchr("|&-)", p->s[p->i]))) {
+    ast *c = parse_postfix(p);
+    if (!c) {
+      ast_free(a);
+      return NULL;
+    }
+    ast_append(a, c);
+  }
+  return a;
+}
+
+// `&` and `-` bind tighter than `|`, and associate to the left.
+static ast *parse_product(parser *p) {
+  ast *a = parse_concat(p);
+  while (a && !at_end(p) && (p->s[p->i] == '&' || p->s[p->i] == '-')) {
+    if (ast_groups(a, NULL))
+      fail(p, "capture groups can not be intersected or subtracted");
+    ast_kind kind = p->s[p->i++] == '&' ? AST_AND : AST_DIFF;
+    ast *c = failed(p) ? NULL : parse_concat(p);
+    if (c && ast_groups(c, NULL))
+      fail(p, "capture groups can not be intersected or subtracted");
+    if (!c || failed(p)) {
+      ast_free(a);
+      ast_free(c);
+      return NULL;
+    }
+    if (a->kind != kind)
+      a = ast_new_unary(kind, a);
+    ast_append(a, c);
+  }
+  return a;
+}
+
+static ast *parse_alt(parser *p) {
+  ast *a = parse_product(p);
+  if (!a || at_end(p) || p->s[p->i] != '|')
+    return a;
+
+  a = ast_new_unary(AST_ALT, a);
+  while (!at_end(p) && p->s[p->i] == '|') {
+    p->i++;
+    ast *c = parse_product(p);
+    if (!c) {
+      ast_free(a);
+      return NULL;
+    }
+    ast_append(a, c);
+  }
+  return a;
+}
+
+ast *parse_regex(const char *regex, size_t regex_len, parse_error *err) {
+  *err = (parse_error){0};
+  parser p = {.s = regex, .len = regex_len, .i = 0, .err = err};
+  ast *a = parse_alt(&p);
+  if (a && !at_end(&p)) {
+    ast_free(a);
+    return fail(&p, "closing parentheses without opening");
+  }
+  return a;
+}
@@ -0,0 +1,86 @@
+#ifndef AST_H_
+#define AST_H_
+#include "util.h"
+
+typedef struct {
+  uint64_t bits[4];
+} byte_set;
+
+static inline int byte_set_has(const byte_set *s, unsigned char c) {
+  return (s->bits[c / 64] >> (c % 64)) & 1;
+}
+
+static inline void byte_set_insert(byte_set *s, unsigned char c) {
+  s->bits[c / 64] |= (uint64_t)1 << (c % 64);
+}
+
+static inline void byte_set_union(byte_set *s, const byte_set *o) {
+  for (int i = 0; i < 4; i++)
+    s->bits[i] |= o->bits[i];
+}
+
+typedef enum {
+  AST_EMPTY,   // matches the empty string
+  AST_SET,     // matches any single byte in `set`
+  AST_CONCAT,  // children matched in sequence
+  AST_ALT,     // any of the children
+  AST_STAR,    // zero or more repetitions of the only child
+  AST_PLUS,    // one or more repetitions of the only child
+  AST_AND,     // matched by every child
+  AST_DIFF,    // matched by the first child and none of the others
+  AST_NOT,     // not matched by the only child
+  AST_CAPTURE, // the only child, whose offsets are reported as `group`
+  AST_REPEAT,  // from `min` to `max` repetitions of the only child
+} ast_kind;
+
+// capture groups are numbered from 0 in the order of their opening
+// parentheses.
+#define MAX_GROUPS 32
+
+// the largest bound of `x{n,m}`. REPEAT_UNBOUNDED is the maximum of `x{n,}`.
+#define MAX_REPEAT 65535
+#define REPEAT_UNBOUNDED ((unsigned)-1)
+
+typedef struct ast {
+  ast_kind kind;
+  byte_set set;
+  vector children; // of `struct ast *`
+  unsigned group;  // of an AST_CAPTURE
+  char *name;      // of an AST_CAPTURE
+  unsigned min;    // of an AST_REPEAT
+  unsigned max;    // of an AST_REPEAT
+} ast;
+
+ast *ast_new(ast_kind kind);
+ast *ast_new_set(const byte_set *set);
+ast *ast_new_unary(ast_kind kind, ast *child);
+void ast_append(ast *parent, ast *child);
+ast *ast_child(const ast *a, size_t index);
+ast *ast_clone(const ast *a);
+// a new tree matching the strings of `a` read backwards.
+ast *ast_reverse(const ast *a);
+void ast_free(ast *a);
+
+// total order on trees, 0 iff the trees are structurally identical.
+int ast_cmp(const ast *a, const ast *b);
+
+// writes a canonical prefix notation of `a`, which is the same for two trees
+// iff `ast_cmp` finds them identical.
+void ast_print(const ast *a, FILE *stream);
+
+// the number of capture groups in `a`. if `names` is not NULL, the name of
+// group `i` is stored in `names[i]`.
+unsigned ast_groups(const ast *a, const char **names);
+
+// number of states Thompson's construction allocates for `a`.
+size_t ast_nfa_size(const ast *a);
+
+typedef struct {
+  const char *message; // NULL if there was no error
+  size_t offset;       // where in the regex the error was found
+} parse_error;
+
+// returns NULL, and fills `err`, if the regex is malformed.
+ast *parse_regex(const char *regex, size_t regex_len, parse_error *err);
+
+#endif // AST_H_
@@ -7,46 +7,95 @@ int line_cmp(const void *a, const void *b) {
   return ((line *)a)->id - ((line *)b)->id;
 }
 int path_cmp(const void *a, const void *b) {
-  return ((path *)a)->trigger - ((path *)b)->trigger;
+  const path *aa = a;
+  const path *bb = b;
+  if (aa->first != bb->first)
+    return aa->first - bb->first;
+  return aa->last - bb->last;
+}
+
+line *find_line(vector *matrix, state_id_t id) {
+  line key = {.id = id};
+  return vec_find_sorted(matrix, &key);
+}
+
+// the path whose range contains `c`, in a line of disjoint ranges.
+path *find_path(const line *l, unsigned char c) {
+  size_t lo = 0, hi = l->paths.size;
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    path *p = elem_at(&l->paths, mid);
+    if (p->last < c)
+      lo = mid + 1;
+    else if (p->first > c)
+      hi = mid;
+    else
+      return p;
+  }
+  return NULL;
 }
 
 unsigned transition_matrix_find(vector *matrix, state_id_t row,
                                 unsigned char col) {
-  line l = {row, P_VEC()};
-  const path p = {col, 0};
-
-  const line *ll = vec_find_sorted(matrix, &l);
-  destroy(&l.paths);
+  const line *ll = find_line(matrix, row);
   if (!ll)
     return 0;
 
-  const path *pp = vec_find_sorted(&ll->paths, &p);
+  const path *pp = find_path(ll, col);
   if (!pp)
     return 0;
 
   return pp->end_state;
 }
 
-void transition_matrix_insert(vector *matrix, state_id_t start, unsigned char c,
+void transition_matrix_insert(vector *matrix, state_id_t start,
+                              unsigned char first, unsigned char last,
                               state_id_t dest) {
-  const path p = {c, dest};
-  line l = {start, P_VEC()};
-
-  line *ll = vec_find_sorted(matrix, &l);
+  const path p = {first, last, dest};
+  line *ll = find_line(matrix, start);
   if (!ll) {
-    vec_insert_sorted(&l.paths, &p);
+    const line l = {start, P_VEC(p)};
     vec_insert_sorted(matrix, &l);
     return;
   }
-  // only freed if not inserted into the matrix as a line
-  destroy(&l.paths);
 
+  assert(!find_path(ll, first) && !find_path(ll, last) &&
+         "overlapping transitions");
+  vec_insert_sorted(&ll->paths, &p);
+
+  // merge with the neighbouring ranges if they lead to the same state.
   path *pp = vec_find_sorted(&ll->paths, &p);
-  if (!pp) {
-    vec_insert_sorted(&ll->paths, &p);
-    return;
+  size_t i = index_of(&ll->paths, pp);
+  path *paths = ll->paths.ptr;
+  if (i + 1 < ll->paths.size && paths[i + 1].end_state == dest &&
+      paths[i + 1].first == last + 1) {
+    paths[i].last = paths[i + 1].last;
+    memmove(paths + i + 1, paths + i + 2,
+            (ll->paths.size - i - 2) * sizeof(path));
+    ll->paths.size--;
+  }
+  if (i > 0 && paths[i - 1].end_state == dest &&
+      paths[i - 1].last + 1 == first) {
+    paths[i - 1].last = paths[i].last;
+    memmove(paths + i, paths + i + 1, (ll->paths.size - i - 1) * sizeof(path));
+    ll->paths.size--;
+  }
+}
+
+void mark_cuts(vector *m, const bit_set *states, unsigned char cut[257]) {
+  memset(cut, 0, 257);
+  ITERATE_BITSET(id, *states) {
+    line key = {.id = id};
+    line *l = vec_find_sorted(m, &key);
+    if (!l)
+      continue;
+    ITER(path, p, &l->paths) {
+      if (p->first == '\0')
+        continue;
+      cut[p->first] = 1;
+      cut[p->last + 1] = 1;
+    }
   }
-  pp->end_state = dest;
 }
 
 int set_cmp(const void *a, const void *b) {
@@ -77,12 +126,19 @@ dfa *to_dfa(nfa *N) {
     vec_pop_back(&Wl, &q);
 
     bit_set *source = vec_find(&Q, &q);
+    thread_counters.lookups++;
     // we should be able to find the element in Q,
     // since Wl is a subset of Q.
     assert(source != NULL);
     state_id_t id_source = index_of(&Q, source);
 
-    for (unsigned c = 1; c < 256; c++) {
+    unsigned char cut[257];
+    mark_cuts(&N->t_matrix, &q, cut);
+
+    // every byte in [c, next) leads to the same set of states.
+    for (unsigned c = 1, next; c < 256; c = next) {
+      for (next = c + 1; next < 256 && !cut[next]; next++)
+        ;
 
       bit_set tmp = delta(N, &q, c);
       if (empty(&tmp))
@@ -90,17 +146,26 @@ dfa *to_dfa(nfa *N) {
 
       bit_set t = eps_closure(N, &tmp);
       bit_set *dest_p = vec_find(&Q, &t);
+      thread_counters.lookups++;
 
       state_id_t id_dest;
       if (dest_p)
         id_dest = index_of(&Q, dest_p);
       else {
+        if (Q.size >= MAX_NFA_SIZE) {
+          destroy(&Q);
+          destroy(&Wl);
+          delete_dfa(result);
+          free(result);
+          return NULL;
+        }
         vec_insert(&Q, &t);
         vec_insert(&Wl, &t);
         id_dest = Q.size - 1;
       }
 
-      transition_matrix_insert(&result->t_matrix, id_source, c, id_dest);
+      transition_matrix_insert(&result->t_matrix, id_source, c, next - 1,
+                               id_dest);
     }
   }
 
@@ -119,6 +184,8 @@ dfa *to_dfa(nfa *N) {
     }
   next_iter:;
   }
+  destroy(&Q);
+  destroy(&Wl);
   return result;
 }
 
@@ -126,10 +193,10 @@ bit_set delta(nfa *N, bit_set *q, unsigned char c) {
   bit_set result = {0};
   ITERATE_BITSET(id, *q) {
     line key = {.id = id};
-    line *l = vec_find(&N->t_matrix, &key);
+    line *l = vec_find_sorted(&N->t_matrix, &key);
     if (l) {
       ITER(path, p, &l->paths) {
-        if (p->trigger == c) {
+        if (p->first != '\0' && p->first <= c && c <= p->last) {
           set_insert(&result, p->end_state);
         }
       }
@@ -141,16 +208,17 @@ bit_set delta(nfa *N, bit_set *q, unsigned char c) {
 bit_set eps_closure(nfa *N, const bit_set *in) {
   bit_set result = *in;
   bit_set worklist = *in;
+  thread_counters.closures++;
 
   state_id_t start_id;
   while ((start_id = set_pop(&worklist)) != 0) {
     line key = {.id = start_id};
     // here we could skip the construction of the key.
     // since we only check the id, &start_id looks like a valid line*.
-    line *l = vec_find(&N->t_matrix, &key);
+    line *l = vec_find_sorted(&N->t_matrix, &key);
     if (l) {
       ITER(path, p, &l->paths) {
-        if (p->trigger == '\0' && !set_has(&result, p->end_state)) {
+        if (p->first == '\0' && !set_has(&result, p->end_state)) {
           set_insert(&result, p->end_state);
           set_insert(&worklist, p->end_state);
         }
@@ -170,40 +238,50 @@ typedef struct {
   bit_set r;
 } set_tuple;
 
-set_tuple split(dfa *D, vector *P, const bit_set *s) {
+// the destination of `c` from a line of the transition matrix, which may be
+// NULL.
+static state_id_t row_find(const line *l, unsigned char c) {
+  const path *p = l ? find_path(l, c) : NULL;
+  return p ? p->end_state : 0;
+}
+
+// `rows[id]` is the line of state `id`, and `block[id]` the index of its block
+// in the partition being refined, -1 for the error state.
+set_tuple split(const line *const *rows, const int *block, const bit_set *s) {
   set_tuple result = {0};
   assert(!empty(s));
 
-  for (unsigned c = 1; c < 256; c++) {
-    bit_set *expect = NULL;
+  unsigned char cut[257] = {0};
+  ITERATE_BITSET(id, *s) {
+    if (!rows[id])
+      continue;
+    ITER(path, p, &rows[id]->paths) {
+      cut[p->first] = 1;
+      cut[p->last + 1] = 1;
+    }
+  }
+
+  for (unsigned c = 1, next; c < 256; c = next) {
+    for (next = c + 1; next < 256 && !cut[next]; next++)
+      ;
+
+    int expect = 0;
     int first_iter = 1;
-    state_id_t dest;
 
     ITERATE_BITSET(id, *s) {
-      dest = transition_matrix_find(&D->t_matrix, id, c);
+      int dest = block[row_find(rows[id], c)];
       if (first_iter) { // set the expectation
-        ITER(bit_set, b, P) {
-          assert(b);
-          if (set_has(b, dest)) {
-            expect = b;
-            break;
-          }
-        }
+        expect = dest;
         first_iter = 0;
-      } else { // check that every id meets the expectation
-        if ((expect && !dest) || (!expect && dest) ||
-            (expect && !set_has(expect, dest))) {
-          goto split_set;
-        }
+      } else if (dest != expect) { // check that every id meets it
+        goto split_set;
       }
     }
     continue;
 
   split_set:
     ITERATE_BITSET(id, *s) {
-      dest = transition_matrix_find(&D->t_matrix, id, c);
-      if ((expect && !dest) || (!expect && dest) ||
-          (expect && !set_has(expect, dest))) {
+      if (block[row_find(rows[id], c)] != expect) {
         set_insert(&result.r, id);
       } else {
         set_insert(&result.l, id);
@@ -219,16 +297,17 @@ set_tuple split(dfa *D, vector *P, const bit_set *s) {
 
 dfa *minimize(dfa *D) {
 
-  bit_set elems = set_iota(1, D->n_states - 1);
+  bit_set elems = set_iota(1, D->n_states);
   bit_set c = set_complement(&elems, &D->accepting_states);
   vector T;
-  vector P;
 
   // TODO: clean up this mess.
   // currently the minimisation roughly preserves order of the states, so the
   // first state of the first set is kept there.  it would be nice not to
   // depend on this behaviour.
-  if (!empty(&c)) {
+  if (empty(&D->accepting_states)) {
+    T = S_VEC(c);
+  } else if (!empty(&c)) {
     state_id_t start = 1;
     if (set_has(&D->accepting_states, start))
       T = S_VEC(D->accepting_states, c);
@@ -237,36 +316,123 @@ dfa *minimize(dfa *D) {
   } else
     T = S_VEC(D->accepting_states);
 
-  P = S_VEC();
+  return minimize_blocks(D, &T, set_iota(0, T.size), NULL);
+}
 
-  while (T.size > P.size) {
-    destroy(&P);
+dfa *minimize_blocks(dfa *D, vector *blocks, bit_set dirty, state_id_t *map) {
+  vector T = *blocks; // the blocks, by index
+
+  // the blocks are kept in the order of Moore's algorithm, where the two
+  // parts of a block replace it, by a list: `next[b]` is the block after `b`.
+  state_id_t n = D->n_states;
+  int *next = malloc(n * sizeof(int));
+  for (size_t b = 0; b < T.size; b++)
+    next[b] = b + 1 < T.size ? (int)b + 1 : -1;
+  int *block = malloc(n * sizeof(int));
+  block[0] = -1;
+  ITER(bit_set, s, &T) {
+    ITERATE_BITSET(id, *s) { block[id] = index_of(&T, s); }
+  }
 
-    P = T;
-    T = S_VEC();
+  const line **rows = calloc(n, sizeof(line *));
+  ITER(line, l, &D->t_matrix) { rows[l->id] = l; }
 
-    ITER(bit_set, s, &P) {
-      set_tuple parts = split(D, &P, s);
+  // the states with a transition to each state: pred[first[id]..first[id+1]).
+  size_t *first = calloc(n + 1, sizeof(size_t));
+  ITER(line, l, &D->t_matrix) {
+    ITER(path, p, &l->paths) { first[p->end_state + 1]++; }
+  }
+  for (state_id_t id = 1; id <= n; id++)
+    first[id] += first[id - 1];
+  state_id_t *pred = malloc((first[n] + 1) * sizeof(state_id_t));
+  size_t *fill = malloc(n * sizeof(size_t));
+  memcpy(fill, first, n * sizeof(size_t));
+  ITER(line, l, &D->t_matrix) {
+    ITER(path, p, &l->paths) { pred[fill[p->end_state]++] = l->id; }
+  }
+  free(fill);
+
+  // each round splits the blocks on the blocks of the previous round, as in
+  // Moore's algorithm, but only the blocks that can split are visited: the
+  // ones split in the previous round, and the ones with a transition to
+  // them. the others still agree on every byte.
+  vector splits = VEC(set_tuple, NULL);
+  vector parts_of = VEC(int, NULL);
+  for (;;) {
+    thread_counters.rounds++;
+    splits.size = parts_of.size = 0;
+    ITERATE_BITSET(b, dirty) {
+      set_tuple parts = split(rows, block, elem_at(&T, b));
       assert(!empty(&parts.l));
-      vec_insert(&T, &parts.l);
-      if (!empty(&parts.r)) {
-        vec_insert(&T, &parts.r);
+      if (empty(&parts.r))
+        continue;
+      int index = b;
+      vec_insert(&splits, &parts);
+      vec_insert(&parts_of, &index);
+    }
+    if (!splits.size)
+      break;
+
+    set_tuple *parts = splits.ptr;
+    int *split_block = parts_of.ptr;
+    for (size_t i = 0; i < splits.size; i++) {
+      int b = split_block[i], r = T.size;
+      *(bit_set *)elem_at(&T, b) = parts[i].l;
+      vec_insert(&T, &parts[i].r);
+      next[r] = next[b];
+      next[b] = r;
+      ITERATE_BITSET(id, parts[i].r) { block[id] = r; }
+    }
+    dirty = (bit_set){0};
+    for (size_t i = 0; i < splits.size; i++) {
+      set_insert(&dirty, split_block[i]);
+      set_insert(&dirty, block[set_peek(&parts[i].r)]);
+      bit_set *halves[] = {&parts[i].l, &parts[i].r};
+      for (int h = 0; h < 2; h++)
+        ITERATE_BITSET(id, *halves[h]) {
+          for (size_t k = first[id]; k < first[id + 1]; k++)
+            set_insert(&dirty, block[pred[k]]);
+        }
+    }
+  }
+  destroy(&splits);
+  destroy(&parts_of);
+
+  // the blocks that can not reach an accepting state merge with the error
+  // state, so that matching stops as soon as no match is possible. the start
+  // state is kept even if the language is empty.
+  bit_set live = D->accepting_states;
+  bit_set todo = D->accepting_states;
+  for (state_id_t id; (id = set_pop(&todo));) {
+    for (size_t k = first[id]; k < first[id + 1]; k++) {
+      if (pred[k] && !set_has(&live, pred[k])) {
+        set_insert(&live, pred[k]);
+        set_insert(&todo, pred[k]);
       }
     }
   }
+  free(first);
+  free(pred);
+
+  state_id_t *new_id = calloc(T.size, sizeof(state_id_t));
+  state_id_t n_states = 1;
+  for (int b = 0; b >= 0; b = next[b]) {
+    bit_set *s = elem_at(&T, b);
+    if (set_has(&live, set_peek(s)) || set_has(s, 1))
+      new_id[b] = n_states++;
+  }
 
   dfa *R = calloc(sizeof(dfa), 1);
   R->t_matrix = L_VEC();
 
-  R->n_states = T.size + 1;
+  R->n_states = n_states;
   R->accepting_states = (bit_set){0};
 
-
-  ITER(bit_set, b, &T) {
-    state_id_t start_id =
-        index_of(&T, b) + 1; // +1 leaves space for ERR state = 0
-    assert(!empty(b));
-    state_id_t elem = set_peek(b);
+  for (int b = 0; b >= 0; b = next[b]) {
+    state_id_t start_id = new_id[b];
+    if (!start_id)
+      continue;
+    state_id_t elem = set_peek(elem_at(&T, b));
     if (set_has(&D->accepting_states, elem)) {
       set_insert(&R->accepting_states, start_id);
     }
@@ -274,37 +440,60 @@ dfa *minimize(dfa *D) {
     // all elements of this set should have the same
     // destination as each other for every char, so we can just check
     // for the first.
-    line key = {.id = elem};
-    line *ll = vec_find(&D->t_matrix, &key);
-
-    if (ll) {
-      ITER(path, p, &ll->paths) {
-        ITER(bit_set, q, &T) {
-          if (set_has(q, p->end_state)) {
-            transition_matrix_insert(&R->t_matrix, start_id,
-                                     p->trigger, index_of(&T, q) + 1);
-            break;
-          }
-        }
+    if (rows[elem]) {
+      ITER(path, p, &rows[elem]->paths) {
+        state_id_t end_id = new_id[block[p->end_state]];
+        if (end_id)
+          transition_matrix_insert(&R->t_matrix, start_id, p->first, p->last,
+                                   end_id);
       }
     }
   }
 
+  if (map) {
+    map[0] = 0;
+    for (state_id_t id = 1; id < n; id++)
+      map[id] = new_id[block[id]];
+  }
+  free(new_id);
+  free(block);
+  free(next);
+  free(rows);
+  destroy(&T);
   return R;
 }
 
+size_t nfa_size(const nfa *N) {
+  size_t n = 0;
+  ITER(line, l, &N->t_matrix) {
+    n = l->id > n ? l->id : n;
+    ITER(path, p, &l->paths) { n = p->end_state > n ? p->end_state : n; }
+  }
+  return n;
+}
+
+dfa *copy_dfa(dfa *D) {
+  dfa *result = calloc(sizeof(dfa), 1);
+  *result = *D;
+  result->t_matrix = L_VEC();
+  ITER(line, l, &D->t_matrix) {
+    line copy = {.id = l->id, .paths = P_VEC()};
+    ITER(path, p, &l->paths) { vec_insert(&copy.paths, p); }
+    vec_insert(&result->t_matrix, &copy);
+  }
+  return result;
+}
+
 void delete_nfa(nfa *N) {
     ITER(line, l, &N->t_matrix) {
-        free(l->paths.ptr);
+        destroy(&l->paths);
     }
-    free(N->t_matrix.ptr);
+    destroy(&N->t_matrix);
 }
 
 void delete_dfa(dfa *D) {
     ITER(line, l, &D->t_matrix) {
-        free(l->paths.ptr);
+        destroy(&l->paths);
     }
-    free(D->t_matrix.ptr);
-}
-
-
+    destroy(&D->t_matrix);
+}
\ No newline at end of file
@@ -8,8 +8,11 @@ typedef struct {
   vector paths;
 } line;
 
+// every byte in [first, last] leads to `end_state`.
+// epsilon moves are the only paths with first == '\0'.
 typedef struct {
-  unsigned char trigger;
+  unsigned char first;
+  unsigned char last;
   state_id_t end_state;
 } path;
 
@@ -50,14 +53,36 @@ typedef struct {
     bit_set accepting_states;
 } dfa;
 
-void transition_matrix_insert(vector*T, state_id_t start, unsigned char c, state_id_t dest);
-unsigned transition_matrix_find(vector *m, state_id_t start, unsigned char dest);
+void transition_matrix_insert(vector *T, state_id_t start, unsigned char first,
+                              unsigned char last, state_id_t dest);
+unsigned transition_matrix_find(vector *m, state_id_t start, unsigned char c);
+line *find_line(vector *m, state_id_t id);
+path *find_path(const line *l, unsigned char c);
+
+// marks in `cut` the bytes where some path leaving one of `states` begins,
+// and the ones right after it ends. bytes between two consecutive cuts
+// lead to the same states.
+void mark_cuts(vector *m, const bit_set *states, unsigned char cut[257]);
 
 bit_set eps_closure(nfa *N, const bit_set *in);
 bit_set delta(nfa *N, bit_set *q, unsigned char c);
+// NULL if the DFA would exceed MAX_NFA_SIZE states.
 dfa *to_dfa(nfa *N);
 
 dfa *minimize(dfa *D);
+// minimizes `D` from the partition of its states in `blocks`, a vector of
+// bit_set which it takes over: states in different blocks stay apart. only
+// the blocks in `dirty` are split at first, the others must already agree
+// on the blocks of every byte. `map`, if not NULL, receives the new id of
+// every state of `D`, 0 for the ones merged with the error state. the
+// blocks are numbered in order, the ones that can not reach an accepting
+// state dropped.
+dfa *minimize_blocks(dfa *D, vector *blocks, bit_set dirty, state_id_t *map);
+
+// the largest state id of `N`, which is its number of states.
+size_t nfa_size(const nfa *N);
+
+dfa *copy_dfa(dfa *D);
 
 void delete_nfa(nfa *N);
 void delete_dfa(dfa *D);
@@ -1,19 +1,63 @@
+#define _POSIX_C_SOURCE 200809L
 #include "scanner_generator.h"
 #include "automata.h"
 #include "thompson.h"
 #include "dfa.h"
+#include "dfa_binary.h"
+#include "dfa_cache.h"
+#include "derivative.h"
+#include "levenshtein.h"
+#include "parallel_dfa.h"
+#include "profile.h"
+#include "rule_set.h"
+#include "shared_dfa.h"
+#include "simplify.h"
+#include "thread_pool.h"
+#include "trie.h"
 #include <ctype.h>
+#include <errno.h>
+#include <signal.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
 
 struct {
   unsigned nfa_graph     : 1;
   unsigned dfa_graph     : 1;
   unsigned minimal_graph : 1;
   unsigned generate_code : 1;
+  unsigned report        : 1;
+  unsigned search        : 1;
+  unsigned emit_binary   : 1;
+  unsigned use_cache     : 1;
+  unsigned stats         : 2; // NO_STATS, STATS_TEXT or STATS_JSON
+  unsigned derivatives   : 1; // build DFAs from derivatives, without NFAs
+  unsigned shared        : 1; // the rules of a file share their states
+  unsigned d2fa          : 2; // NO_D2FA, D2FA_GOTO or D2FA_TABLE
+  unsigned jobs;         // threads compiling rules
+  unsigned dfa_threads;  // threads determinizing each rule, 0 if serial
+  unsigned distance;     // edits allowed in a match
+  const char *cache_dir; // NULL if there is no cache
+  const char *socket;    // where to serve requests, "-" for stdin
+  unsigned profile_generate : 1;
+  const char *profile_use; // the profile laying out the code, or NULL
+  const char *union_name;  // the scanner of all the rules of a file, or NULL
+  unsigned tokenize : 1;   // the union also gets a tokenizer
+  vector skip;             // of const char *: the rules the tokenizer drops
 } options;
 
+enum { NO_STATS, STATS_TEXT, STATS_JSON };
+enum { NO_D2FA, D2FA_GOTO, D2FA_TABLE };
+
+dfa_cache cache;
+profile_set profiles;
+
 void usage(FILE *stream) {
   fprintf(
       stream,
@@ -47,7 +91,1089 @@ void usage(FILE *stream) {
       "    -a --all-graphs Like -g, but also generates graphs for the NFA\n"
       "                    resulting from Thompson's construction and the \n"
       "                    naive DFA generated directly from that. these will\n"
-      "                    have the extensions: '.nfa.dot' and '.naive.dot'\n");
+      "                    have the extensions: '.nfa.dot' and '.naive.dot'\n"
+      "\n"
+      "    -r --report     Print to stderr, for each regex, the number of NFA\n"
+      "                    states saved by simplifying it before Thompson's\n"
+      "                    construction.\n"
+      "\n"
+      "    -s --search     Generate `unsigned long search_<regex_name>(const\n"
+      "                    char *s)` instead, returning the offset just past\n"
+      "                    the earliest ending match anywhere in `s`, or 0.\n"
+      "\n"
+      "    -j --jobs N     Compile the rules on N threads, or on one per\n"
+      "                    processor if N is 0. The output does not depend\n"
+      "                    on N.\n"
+      "\n"
+      "    -t --dfa-threads N\n"
+      "                    Determinize each regex on N threads, or on one per\n"
+      "                    processor if N is 0. States are numbered\n"
+      "                    breadth first, whatever the value of N.\n"
+      "\n"
+      "    -k --distance K\n"
+      "                    Match the strings within K edits (bytes inserted,\n"
+      "                    deleted or replaced) of a string the regex\n"
+      "                    matches, with a Levenshtein automaton built from\n"
+      "                    its minimal DFA. Groups are ignored.\n"
+      "\n"
+      "    -d --derivatives\n"
+      "                    Build the DFA of each regex directly from its\n"
+      "                    derivatives, whose states are regexes, instead\n"
+      "                    of determinizing the NFA of Thompson's\n"
+      "                    construction. `&`, `-` and `~` are derived like\n"
+      "                    the other operators.\n"
+      "\n"
+      "    --cache DIR     Keep the minimal DFA of every regex in DIR, keyed\n"
+      "                    by its simplified form, and reuse it in later\n"
+      "                    runs instead of determinizing and minimizing the\n"
+      "                    regex again. Hits and misses are printed.\n"
+      "\n"
+      "    --emit-binary   Also write the minimal DFAs to <input_filename>.bin,\n"
+      "                    in a format that `ra_binary_open` maps in memory\n"
+      "                    and matches in place.\n"
+      "\n"
+      "    --serve SOCKET  Compile batches of rules sent to the Unix socket\n"
+      "                    SOCKET, or to stdin if it is `-`, keeping their\n"
+      "                    minimal DFAs in memory for the following batches.\n"
+      "                    A batch is a line `compile [search] [code|binary|\n"
+      "                    stats]`, the rules, and a line `end`. The answer\n"
+      "                    is a line `ok|error <output bytes> <message\n"
+      "                    bytes>` followed by both. `shutdown` stops the\n"
+      "                    server.\n"
+      "\n"
+      "    --stats[=json]  Print to stdout, for each rule, the time spent in\n"
+      "                    each phase, the size of each automaton, and the\n"
+      "                    work done building them: one line of `key=value`\n"
+      "                    pairs per rule, or a JSON object.\n"
+      "\n"
+      "    --profile-generate\n"
+      "                    Make the generated code count the visits of its\n"
+      "                    states and the transitions they take, and append\n"
+      "                    them to <input_filename>.profile (or to the file\n"
+      "                    $DFA_PROFILE) when the program exits.\n"
+      "\n"
+      "    --profile-use FILE\n"
+      "                    Lay out the generated code by the counts in FILE:\n"
+      "                    hot transitions fall through to the next state,\n"
+      "                    cold states are moved to the end, and the ranges\n"
+      "                    taken most often are tested before the switch.\n"
+      "\n"
+      "    --shared        Merge the DFAs of the rules of each file, so that\n"
+      "                    the states that match the same strings in\n"
+      "                    several rules are emitted once, in a function\n"
+      "                    that each `scan_<regex_name>` enters at its own\n"
+      "                    start state. Not with the profile options.\n"
+      "\n"
+      "    --d2fa[=table]  Compress the DFA of each rule with default\n"
+      "                    transitions: a state only lists the bytes on\n"
+      "                    which it differs from its default state, and\n"
+      "                    jumps to the code of the default for the others,\n"
+      "                    or looks them up in tables with `=table`.\n"
+      "\n"
+      "    --union NAME    Also generate `scan_NAME` (or `search_NAME`) in\n"
+      "                    each file, matching what any of its rules match.\n"
+      "                    With --cache, the DFA of the union is kept in DIR\n"
+      "                    and only the rules added to the file or removed\n"
+      "                    from it since the last run change it.\n"
+      "\n"
+      "    --tokenize NAME Like --union NAME, and also generate\n"
+      "                    `tokenize_NAME(buf, len, &offset, &tokens, cap)`,\n"
+      "                    which stores the offset, length and rule of the\n"
+      "                    longest matches in `buf`, one after the other,\n"
+      "                    into the arrays of `tokens`, up to `cap` of them,\n"
+      "                    and leaves `offset` where the next call resumes.\n"
+      "                    Not with -s.\n"
+      "\n"
+      "    --skip RULE     Drop the tokens of RULE, like whitespace or\n"
+      "                    comments, in the tokenizer. Can be repeated.\n"
+      "\n"
+      "  CAPTURE GROUPS:\n"
+      "    the scanners of rules with groups `(?<name>...)` take a second\n"
+      "    argument, `long *captures`, where the offsets of the start and\n"
+      "    the end of group `<rule>_<name>` in the match are stored, or -1\n"
+      "    if the group is not part of it. Searchers, binary files and the\n"
+      "    graphs ignore the groups.\n");
+}
+
+FILE *open_graph(const char *file, const char *name, const char *extension) {
+  char dot_name[1024];
+  snprintf(dot_name, 1024, "%s_%s%s", file, name, extension);
+  return fopen(dot_name, "w");
+}
+
+typedef enum {
+  PHASE_NFA,      // parsing, simplification and Thompson's construction
+  PHASE_DFA,      // subset construction, or building the trie
+  PHASE_MINIMIZE,
+  PHASE_CODE,     // code generation and binary layout
+  N_PHASES,
+} phase;
+
+static const char *const phase_names[N_PHASES] = {
+    "regex_to_nfa", "to_dfa", "minimize", "scanner_from_dfa"};
+
+static const char *const cache_uses[] = {"none", "hit", "miss"};
+
+// what `--stats` reports for a rule. times are in seconds.
+typedef struct {
+  double time[N_PHASES];
+  size_t nfa_states, nfa_transitions;
+  size_t dfa_states, dfa_transitions;
+  size_t minimal_states, minimal_transitions;
+  work_counters work;
+} rule_stats;
+
+static double now(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static size_t count_transitions(const vector *t_matrix) {
+  size_t n = 0;
+  ITER(line, l, t_matrix) { n += l->paths.size; }
+  return n;
+}
+
+// a rule, which can be compiled on any thread. its code and messages are
+// kept in memory, so that they are written in the order of the rules.
+typedef struct {
+  const char *file;
+  char *name;
+  char *regex;
+  size_t regex_len;
+  char *code;
+  size_t code_len;
+  char *log;
+  size_t log_len;
+  binary_dfa bin; // only with --emit-binary
+  int failed;
+  // scanners report capture groups with a tagged DFA, built from the
+  // parsed regex. NULL if the rule has no groups, or in other outputs.
+  tdfa *tagged;
+  ast *groups;
+  dfa *minimal; // a copy of the minimal DFA, kept for --union and --shared
+  int shared;   // the code is left to `emit_shared`
+  const char *unrolled; // the option that unrolls its counted repetitions
+
+  rule_stats stats;
+  double lap; // when the current phase started
+  enum { NOT_CACHED, CACHE_HIT, CACHE_MISS } cache_use;
+} job;
+
+// charges the time since the end of the previous phase to `p`.
+static void lap(job *j, phase p) {
+  double t = now();
+  j->stats.time[p] += t - j->lap;
+  j->lap = t;
+}
+
+// writes the code of a minimal DFA compressed with default transitions.
+static void emit_d2fa(job *j, dfa *minimal_dfa, FILE *out, FILE *log) {
+  d2fa F = dfa_to_d2fa(minimal_dfa, D2FA_MAX_CHAIN);
+  if (options.report) {
+    size_t ranges = 0;
+    ITER(line, l, &F.t_matrix) { ranges += l->paths.size; }
+    fprintf(log,
+            "%s: D2FA lists %zu of %zu bytes, in %zu ranges instead of %zu, "
+            "defaults chain up to %u\n",
+            j->name, F.listed, (size_t)(F.n_states - 1) * 255, ranges,
+            j->stats.minimal_transitions, F.max_chain);
+  }
+  if (options.d2fa == D2FA_TABLE)
+    table_scanner_from_d2fa(&F, j->name, options.search, out);
+  else
+    scanner_from_d2fa(&F, j->name, options.search, out);
+  delete_d2fa(&F);
+}
+
+// writes the code and the graph of a minimal DFA, and lays it out for the
+// binary file.
+void emit_dfa(job *j, dfa *minimal_dfa, FILE *out, FILE *log) {
+  j->stats.minimal_states = minimal_dfa->n_states - 1;
+  j->stats.minimal_transitions = count_transitions(&minimal_dfa->t_matrix);
+
+  // the plain scanners and searchers of the file are emitted together by
+  // `emit_shared`.
+  j->shared = options.shared && options.generate_code && !j->tagged &&
+              !options.d2fa && !options.profile_generate &&
+              !options.profile_use;
+  if (options.union_name || j->shared) {
+    // the union is built once the arena of the rule is gone.
+    arena *rule_arena = arena_swap(NULL);
+    j->minimal = copy_dfa(minimal_dfa);
+    arena_swap(rule_arena);
+  }
+
+  if (options.emit_binary)
+    j->bin = binary_from_dfa(minimal_dfa, options.search ? BINARY_SEARCH : 0);
+  if (options.generate_code && !j->shared) {
+    profile_mode profile = {0};
+    char profile_file[1024];
+    if (options.profile_generate) {
+      snprintf(profile_file, sizeof(profile_file), "%s.profile", j->file);
+      profile.generate = profile_file;
+    }
+    dfa_profile *counts = NULL;
+    if (options.profile_use) {
+      counts = profile_find(&profiles, j->name, minimal_dfa);
+      if (!counts)
+        fprintf(log, "WARNING: %s: \"%s\" has no profile for its DFA.\n",
+                j->file, j->name);
+      profile.use = counts;
+    }
+    const char *groups[MAX_GROUPS];
+    if (options.d2fa && !j->tagged)
+      emit_d2fa(j, minimal_dfa, out, log);
+    else if (options.search)
+      searcher_from_dfa(minimal_dfa, j->name, &profile, out);
+    else if (j->tagged && ast_groups(j->groups, groups))
+      scanner_from_tdfa(j->tagged, j->name, groups, out);
+    else
+      scanner_from_dfa(minimal_dfa, j->name, &profile, out);
+    delete_profile(counts);
+  }
+  lap(j, PHASE_CODE);
+  if (options.minimal_graph) {
+    FILE *f = open_graph(j->file, j->name, ".dot");
+    dump_dfa_to_dot(minimal_dfa, f);
+    fclose(f);
+  }
+}
+
+int too_large(job *j, FILE *log) {
+  if (j->unrolled)
+    fprintf(log,
+            "ERROR: %s: counted repetition not supported with %s: \"%s\" "
+            "exceeds %d states unrolled.\n",
+            j->file, j->unrolled, j->name, MAX_NFA_SIZE);
+  else
+    fprintf(log, "ERROR: %s: the automaton for \"%s\" exceeds %d states.\n",
+            j->file, j->name, MAX_NFA_SIZE);
+  return 1;
+}
+
+// the option that keeps the counters out of the automaton of a rule, NULL
+// if it is a plain scanner or searcher. `grouped` rules report groups.
+static const char *unrolling_option(int grouped) {
+  if (options.emit_binary)
+    return "--emit-binary";
+  if (options.tokenize)
+    return "--tokenize";
+  if (options.union_name)
+    return "--union";
+  if (options.shared)
+    return "--shared";
+  if (options.d2fa)
+    return "--d2fa";
+  if (options.profile_generate)
+    return "--profile-generate";
+  if (options.profile_use)
+    return "--profile-use";
+  if (options.distance)
+    return "--distance";
+  if (options.derivatives)
+    return "--derivatives";
+  if (options.nfa_graph || options.dfa_graph || options.minimal_graph)
+    return "--graph";
+  if (grouped)
+    return "capture groups";
+  return NULL;
+}
+
+// the minimal DFA of the strings within `options.distance` edits of a
+// string `D` accepts. frees `D`, and returns NULL if the DFA is too large.
+static dfa *within_distance(job *j, dfa *D, FILE *log) {
+  nfa N = levenshtein_nfa(D, options.distance);
+  state_id_t states = D->n_states - 1;
+  delete_dfa(D);
+  free(D);
+  lap(j, PHASE_NFA);
+  if (!N.start_id)
+    return NULL;
+  // the stats give the automata of the edits, which dwarf the ones of the
+  // regex.
+  j->stats.nfa_states = nfa_size(&N);
+  j->stats.nfa_transitions = count_transitions(&N.t_matrix);
+  dfa *naive_dfa = options.dfa_threads
+                        ? to_dfa_parallel(&N, options.dfa_threads)
+                        : to_dfa(&N);
+  delete_nfa(&N);
+  lap(j, PHASE_DFA);
+  if (!naive_dfa)
+    return NULL;
+  j->stats.dfa_states = naive_dfa->n_states - 1;
+  j->stats.dfa_transitions = count_transitions(&naive_dfa->t_matrix);
+  dfa *minimal_dfa = minimize(naive_dfa);
+  delete_dfa(naive_dfa);
+  free(naive_dfa);
+  lap(j, PHASE_MINIMIZE);
+  if (options.report)
+    fprintf(log, "%s: within %u edits, %u -> %u minimal states\n", j->name,
+            options.distance, states, minimal_dfa->n_states - 1);
+  return minimal_dfa;
+}
+
+// alternations of literals skip Thompson's construction and determinization.
+int compile_literals(job *j, vector *literals, FILE *out, FILE *log) {
+  // binary files and unions only hold DFAs.
+  if (options.search && !options.emit_binary && !options.union_name) {
+    aho_corasick A = literals_to_aho_corasick(literals);
+    lap(j, PHASE_DFA);
+    if (!A.n_states)
+      return too_large(j, log);
+    if (options.report)
+      fprintf(log, "%s: %zu literals, %u trie states\n", j->name,
+              literals->size, A.n_states);
+
+    j->stats.dfa_states = j->stats.minimal_states = A.n_states;
+    j->stats.dfa_transitions = j->stats.minimal_transitions =
+        count_transitions(&A.t_matrix);
+    if (options.generate_code)
+      searcher_from_aho_corasick(&A, j->name, out);
+    lap(j, PHASE_CODE);
+    if (options.minimal_graph) {
+      FILE *f = open_graph(j->file, j->name, ".dot");
+      dump_aho_corasick_to_dot(&A, f);
+      fclose(f);
+    }
+    delete_aho_corasick(&A);
+    return 0;
+  }
+
+  // Daciuk's construction builds the minimal DFA directly.
+  dfa *minimal_dfa = literals_to_dfa(literals);
+  lap(j, PHASE_DFA);
+  if (!minimal_dfa)
+    return too_large(j, log);
+  j->stats.dfa_states = minimal_dfa->n_states - 1;
+  j->stats.dfa_transitions = count_transitions(&minimal_dfa->t_matrix);
+  if (options.report)
+    fprintf(log, "%s: %zu literals, %u DFA states\n", j->name,
+            literals->size, minimal_dfa->n_states - 1);
+  if (options.distance) {
+    minimal_dfa = within_distance(j, minimal_dfa, log);
+    if (!minimal_dfa)
+      return too_large(j, log);
+  }
+
+  emit_dfa(j, minimal_dfa, out, log);
+  delete_dfa(minimal_dfa);
+  free(minimal_dfa);
+  return 0;
+}
+
+// the code of a regex with long counted repetitions, from a DFA that keeps a
+// register for each of them instead of a copy of their body for every count.
+// returns 0, having written nothing, if there are none or the DFA would need
+// several values of a counter at once: the repetitions are then unrolled.
+static int compile_counted(job *j, const ast *tree, FILE *out, FILE *log) {
+  counted_nfa C = ast_to_counted_nfa(tree);
+  if (!C.n_counters || !C.N.start_id) {
+    delete_counted_nfa(&C);
+    return 0;
+  }
+  lap(j, PHASE_NFA);
+  j->stats.nfa_states = nfa_size(&C.N);
+  j->stats.nfa_transitions = count_transitions(&C.N.t_matrix) + C.moves.size;
+  counted_dfa *D = counted_to_dfa(&C, options.search);
+  delete_counted_nfa(&C);
+  lap(j, PHASE_DFA);
+  if (!D) {
+    if (options.report)
+      fprintf(log, "%s: the counted repetitions are unrolled\n", j->name);
+    return 0;
+  }
+  size_t transitions = 0;
+  ITER(vector, row, &D->rows) {
+    ITER(counted_path, p, row) { transitions += p->arms.size; }
+  }
+  j->stats.dfa_states = j->stats.minimal_states = D->n_states - 1;
+  j->stats.dfa_transitions = j->stats.minimal_transitions = transitions;
+  if (options.report)
+    fprintf(log, "%s: %u counters, %u DFA states\n", j->name, D->n_counters,
+            D->n_states - 1);
+  if (options.generate_code)
+    scanner_from_counted_dfa(D, j->name, options.search, out);
+  lap(j, PHASE_CODE);
+  delete_counted_dfa(D);
+  free(D);
+  return 1;
+}
+
+// the key of a simplified tree in the cache: everything the minimal DFA
+// depends on.
+char *cache_key(const ast *tree, size_t *key_len) {
+  char *key;
+  FILE *f = open_memstream(&key, key_len);
+  fprintf(f, "max_states=%d parallel=%d derivatives=%d distance=%u\n",
+          MAX_NFA_SIZE, options.dfa_threads != 0, options.derivatives,
+          options.distance);
+  ast_print(tree, f);
+  fclose(f);
+  return key;
+}
+
+// returns 1, after writing the reason to `log`, if the rule can not be
+// compiled.
+int compile_rule(job *j, FILE *out, FILE *log) {
+  parse_error err;
+  ast *tree = parse_regex(j->regex, j->regex_len, &err);
+  lap(j, PHASE_NFA);
+  if (!tree) {
+    fprintf(log, "ERROR: %s: in \"%s\" at offset %zu: %s.\n", j->file,
+            j->name, err.offset, err.message);
+    return 1;
+  }
+
+  // the groups are only reported by scanners, the searchers, the binary
+  // file and the graphs treat them as parentheses.
+  int grouped = !options.search && !options.distance && ast_groups(tree, NULL);
+  j->unrolled = ast_has_counted(tree) ? unrolling_option(grouped) : NULL;
+  if (options.generate_code && grouped) {
+    tdfa *tagged = ast_to_tdfa(tree);
+    j->tagged = tagged ? minimize_tdfa(tagged) : NULL;
+    if (tagged)
+      delete_tdfa(tagged);
+    lap(j, PHASE_DFA);
+    if (!j->tagged) {
+      ast_free(tree);
+      return too_large(j, log);
+    }
+    j->groups = ast_clone(tree);
+  }
+
+  // the intermediate graphs can only be drawn if we build them, and the
+  // searchers of approximate literals need the prefix of the regexes.
+  vector literals = LIT_VEC();
+  if (!options.nfa_graph && !options.dfa_graph &&
+      !(options.search && options.distance) && ast_literals(tree, &literals)) {
+    lap(j, PHASE_NFA);
+    int failed = compile_literals(j, &literals, out, log);
+    delete_literals(&literals);
+    ast_free(tree);
+    return failed;
+  }
+  delete_literals(&literals);
+
+  if (options.search) {
+    // a match can start anywhere: prepend `[\x01-\xff]*`.
+    byte_set any = {0};
+    for (unsigned c = 1; c < 256; c++)
+      byte_set_insert(&any, c);
+    ast *prefixed = ast_new(AST_CONCAT);
+    ast_append(prefixed, ast_new_unary(AST_STAR, ast_new_set(&any)));
+    ast_append(prefixed, tree);
+    tree = prefixed;
+  }
+
+  size_t unsimplified_size = ast_nfa_size(tree);
+  tree = simplify(tree);
+  size_t simplified_size = ast_nfa_size(tree);
+
+  if (options.report)
+    fprintf(log, "%s: %zu -> %zu NFA states (%zu saved)\n", j->name,
+            unsimplified_size, simplified_size,
+            unsimplified_size - simplified_size);
+
+  // the counters only exist in the plain scanners and searchers, whose
+  // automaton is also built, and checked, without the code.
+  if (!unrolling_option(grouped) && compile_counted(j, tree, out, log)) {
+    ast_free(tree);
+    return 0;
+  }
+
+  // the intermediate automata are not cached, they are only built to be
+  // drawn.
+  char *key = NULL;
+  size_t key_len = 0;
+  if (options.use_cache && !options.nfa_graph && !options.dfa_graph) {
+    key = cache_key(tree, &key_len);
+    dfa *cached_dfa = cache_load(&cache, key, key_len);
+    j->cache_use = cached_dfa ? CACHE_HIT : CACHE_MISS;
+    if (cached_dfa) {
+      lap(j, PHASE_NFA);
+      ast_free(tree);
+      free(key);
+      emit_dfa(j, cached_dfa, out, log);
+      delete_dfa(cached_dfa);
+      free(cached_dfa);
+      return 0;
+    }
+  }
+
+  nfa initial_nfa = {.t_matrix = L_VEC()};
+  dfa *naive_dfa = NULL;
+  if (options.derivatives) {
+    // there is no NFA, its states and transitions stay 0.
+    lap(j, PHASE_NFA);
+    naive_dfa = ast_to_dfa_derivatives(tree);
+    ast_free(tree);
+  } else {
+    initial_nfa = ast_to_nfa(tree);
+    ast_free(tree);
+    lap(j, PHASE_NFA);
+    j->stats.nfa_states = nfa_size(&initial_nfa);
+    j->stats.nfa_transitions = count_transitions(&initial_nfa.t_matrix);
+    if (initial_nfa.start_id && options.dfa_threads)
+      naive_dfa = to_dfa_parallel(&initial_nfa, options.dfa_threads);
+    else if (initial_nfa.start_id)
+      naive_dfa = to_dfa(&initial_nfa);
+  }
+  lap(j, PHASE_DFA);
+  if (!naive_dfa) {
+    delete_nfa(&initial_nfa);
+    free(key);
+    return too_large(j, log);
+  }
+  j->stats.dfa_states = naive_dfa->n_states - 1;
+  j->stats.dfa_transitions = count_transitions(&naive_dfa->t_matrix);
+
+  dfa *minimal_dfa = minimize(naive_dfa);
+  lap(j, PHASE_MINIMIZE);
+  if (options.distance)
+    minimal_dfa = within_distance(j, minimal_dfa, log);
+  if (!minimal_dfa) {
+    delete_nfa(&initial_nfa);
+    delete_dfa(naive_dfa);
+    free(naive_dfa);
+    free(key);
+    return too_large(j, log);
+  }
+  if (key) {
+    cache_store(&cache, key, key_len, minimal_dfa);
+    free(key);
+  }
+
+  emit_dfa(j, minimal_dfa, out, log);
+
+  if (options.nfa_graph && !options.derivatives) {
+    FILE *f = open_graph(j->file, j->name, ".nfa.dot");
+    dump_nfa_to_dot(&initial_nfa, f);
+    fclose(f);
+  }
+  if (options.dfa_graph) {
+    FILE *f = open_graph(j->file, j->name, ".naive.dot");
+    dump_dfa_to_dot(naive_dfa, f);
+    fclose(f);
+  }
+
+  delete_nfa(&initial_nfa);
+  delete_dfa(naive_dfa);
+  free(naive_dfa);
+  delete_dfa(minimal_dfa);
+  free(minimal_dfa);
+  return 0;
+}
+
+void run_job(void *jobs, size_t i) {
+  job *j = (job *)jobs + i;
+  FILE *out = open_memstream(&j->code, &j->code_len);
+  FILE *log = open_memstream(&j->log, &j->log_len);
+  work_counters before = thread_counters;
+  j->lap = now();
+  // everything built for the rule is freed at once, only the output and
+  // the binary layout outlive it.
+  arena *outer = arena_swap(arena_new());
+  j->failed = compile_rule(j, out, log);
+  if (j->tagged) {
+    delete_tdfa(j->tagged);
+    ast_free(j->groups);
+    j->tagged = NULL;
+    j->groups = NULL;
+  }
+  arena_delete(arena_swap(outer));
+  fclose(out);
+  fclose(log);
+
+  j->stats.work = (work_counters){
+      .closures = thread_counters.closures - before.closures,
+      .lookups = thread_counters.lookups - before.lookups,
+      .rounds = thread_counters.rounds - before.rounds,
+      .bytes = thread_counters.bytes - before.bytes,
+  };
+}
+
+void delete_jobs(vector *jobs) {
+  ITER(job, j, jobs) {
+    delete_binary_dfa(&j->bin);
+    if (j->minimal) {
+      delete_dfa(j->minimal);
+      free(j->minimal);
+    }
+    free(j->name);
+    free(j->regex);
+    free(j->code);
+    free(j->log);
+  }
+  destroy(jobs);
+}
+
+// reads the rule on `line`, of length `l`, into a new job. returns 1 after
+// reporting the problem to `log` if the line is malformed.
+int read_rule(char *line, ssize_t l, const char *file, vector *jobs,
+              FILE *log) {
+  if (l > 0 && line[l - 1] == '\n')
+    line[--l] = '\0';
+
+  unsigned id_start = 0;
+  for (; line[id_start] && isspace(line[id_start]); id_start++)
+    ;
+  if (line[id_start] == '\0')
+    return 0;
+  unsigned id_end = id_start;
+  for (; line[id_end] && isalnum(line[id_end]); id_end++)
+    ;
+
+  if (id_end == id_start) {
+    fprintf(log, "ERROR: missing identifier in file \"%s\"\n", file);
+    return 1;
+  }
+  if (line[id_end] == '\0') {
+    fprintf(log, "ERROR: missing regex in file \"%s\"\n", file);
+    return 1;
+  }
+
+  // the regex starts right after the single separator.
+  const char *regex = line + id_end + 1;
+  job j = {.file = file, .regex_len = line + l - regex};
+  j.name = strndup(line + id_start, id_end - id_start);
+  j.regex = malloc(j.regex_len + 1);
+  memcpy(j.regex, regex, j.regex_len + 1);
+  vec_insert(jobs, &j);
+  return 0;
+}
+
+// writes the binary file for `count` jobs. the rules that failed are left
+// out.
+void write_jobs_binary(job *jobs, size_t count, FILE *stream) {
+  size_t n = 0;
+  const char *names[count + 1];
+  binary_dfa dfas[count + 1];
+  for (size_t k = 0; k < count; k++) {
+    if (!jobs[k].failed) {
+      names[n] = jobs[k].name;
+      dfas[n++] = jobs[k].bin;
+    }
+  }
+  write_binary(stream, names, dfas, n);
+}
+
+// writes the scanners of the `count` jobs whose code was left to be shared.
+// their DFAs are merged, as many as fit in MAX_NFA_SIZE states at a time, so
+// that the states that match the same strings in several rules are emitted
+// once.
+void emit_shared(const char *file, job *jobs, size_t count, FILE *out,
+                 FILE *log) {
+  dfa *dfas[count + 1];
+  const char *names[count + 1];
+  state_id_t starts[count + 1];
+  size_t group = 0;
+  for (size_t r = 0; r < count; group++) {
+    size_t n = 0, states = 1;
+    for (; r < count; r++) {
+      if (!jobs[r].shared || jobs[r].failed)
+        continue;
+      size_t more = jobs[r].minimal->n_states - 1;
+      if (n && states + more > MAX_NFA_SIZE)
+        break;
+      dfas[n] = jobs[r].minimal;
+      names[n++] = jobs[r].name;
+      states += more;
+    }
+    if (!n)
+      break;
+
+    dfa *S = share_states(dfas, n, starts);
+    if (options.report)
+      fprintf(log, "%s: %zu rules share %u states instead of %zu\n", file,
+              n, S->n_states - 1, states - 1);
+    char shared_name[64];
+    snprintf(shared_name, sizeof(shared_name), "shared_states_%zu", group);
+    shared_code_from_dfa(S, shared_name, names, starts, n, options.search,
+                         out);
+    delete_dfa(S);
+    free(S);
+  }
+}
+
+// the key of a rule in a union: its regex, and how it is matched.
+static char *union_rule_key(const job *j) {
+  char *key = malloc(j->regex_len + 3);
+  key[0] = options.search ? 's' : 'm';
+  key[1] = ' ';
+  memcpy(key + 2, j->regex, j->regex_len + 1);
+  return key;
+}
+
+// writes `tokenize_NAME`, for the union `S` of the rules where the rule `r`
+// is in `slot_of[r]`.
+static void emit_tokenizer(job *jobs, size_t count, const rule_set *S,
+                           const size_t *slot_of, FILE *out) {
+  const char **names = malloc((count + 1) * sizeof(char *));
+  unsigned char *skip = calloc(count + 1, 1);
+  for (size_t r = 0; r < count; r++) {
+    names[r] = jobs[r].name;
+    ITER(const char *, name, &options.skip) {
+      if (!strcmp(*name, jobs[r].name))
+        skip[r] = 1;
+    }
+  }
+
+  // a state accepts the token of the first rule accepting there.
+  size_t n_slots = 0;
+  for (size_t r = 0; r < count; r++)
+    if (slot_of[r] != (size_t)-1 && slot_of[r] + 1 > n_slots)
+      n_slots = slot_of[r] + 1;
+  int *rule_of = malloc((n_slots + 1) * sizeof(int));
+  for (size_t i = 0; i < n_slots; i++)
+    rule_of[i] = -1;
+  for (size_t r = count; r-- > 0;)
+    if (slot_of[r] != (size_t)-1)
+      rule_of[slot_of[r]] = r;
+  int *token = malloc(S->D->n_states * sizeof(int));
+  for (state_id_t id = 0; id < S->D->n_states; id++) {
+    token[id] = -1;
+    bit_set *accepts = elem_at(&S->accepts, id);
+    ITERATE_BITSET(i, *accepts) {
+      if (i < n_slots && rule_of[i] >= 0 &&
+          (token[id] < 0 || rule_of[i] < token[id]))
+        token[id] = rule_of[i];
+    }
+  }
+
+  tokenizer_from_dfa(S->D, options.union_name, names, token, skip, count,
+                     out);
+  free(names);
+  free(skip);
+  free(rule_of);
+  free(token);
+}
+
+// writes the scanner of the union of the `count` rules of `file` to `out`,
+// if it is not NULL. with a cache, the union of the previous run is updated:
+// the rules that are gone are removed from it, and the new ones added.
+// returns 1 if the union is too large.
+int emit_union(const char *file, job *jobs, size_t count, FILE *out,
+               FILE *log) {
+  char *key;
+  size_t key_len;
+  FILE *k = open_memstream(&key, &key_len);
+  fprintf(k, "max_states=%d union=%s file=%s search=%d distance=%u\n",
+          MAX_NFA_SIZE, options.union_name, file, options.search,
+          options.distance);
+  fclose(k);
+
+  vector slots = VEC(char *, NULL); // the key of the rule in each slot
+  rule_set *S = NULL;
+  if (options.use_cache)
+    S = cache_load_rules(&cache, key, key_len, &slots);
+  if (!S)
+    S = rule_set_new();
+  char **slot = slots.ptr;
+
+  // a rule keeps the slot of a rule with the same regex if there is one.
+  char **added = calloc(count + 1, sizeof(char *));
+  size_t *slot_of = malloc((count + 1) * sizeof(size_t));
+  bit_set kept = {0};
+  for (size_t r = 0; r < count; r++) {
+    slot_of[r] = -1;
+    if (!jobs[r].minimal)
+      continue;
+    added[r] = union_rule_key(&jobs[r]);
+    for (size_t i = 0; i < slots.size; i++) {
+      if (slot[i] && !set_has(&kept, i) && !strcmp(slot[i], added[r])) {
+        set_insert(&kept, i);
+        slot_of[r] = i;
+        free(added[r]);
+        added[r] = NULL;
+        break;
+      }
+    }
+  }
+
+  size_t n_added = 0, n_removed = 0;
+  for (size_t i = 0; i < slots.size; i++) {
+    if (slot[i] && !set_has(&kept, i)) {
+      rule_set *smaller = rule_set_remove(S, i);
+      delete_rule_set(S);
+      S = smaller;
+      free(slot[i]);
+      slot[i] = NULL;
+      n_removed++;
+    }
+  }
+  size_t free_slot = 0;
+  for (size_t r = 0; S && r < count; r++) {
+    if (!added[r])
+      continue;
+    for (; free_slot < slots.size && slot[free_slot]; free_slot++)
+      ;
+    if (free_slot == slots.size) {
+      char *none = NULL;
+      vec_insert(&slots, &none);
+      slot = slots.ptr;
+    }
+    rule_set *larger = free_slot < MAX_NFA_SIZE
+                           ? rule_set_add(S, jobs[r].minimal, free_slot)
+                           : NULL;
+    delete_rule_set(S);
+    S = larger;
+    slot[free_slot] = added[r];
+    slot_of[r] = free_slot;
+    added[r] = NULL;
+    n_added++;
+  }
+
+  int failed = !S;
+  if (failed) {
+    fprintf(log, "ERROR: %s: the union \"%s\" exceeds %d states.\n", file,
+            options.union_name, MAX_NFA_SIZE);
+  } else {
+    size_t n_rules = 0;
+    for (size_t i = 0; i < slots.size; i++)
+      n_rules += slot[i] != NULL;
+    if (options.report)
+      fprintf(log,
+              "%s: union of %zu rules, %zu added, %zu removed, %u states\n",
+              options.union_name, n_rules, n_added, n_removed,
+              S->D->n_states - 1);
+    if (options.use_cache)
+      cache_store_rules(&cache, key, key_len, S, &slots);
+    profile_mode profile = {0};
+    if (out && options.search)
+      searcher_from_dfa(S->D, options.union_name, &profile, out);
+    else if (out)
+      scanner_from_dfa(S->D, options.union_name, &profile, out);
+    if (out && options.tokenize && !options.search)
+      emit_tokenizer(jobs, count, S, slot_of, out);
+    if (options.minimal_graph) {
+      FILE *f = open_graph(file, options.union_name, ".dot");
+      dump_dfa_to_dot(S->D, f);
+      fclose(f);
+    }
+    delete_rule_set(S);
+  }
+
+  for (size_t r = 0; r < count; r++)
+    free(added[r]);
+  free(added);
+  free(slot_of);
+  ITER(char *, name, &slots) { free(*name); }
+  destroy(&slots);
+  free(key);
+  return failed;
+}
+
+// the line that ends a batch, with or without a carriage return.
+static int is_end(const char *line) {
+  return !strncmp(line, "end", 3) && !line[3 + strspn(line + 3, "\r\n")];
+}
+
+// answers the batches read from `in` until its end, or until the answers can
+// no longer be written. returns 1 if the server was asked to shut down.
+int serve(FILE *in, FILE *out) {
+  char *line = NULL;
+  size_t line_cap = 0;
+  ssize_t l;
+  int stop = 0, gone = 0;
+
+  while (!stop && !gone && (l = getline(&line, &line_cap, in)) != -1) {
+    char *payload = NULL, *messages = NULL;
+    size_t payload_len = 0, messages_len = 0;
+    FILE *p = open_memstream(&payload, &payload_len);
+    FILE *m = open_memstream(&messages, &messages_len);
+    int failed = 0;
+
+    char *word = strtok(line, " \t\r\n");
+    if (!word) {
+      fclose(p);
+      fclose(m);
+      free(payload);
+      free(messages);
+      continue;
+    }
+
+    if (!strcmp(word, "shutdown")) {
+      stop = 1;
+    } else if (strcmp(word, "compile")) {
+      fprintf(m, "ERROR: unknown command \"%s\"\n", word);
+      failed = 1;
+    } else {
+      enum { CODE, BINARY, STATS } kind = CODE;
+      options.search = 0;
+      while ((word = strtok(NULL, " \t\r\n"))) {
+        if (!strcmp(word, "search"))
+          options.search = 1;
+        else if (!strcmp(word, "code"))
+          kind = CODE;
+        else if (!strcmp(word, "binary"))
+          kind = BINARY;
+        else if (!strcmp(word, "stats"))
+          kind = STATS;
+      }
+      options.generate_code = kind == CODE;
+      options.emit_binary = kind == BINARY;
+
+      vector jobs = VEC(job, NULL);
+      while ((l = getline(&line, &line_cap, in)) != -1 && !is_end(line))
+        failed |= read_rule(line, l, "request", &jobs, m);
+      parallel_for(jobs.size, options.jobs, run_job, jobs.ptr);
+
+      ITER(job, j, &jobs) {
+        fwrite(j->log, 1, j->log_len, m);
+        failed |= j->failed;
+        if (kind == CODE)
+          fwrite(j->code, 1, j->code_len, p);
+        if (kind == STATS && !j->failed) {
+          fprintf(p, "%s %zu %zu %s\n", j->name, j->stats.minimal_states,
+                  j->stats.minimal_transitions, cache_uses[j->cache_use]);
+        }
+      }
+      if (kind == CODE)
+        emit_shared("request", jobs.ptr, jobs.size, p, m);
+      if (kind == BINARY)
+        write_jobs_binary(jobs.ptr, jobs.size, p);
+      delete_jobs(&jobs);
+    }
+
+    fclose(p);
+    fclose(m);
+    fprintf(out, "%s %zu %zu\n", failed ? "error" : "ok", payload_len,
+            messages_len);
+    fwrite(payload, 1, payload_len, out);
+    fwrite(messages, 1, messages_len, out);
+    // a client that hung up before reading its answer is not served again.
+    gone = fflush(out) || ferror(out);
+    free(payload);
+    free(messages);
+  }
+  free(line);
+  return stop;
+}
+
+static void json_string(const char *s, FILE *stream) {
+  fputc('"', stream);
+  for (; *s; s++) {
+    if (*s == '"' || *s == '\\')
+      fprintf(stream, "\\%c", *s);
+    else if ((unsigned char)*s < ' ')
+      fprintf(stream, "\\u%04x", *s);
+    else
+      fputc(*s, stream);
+  }
+  fputc('"', stream);
+}
+
+// one line of `key=value` pairs per rule and one for the whole run, or the
+// same as a JSON object.
+void print_stats(job *jobs, size_t count, double elapsed, FILE *stream) {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  long peak_bytes = usage.ru_maxrss * 1024L;
+
+  if (options.stats == STATS_TEXT) {
+    for (job *j = jobs; j < jobs + count; j++) {
+      rule_stats *s = &j->stats;
+      fprintf(stream, "file=%s rule=%s failed=%d cache=%s", j->file, j->name,
+              j->failed, cache_uses[j->cache_use]);
+      for (phase p = 0; p < N_PHASES; p++)
+        fprintf(stream, " %s=%.6f", phase_names[p], s->time[p]);
+      fprintf(stream,
+              " nfa_states=%zu nfa_transitions=%zu dfa_states=%zu"
+              " dfa_transitions=%zu minimal_states=%zu"
+              " minimal_transitions=%zu closures=%zu lookups=%zu"
+              " minimize_rounds=%zu bytes_allocated=%zu\n",
+              s->nfa_states, s->nfa_transitions, s->dfa_states,
+              s->dfa_transitions, s->minimal_states, s->minimal_transitions,
+              s->work.closures, s->work.lookups, s->work.rounds,
+              s->work.bytes);
+    }
+    fprintf(stream, "total rules=%zu time=%.6f peak_memory=%ld\n", count,
+            elapsed, peak_bytes);
+    return;
+  }
+
+  fprintf(stream, "{\"rules\": [");
+  for (job *j = jobs; j < jobs + count; j++) {
+    rule_stats *s = &j->stats;
+    fprintf(stream, "%s\n  {\"file\": ", j == jobs ? "" : ",");
+    json_string(j->file, stream);
+    fprintf(stream, ", \"rule\": ");
+    json_string(j->name, stream);
+    fprintf(stream, ", \"failed\": %s, \"cache\": \"%s\",\n   \"time\": {",
+            j->failed ? "true" : "false", cache_uses[j->cache_use]);
+    for (phase p = 0; p < N_PHASES; p++)
+      fprintf(stream, "%s\"%s\": %.6f", p ? ", " : "", phase_names[p],
+              s->time[p]);
+    fprintf(stream,
+            "},\n   \"nfa\": {\"states\": %zu, \"transitions\": %zu},"
+            " \"dfa\": {\"states\": %zu, \"transitions\": %zu},"
+            " \"minimal\": {\"states\": %zu, \"transitions\": %zu},\n"
+            "   \"closures\": %zu, \"lookups\": %zu,"
+            " \"minimize_rounds\": %zu, \"bytes_allocated\": %zu}",
+            s->nfa_states, s->nfa_transitions, s->dfa_states,
+            s->dfa_transitions, s->minimal_states, s->minimal_transitions,
+            s->work.closures, s->work.lookups, s->work.rounds, s->work.bytes);
+  }
+  fprintf(stream,
+          "\n],\n\"total\": {\"rules\": %zu, \"time\": %.6f,"
+          " \"peak_memory\": %ld}}\n",
+          count, elapsed, peak_bytes);
+}
+
+int serve_socket(const char *path) {
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "ERROR: the socket path \"%s\" is too long\n", path);
+    return 1;
+  }
+  strcpy(addr.sun_path, path);
+
+  // a socket left by a previous server is replaced, anything else is kept.
+  struct stat st;
+  if (!lstat(path, &st)) {
+    if (!S_ISSOCK(st.st_mode)) {
+      fprintf(stderr, "ERROR: \"%s\" exists and is not a socket\n", path);
+      return 1;
+    }
+    unlink(path);
+  }
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) ||
+      listen(fd, 16)) {
+    fprintf(stderr, "ERROR: could not listen on \"%s\"\n", path);
+    if (fd >= 0)
+      close(fd);
+    return 1;
+  }
+
+  // a client that hangs up early must not take the server down with it: its
+  // writes fail with EPIPE instead.
+  signal(SIGPIPE, SIG_IGN);
+
+  // one client at a time: the rules of a batch are already compiled in
+  // parallel, and batches share the options.
+  int stop = 0, status = 0;
+  while (!stop) {
+    int client = accept(fd, NULL, NULL);
+    if (client < 0 && errno == EINTR)
+      continue;
+    if (client < 0) {
+      fprintf(stderr, "ERROR: could not accept a client on \"%s\"\n", path);
+      status = 1;
+      break;
+    }
+    FILE *in = fdopen(client, "r");
+    FILE *out = fdopen(dup(client), "w");
+    stop = serve(in, out);
+    fclose(in);
+    fclose(out);
+  }
+  close(fd);
+  unlink(path);
+  return status;
 }
 
 int main(int argc, const char **argv) {
@@ -61,6 +1187,24 @@ int main(int argc, const char **argv) {
   options.dfa_graph = 0;
   options.minimal_graph = 0;
   options.generate_code = 1;
+  options.report = 0;
+  options.search = 0;
+  options.emit_binary = 0;
+  options.use_cache = 0;
+  options.stats = NO_STATS;
+  options.derivatives = 0;
+  options.shared = 0;
+  options.d2fa = NO_D2FA;
+  options.jobs = 1;
+  options.dfa_threads = 0;
+  options.distance = 0;
+  options.cache_dir = NULL;
+  options.socket = NULL;
+  options.profile_generate = 0;
+  options.profile_use = NULL;
+  options.union_name = NULL;
+  options.tokenize = 0;
+  options.skip = VEC(const char *, NULL);
 
   const char *files[argc - 1];
   int file_count = 0;
@@ -82,104 +1226,205 @@ int main(int argc, const char **argv) {
         case 'n':
           options.generate_code = 0;
           break;
+        case 'r':
+          options.report = 1;
+          break;
+        case 's':
+          options.search = 1;
+          break;
+        case 'd':
+          options.derivatives = 1;
+          break;
+        case 'j':
+        case 'k':
+        case 't': {
+          // the count is the rest of the argument, or the next one.
+          unsigned n = 0;
+          if (c[1])
+            n = atoi(c + 1);
+          else if (i + 1 < argc)
+            n = atoi(argv[++i]);
+          if (*c == 'j')
+            options.jobs = n;
+          else if (*c == 'k')
+            options.distance = n;
+          else
+            options.dfa_threads = n ? n : available_threads();
+          c += strlen(c) - 1;
+          break;
+        }
         }
       }
     } else { // parse as a single flag
-      if (strcmp(argv[i], "--all-graphs")) {
+      if (!strcmp(argv[i], "--all-graphs")) {
         options.nfa_graph = 1;
         options.dfa_graph = 1;
         options.minimal_graph = 1;
-      } else if (strcmp(argv[i], "--graph")) {
+      } else if (!strcmp(argv[i], "--graph")) {
         options.minimal_graph = 1;
-      } else if (strcmp(argv[i], "--no-code")) {
+      } else if (!strcmp(argv[i], "--no-code")) {
         options.generate_code = 0;
+      } else if (!strcmp(argv[i], "--report")) {
+        options.report = 1;
+      } else if (!strcmp(argv[i], "--search")) {
+        options.search = 1;
+      } else if (!strcmp(argv[i], "--derivatives")) {
+        options.derivatives = 1;
+      } else if (!strcmp(argv[i], "--shared")) {
+        options.shared = 1;
+      } else if (!strcmp(argv[i], "--d2fa")) {
+        options.d2fa = D2FA_GOTO;
+      } else if (!strcmp(argv[i], "--d2fa=table")) {
+        options.d2fa = D2FA_TABLE;
+      } else if (!strcmp(argv[i], "--distance") && i + 1 < argc) {
+        options.distance = atoi(argv[++i]);
+      } else if (!strcmp(argv[i], "--jobs") && i + 1 < argc) {
+        options.jobs = atoi(argv[++i]);
+      } else if (!strcmp(argv[i], "--emit-binary")) {
+        options.emit_binary = 1;
+      } else if (!strcmp(argv[i], "--cache") && i + 1 < argc) {
+        options.cache_dir = argv[++i];
+      } else if (!strcmp(argv[i], "--stats")) {
+        options.stats = STATS_TEXT;
+      } else if (!strcmp(argv[i], "--stats=json")) {
+        options.stats = STATS_JSON;
+      } else if (!strcmp(argv[i], "--serve") && i + 1 < argc) {
+        options.socket = argv[++i];
+      } else if (!strcmp(argv[i], "--profile-generate")) {
+        options.profile_generate = 1;
+      } else if (!strcmp(argv[i], "--profile-use") && i + 1 < argc) {
+        options.profile_use = argv[++i];
+      } else if (!strcmp(argv[i], "--union") && i + 1 < argc) {
+        options.union_name = argv[++i];
+      } else if (!strcmp(argv[i], "--tokenize") && i + 1 < argc) {
+        options.union_name = argv[++i];
+        options.tokenize = 1;
+      } else if (!strcmp(argv[i], "--skip") && i + 1 < argc) {
+        vec_insert(&options.skip, &argv[++i]);
+      } else if (!strcmp(argv[i], "--dfa-threads") && i + 1 < argc) {
+        unsigned n = atoi(argv[++i]);
+        options.dfa_threads = n ? n : available_threads();
       }
     }
   }
 
-  char line[4096];
-  char regex[4096];
-  char name[4096];
-
-  for (int i = 0; i < file_count; i++) {
-    char fname[1024];
-    snprintf(fname, 1024, "%s.c", files[i]);
-
-    FILE *in = fopen(files[i], "r");
-    FILE *out;
-    if (options.generate_code)
-      out = fopen(fname, "w");
-
-    while (fgets(line, 4096, in) != NULL) {
-      unsigned id_start = 0;
-      for (; line[id_start] && isspace(line[id_start]); id_start++)
-        ;
-      unsigned id_end = id_start;
-      for (; line[id_end] && isalnum(line[id_end]); id_end++)
-        ;
-      unsigned re_start = id_end;
-      for (; line[id_end] && isspace(line[id_end]); id_end++)
-        ;
-
-      if (id_end - id_start == 0)
-        fprintf(stderr, "ERROR: missing identifier in file \"%s\"", argv[i]);
-
-      if (line[re_start] == '\0')
-        fprintf(stderr, "ERROR: missing regex in file \"%s\"", argv[i]);
-      unsigned l = strlen(line);
-
-      memcpy(name, line + id_start, id_end - id_start);
-      name[id_end - id_start - 1] = '\0';
+  if (options.jobs == 0)
+    options.jobs = available_threads();
+  // the server keeps every DFA it builds in memory.
+  if (options.cache_dir || options.socket) {
+    options.use_cache = 1;
+    if (cache_open(&cache, options.cache_dir, options.socket != NULL)) {
+      fprintf(stderr, "ERROR: could not create the cache directory \"%s\"\n",
+              options.cache_dir);
+      cache.dir = NULL;
+      options.use_cache = options.socket != NULL;
+    }
+  }
 
-      memcpy(regex, line + re_start + 1, l - re_start - 1);
-      regex[l - re_start - 2] = '\0';
+  if (options.profile_use && profile_load(&profiles, options.profile_use)) {
+    fprintf(stderr, "ERROR: could not open the profile \"%s\"\n",
+            options.profile_use);
+    return 1;
+  }
 
+  if (options.socket) {
+    // graphs and unions would be written next to files that do not exist.
+    options.union_name = NULL;
+    options.nfa_graph = 0;
+    options.dfa_graph = 0;
+    options.minimal_graph = 0;
+    int status = !strcmp(options.socket, "-") ? (serve(stdin, stdout), 0)
+                                                : serve_socket(options.socket);
+    cache_close(&cache);
+    if (options.profile_use)
+      profile_set_free(&profiles);
+    return status;
+  }
 
-      nfa initial_nfa = regex_to_nfa(regex, l - re_start - 2);
-      dfa *naive_dfa = to_dfa(&initial_nfa);
-      dfa *minimal_dfa = minimize(naive_dfa);
+  double start = now();
+  char *line = NULL;
+  size_t line_cap = 0;
+  int status = 0;
 
-      if (options.generate_code) {
-          scanner_from_dfa(minimal_dfa, name, out);
-      }
+  // the rules of file `i` are the jobs in [first_job[i], first_job[i + 1]).
+  vector jobs = VEC(job, NULL);
+  size_t first_job[file_count + 1];
+  int readable[file_count + 1];
 
-      if (options.nfa_graph) {
-          char dot_name[1024];
-          snprintf(dot_name, 1024, "%s_%s.nfa.dot", files[i], name);
-          FILE * f = fopen(dot_name, "w");
-          dump_nfa_to_dot(&initial_nfa, f);
-          fclose(f);
+  for (int i = 0; i < file_count; i++) {
+    first_job[i] = jobs.size;
+    FILE *in = fopen(files[i], "r");
+    readable[i] = in != NULL;
+    if (!in) {
+      fprintf(stderr, "ERROR: could not open \"%s\"\n", files[i]);
+      status = 1;
+      continue;
+    }
 
-      }
+    // rules can be arbitrarily long, e.g. lists of thousands of keywords.
+    ssize_t l;
+    while ((l = getline(&line, &line_cap, in)) != -1)
+      status |= read_rule(line, l, files[i], &jobs, stderr);
+    fclose(in);
+  }
+  first_job[file_count] = jobs.size;
+  free(line);
 
+  parallel_for(jobs.size, options.jobs, run_job, jobs.ptr);
 
-      if (options.dfa_graph) {
-          char dot_name[1024];
-          snprintf(dot_name, 1024, "%s_%s.naive.dot", files[i], name);
-          FILE * f = fopen(dot_name, "w");
-          dump_dfa_to_dot(naive_dfa, f);
-          fclose(f);
+  for (int i = 0; i < file_count; i++) {
+    if (!readable[i])
+      continue;
 
-      }
-      if (options.minimal_graph) {
-          char dot_name[1024];
-          snprintf(dot_name, 1024, "%s_%s.dot", files[i], name);
-          FILE * f = fopen(dot_name, "w");
-          dump_dfa_to_dot(minimal_dfa, f);
-          fclose(f);
+    FILE *out = NULL;
+    if (options.generate_code) {
+      char fname[1024];
+      snprintf(fname, 1024, "%s.c", files[i]);
+      out = fopen(fname, "w");
+    }
+    for (size_t k = first_job[i]; k < first_job[i + 1]; k++) {
+      job *j = elem_at(&jobs, k);
+      fwrite(j->log, 1, j->log_len, stderr);
+      if (out)
+        fwrite(j->code, 1, j->code_len, out);
+      status |= j->failed;
+    }
+    if (out)
+      emit_shared(files[i], elem_at(&jobs, first_job[i]),
+                  first_job[i + 1] - first_job[i], out, stderr);
+    if (options.union_name)
+      status |= emit_union(files[i], elem_at(&jobs, first_job[i]),
+                           first_job[i + 1] - first_job[i], out, stderr);
+    if (out)
+      fclose(out);
 
+    if (options.emit_binary) {
+      char fname[1024];
+      snprintf(fname, 1024, "%s.bin", files[i]);
+      FILE *bin = fopen(fname, "wb");
+      if (bin) {
+        write_jobs_binary(elem_at(&jobs, first_job[i]),
+                          first_job[i + 1] - first_job[i], bin);
+        fclose(bin);
+      } else {
+        fprintf(stderr, "ERROR: could not write \"%s\"\n", fname);
+        status = 1;
       }
-
-      delete_nfa(&initial_nfa);
-      delete_dfa(naive_dfa);
-      free(naive_dfa);
-      delete_dfa(minimal_dfa);
-      free(minimal_dfa);
-
     }
+  }
 
-    fclose(in);
-    if (options.generate_code)
-      fclose(out);
+  if (options.stats)
+    print_stats(jobs.ptr, jobs.size, now() - start, stdout);
+  if (options.cache_dir) {
+    if (options.use_cache)
+      fprintf(stderr, "cache: %zu hits, %zu misses\n",
+              atomic_load(&cache.hits), atomic_load(&cache.misses));
+    cache_close(&cache);
   }
+
+  delete_jobs(&jobs);
+  destroy(&options.skip);
+  if (options.profile_use)
+    profile_set_free(&profiles);
+  return status;
 }
@@ -0,0 +1,369 @@
+#include "counted.h"
+
+// the subset construction follows the moves that use counters as epsilon
+// moves, but a move out of the end of `x` depends on the register of its
+// counter. the transitions on a byte are found once for every case of the
+// registers they test, each the arm of a `counted_path`.
+//
+// a state of the NFA is reached with a version of each counter it is in:
+// the register of the DFA state it comes from (COUNT_KEEP), one more
+// (COUNT_INC), or 0 (COUNT_RESET), 2 bits each. the states of the DFA are
+// the sets of states that read a byte, and all of them must agree on the
+// version of each counter, which the transition then applies.
+
+typedef struct {
+  state_id_t state;
+  unsigned short versions;
+} reached;
+
+typedef struct {
+  counted_nfa *C;
+  int search;
+  size_t n;                   // states of the NFA, with 0
+  size_t *first_move;         // the moves of `s` are [first_move[s], ...[s+1])
+  count_move *moves;          // by the state they leave
+  unsigned short *scope;      // the counters each state is in, one bit each
+  unsigned char *reads;       // whether each state has a path on a byte
+  unsigned short (*seen)[3];  // the versions each state was reached with
+  unsigned char *n_seen;
+  vector touched;             // of state_id_t, the states with n_seen
+  vector stack;               // of `reached`
+  vector kernels;             // of bit_set, by state of the DFA
+  vector work;                // of state_id_t, the states to expand
+  counted_dfa *D;
+} builder;
+
+// the result of a closure: the states that read a byte, and the end.
+typedef struct {
+  bit_set kernel;
+  unsigned char ops[MAX_COUNTERS];
+  unsigned live; // the counters that some state of the kernel is in
+  int conflict;  // two of them disagree on the version of a counter
+  int accepting;
+} closed;
+
+enum { CLOSED = -1, UNSUPPORTED = -2 };
+
+static unsigned version(unsigned versions, unsigned k) {
+  return (versions >> 2 * k) & 3;
+}
+
+static unsigned with_version(unsigned versions, unsigned k, unsigned v) {
+  return (versions & ~(3u << 2 * k)) | v << 2 * k;
+}
+
+// the versions of the counters `s` is in.
+static unsigned in_scope(const builder *B, state_id_t s, unsigned versions) {
+  unsigned mask = 0;
+  for (unsigned k = 0; k < B->C->n_counters; k++)
+    if (B->scope[s] >> k & 1)
+      mask |= 3u << 2 * k;
+  return versions & mask;
+}
+
+// whether the register of `k` can be in the case `x`: r + 1 goes from 1 to
+// `max`, and for `x{n,}` stops at `n`.
+static int possible(const counter *k, count_case x) {
+  switch (x) {
+  case COUNT_BELOW:
+    return k->min >= 2;
+  case COUNT_MIDDLE:
+    return k->max == REPEAT_UNBOUNDED || k->max - 1 >= (k->min ? k->min : 1);
+  case COUNT_TOP:
+    return k->max != REPEAT_UNBOUNDED;
+  }
+  return 0;
+}
+
+static void push(builder *B, state_id_t s, unsigned versions) {
+  const reached r = {s, in_scope(B, s, versions)};
+  vec_insert(&B->stack, &r);
+}
+
+// the closure of `from`, whose states all keep the registers, when the
+// counters are in `cases`. returns CLOSED, the counter whose case it needs
+// to go on, or UNSUPPORTED if `x` of a counter matches the empty string.
+static int closure(builder *B, const bit_set *from, const unsigned char *cases,
+                   closed *out) {
+  thread_counters.closures++;
+  ITER(state_id_t, s, &B->touched) { B->n_seen[*s] = 0; }
+  B->touched.size = B->stack.size = 0;
+  *out = (closed){0};
+  ITERATE_BITSET(s, *from) { push(B, s, 0); }
+
+  const nfa *N = &B->C->N;
+  while (B->stack.size) {
+    reached r;
+    vec_pop_back(&B->stack, &r);
+    state_id_t s = r.state;
+    unsigned v = r.versions;
+    int again = 0;
+    for (unsigned i = 0; i < B->n_seen[s]; i++)
+      again |= B->seen[s][i] == v;
+    if (again)
+      continue;
+    if (B->n_seen[s] == 3)
+      return UNSUPPORTED;
+    if (!B->n_seen[s])
+      vec_insert(&B->touched, &s);
+    B->seen[s][B->n_seen[s]++] = v;
+
+    if (B->reads[s] || s == N->end_id) {
+      set_insert(&out->kernel, s);
+      out->accepting |= s == N->end_id;
+      for (unsigned k = 0; k < B->C->n_counters; k++) {
+        if (!(B->scope[s] >> k & 1))
+          continue;
+        if (!(out->live >> k & 1))
+          out->ops[k] = version(v, k);
+        else if (out->ops[k] != version(v, k))
+          out->conflict = 1;
+        out->live |= 1u << k;
+      }
+    }
+
+    line *l = find_line((vector *)&N->t_matrix, s);
+    if (l) {
+      ITER(path, p, &l->paths) {
+        if (p->first == '\0')
+          push(B, p->end_state, v);
+      }
+    }
+    for (size_t i = B->first_move[s]; i < B->first_move[s + 1]; i++) {
+      const count_move *m = &B->moves[i];
+      const counter *k = &B->C->counters[m->counter];
+      if (m->kind == COUNT_ENTER) {
+        push(B, m->to, with_version(v, m->counter, COUNT_RESET));
+        continue;
+      }
+      // the end of `x` is only reached with the register of the DFA state
+      // when `x` reads a byte.
+      if (version(v, m->counter) != COUNT_KEEP)
+        return UNSUPPORTED;
+      unsigned x = cases[m->counter];
+      if (!x)
+        return m->counter;
+      if (m->kind == COUNT_EXIT && x != COUNT_BELOW)
+        push(B, m->to, with_version(v, m->counter, 0));
+      // `x{n,}` stops counting at n.
+      if (m->kind == COUNT_LOOP && k->max == REPEAT_UNBOUNDED)
+        push(B, m->to,
+             with_version(v, m->counter,
+                          x == COUNT_MIDDLE ? COUNT_KEEP : COUNT_INC));
+      else if (m->kind == COUNT_LOOP && x != COUNT_TOP)
+        push(B, m->to, with_version(v, m->counter, COUNT_INC));
+    }
+  }
+  return CLOSED;
+}
+
+// the state of the DFA for a kernel, added to the work list if it is new. 0
+// if there are too many.
+static state_id_t intern(builder *B, const bit_set *kernel, int accepting) {
+  ITER(bit_set, q, &B->kernels) {
+    if (!memcmp(q, kernel, sizeof(bit_set)))
+      return index_of(&B->kernels, q);
+  }
+  thread_counters.lookups++;
+  if (B->kernels.size >= MAX_NFA_SIZE)
+    return 0;
+  state_id_t id = B->kernels.size;
+  vec_insert(&B->kernels, kernel);
+  vector row = VEC(counted_path, NULL);
+  vec_insert(&B->D->rows, &row);
+  if (accepting)
+    set_insert(&B->D->accepting_states, id);
+  // a searcher returns as soon as it accepts.
+  if (!(accepting && B->search))
+    vec_insert(&B->work, &id);
+  return id;
+}
+
+static int same_outcome(const count_arm *a, const count_arm *b) {
+  return a->end_state == b->end_state && !memcmp(a->ops, b->ops, MAX_COUNTERS);
+}
+
+// appends to `arms` where the byte that leads to `to` goes, for every case
+// of the counters it depends on beyond `cases`. returns 0 if the DFA can
+// not be built.
+static int expand(builder *B, const bit_set *to, unsigned char *cases,
+                  vector *arms) {
+  closed c;
+  int r = closure(B, to, cases, &c);
+  if (r == UNSUPPORTED)
+    return 0;
+  if (r != CLOSED) {
+    for (count_case x = COUNT_BELOW; x <= COUNT_TOP; x++) {
+      if (!possible(&B->C->counters[r], x))
+        continue;
+      cases[r] = x;
+      if (!expand(B, to, cases, arms))
+        return 0;
+    }
+    cases[r] = 0;
+    return 1;
+  }
+
+  count_arm a = {.end_state = 0};
+  memcpy(a.cases, cases, MAX_COUNTERS);
+  if (!empty(&c.kernel)) {
+    if (c.accepting && B->search) {
+      // every match ends in the same state.
+      bit_set end = {0};
+      set_insert(&end, B->C->N.end_id);
+      c.kernel = end;
+    } else if (c.conflict) {
+      return 0;
+    } else {
+      memcpy(a.ops, c.ops, MAX_COUNTERS);
+    }
+    if (!(a.end_state = intern(B, &c.kernel, c.accepting)))
+      return 0;
+  }
+  vec_insert(arms, &a);
+  return 1;
+}
+
+static void delete_row(vector *row) {
+  ITER(counted_path, p, row) { destroy(&p->arms); }
+  destroy(row);
+}
+
+// the paths of state `id`. returns 0 if the DFA can not be built.
+static int expand_state(builder *B, state_id_t id) {
+  bit_set q = *(bit_set *)elem_at(&B->kernels, id);
+  unsigned char cut[257];
+  mark_cuts(&B->C->N.t_matrix, &q, cut);
+  vector row = VEC(counted_path, NULL);
+
+  // every byte in [c, next) leads to the same states of the NFA.
+  for (unsigned c = 1, next; c < 256; c = next) {
+    for (next = c + 1; next < 256 && !cut[next]; next++)
+      ;
+    bit_set to = delta(&B->C->N, &q, c);
+    if (empty(&to))
+      continue;
+
+    counted_path p = {c, next - 1, VEC(count_arm, NULL)};
+    unsigned char cases[MAX_COUNTERS] = {0};
+    if (!expand(B, &to, cases, &p.arms)) {
+      destroy(&p.arms);
+      delete_row(&row);
+      return 0;
+    }
+    // the arms that end like the last one are left to it.
+    count_arm *arms = p.arms.ptr;
+    size_t n = 0;
+    for (size_t i = 0; i < p.arms.size; i++)
+      if (i + 1 == p.arms.size || !same_outcome(&arms[i], &arms[p.arms.size - 1]))
+        arms[n++] = arms[i];
+    p.arms.size = n;
+    if (n == 1)
+      memset(arms[0].cases, 0, MAX_COUNTERS);
+    if (n == 1 && !arms[0].end_state) {
+      destroy(&p.arms);
+      continue;
+    }
+
+    counted_path *prev = row.size ? elem_at(&row, row.size - 1) : NULL;
+    if (prev && prev->last + 1U == c && prev->arms.size == n &&
+        !memcmp(prev->arms.ptr, arms, n * sizeof(count_arm))) {
+      prev->last = next - 1;
+      destroy(&p.arms);
+    } else {
+      vec_insert(&row, &p);
+    }
+  }
+  vector *slot = elem_at(&B->D->rows, id);
+  *slot = row;
+  return 1;
+}
+
+counted_dfa *counted_to_dfa(counted_nfa *C, int search) {
+  size_t n = nfa_size(&C->N);
+  ITER(count_move, m, &C->moves) {
+    n = m->from > n ? m->from : n;
+    n = m->to > n ? m->to : n;
+  }
+  n++;
+
+  counted_dfa *D = calloc(1, sizeof(counted_dfa));
+  D->n_counters = C->n_counters;
+  memcpy(D->counters, C->counters, sizeof(C->counters));
+  D->rows = VEC(vector, NULL);
+
+  builder B = {
+      .C = C,
+      .search = search,
+      .n = n,
+      .first_move = calloc(n + 1, sizeof(size_t)),
+      .moves = malloc((C->moves.size + 1) * sizeof(count_move)),
+      .scope = calloc(n, sizeof(unsigned short)),
+      .reads = calloc(n, 1),
+      .seen = malloc(n * sizeof(*B.seen)),
+      .n_seen = calloc(n, 1),
+      .touched = VEC(state_id_t, NULL),
+      .stack = VEC(reached, NULL),
+      .kernels = VEC(bit_set, NULL),
+      .work = VEC(state_id_t, NULL),
+      .D = D,
+  };
+  ITER(count_move, m, &C->moves) { B.first_move[m->from + 1]++; }
+  for (size_t s = 1; s <= n; s++)
+    B.first_move[s] += B.first_move[s - 1];
+  size_t *fill = malloc(n * sizeof(size_t));
+  memcpy(fill, B.first_move, n * sizeof(size_t));
+  ITER(count_move, m, &C->moves) { B.moves[fill[m->from]++] = *m; }
+  free(fill);
+  for (unsigned k = 0; k < C->n_counters; k++)
+    for (size_t s = C->counters[k].first; s <= C->counters[k].last; s++)
+      B.scope[s] |= 1u << k;
+  ITER(line, l, &C->N.t_matrix) {
+    ITER(path, p, &l->paths) { B.reads[l->id] |= p->first != '\0'; }
+  }
+
+  // the error state has the empty kernel, and every register is 0 in the
+  // start state.
+  bit_set none = {0}, start = {0};
+  intern(&B, &none, 0);
+  B.work.size = 0;
+  set_insert(&start, C->N.start_id);
+  unsigned char cases[MAX_COUNTERS] = {0};
+  closed c;
+  int ok = closure(&B, &start, cases, &c) == CLOSED &&
+           (!c.conflict || (search && c.accepting)) &&
+           intern(&B, &c.kernel, c.accepting);
+  while (ok && B.work.size) {
+    state_id_t id;
+    vec_pop_back(&B.work, &id);
+    ok = expand_state(&B, id);
+  }
+  D->n_states = B.kernels.size;
+
+  free(B.first_move);
+  free(B.moves);
+  free(B.scope);
+  free(B.reads);
+  free(B.seen);
+  free(B.n_seen);
+  destroy(&B.touched);
+  destroy(&B.stack);
+  destroy(&B.kernels);
+  destroy(&B.work);
+  if (!ok) {
+    delete_counted_dfa(D);
+    free(D);
+    return NULL;
+  }
+  return D;
+}
+
+void delete_counted_nfa(counted_nfa *C) {
+  delete_nfa(&C->N);
+  destroy(&C->moves);
+}
+
+void delete_counted_dfa(counted_dfa *D) {
+  ITER(vector, row, &D->rows) { delete_row(row); }
+  destroy(&D->rows);
+}
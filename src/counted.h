@@ -0,0 +1,92 @@
+#ifndef COUNTED_H_
+#define COUNTED_H_
+#include "ast.h"
+#include "automata.h"
+
+// a counted repetition `x{n,m}` can be built with a single copy of `x` and a
+// counter register, instead of a copy of `x` for every count: the NFA
+// resets the counter when it enters `x`, and at the end of `x` goes round
+// again or leaves depending on its value. the DFA of such an NFA keeps the
+// counter in a register too, so neither grows with the bounds.
+//
+// a DFA state can only keep one value of each counter. the construction
+// gives up when two values would be needed at once, as in a search for
+// `[0-9]{3,9}` that restarts the count at every digit, or when `x` matches
+// the empty string, and the repetition is then unrolled.
+
+// the repetitions of fewer copies are unrolled, which is faster to run.
+#define COUNT_ABOVE 8
+// the counted repetitions of a regex, the others are unrolled.
+#define MAX_COUNTERS 8
+
+typedef struct {
+  unsigned min;
+  unsigned max;      // REPEAT_UNBOUNDED for `x{n,}`
+  state_id_t first;  // the states of the NFA in the repetition, [first, last]
+  state_id_t last;
+} counter;
+
+typedef enum {
+  COUNT_ENTER, // from the start of the repetition into `x`, resetting
+  COUNT_LOOP,  // from the end of `x` into it again, counting one more
+  COUNT_EXIT,  // from the end of `x` to the end of the repetition
+} count_kind;
+
+// an epsilon move of the NFA that uses a counter.
+typedef struct {
+  state_id_t from;
+  state_id_t to;
+  unsigned char counter;
+  unsigned char kind;
+} count_move;
+
+typedef struct {
+  nfa N;              // the moves that do not use a counter
+  vector moves;       // of `count_move`
+  counter counters[MAX_COUNTERS];
+  unsigned n_counters;
+} counted_nfa;
+
+// what a transition knows of a counter whose register holds `r`: whether
+// `x` has been matched fewer than `min` times, at least `min` and fewer than
+// `max` times, or `max` times, once it is matched again.
+typedef enum {
+  COUNT_BELOW = 1, // r + 1 < min
+  COUNT_MIDDLE,    // min <= r + 1 < max
+  COUNT_TOP,       // r + 1 >= max
+} count_case;
+
+typedef enum { COUNT_KEEP, COUNT_INC, COUNT_RESET } count_op;
+
+// where a byte leads when the counters are in `cases`, 0 for the counters
+// that do not matter, and what happens to their registers on the way.
+typedef struct {
+  unsigned char cases[MAX_COUNTERS];
+  unsigned char ops[MAX_COUNTERS]; // count_op
+  state_id_t end_state;
+} count_arm;
+
+// the arms are tested in order, and the last one always applies.
+typedef struct {
+  unsigned char first;
+  unsigned char last;
+  vector arms; // of `count_arm`
+} counted_path;
+
+typedef struct {
+  state_id_t n_states; // including the error state 0. the start is 1, and
+                       // every register is 0 there
+  counter counters[MAX_COUNTERS];
+  unsigned n_counters;
+  vector rows;         // by state, vectors of `counted_path` in byte order
+  bit_set accepting_states;
+} counted_dfa;
+
+// NULL if a state would need two values of a counter, or more than
+// MAX_NFA_SIZE states. with `search`, the accepting states end the match,
+// and are not expanded.
+counted_dfa *counted_to_dfa(counted_nfa *C, int search);
+void delete_counted_nfa(counted_nfa *C);
+void delete_counted_dfa(counted_dfa *D);
+
+#endif // COUNTED_H_
@@ -0,0 +1,155 @@
+#include "d2fa.h"
+
+// the candidate defaults kept for each state, the ones that save it the
+// most ranges.
+#define CANDIDATES 8
+
+typedef struct {
+  unsigned weight; // ranges `a` saves by defaulting to `b`
+  state_id_t a;
+  state_id_t b;
+} edge;
+
+static int edge_cmp(const void *x, const void *y) {
+  const edge *e = x, *f = y;
+  if (e->weight != f->weight)
+    return e->weight < f->weight ? 1 : -1;
+  if (e->a != f->a)
+    return e->a - f->a;
+  return e->b - f->b;
+}
+
+// inserts into the best candidates of a state, heaviest first.
+static void keep_candidate(edge *best, edge e) {
+  if (e.weight <= best[CANDIDATES - 1].weight)
+    return;
+  size_t i = CANDIDATES - 1;
+  for (; i > 0 && best[i - 1].weight < e.weight; i--)
+    best[i] = best[i - 1];
+  best[i] = e;
+}
+
+// the ranges listed by `a` with the default `b`, and by `b` with the
+// default `a`: the runs of bytes on which the two differ and the state goes
+// to the same place. `step[s][c]` is whether `s` goes elsewhere on `c` than
+// on `c - 1`. row 0, the error state, is all 0, so with `b = 0` they are the
+// runs of paths of `a`.
+static void listed_ranges(state_id_t (*row)[256], unsigned char (*step)[256],
+                          state_id_t a, state_id_t b, unsigned *a_listed,
+                          unsigned *b_listed) {
+  unsigned char differ[256];
+  differ[0] = 0;
+  for (unsigned c = 1; c < 256; c++)
+    differ[c] = row[a][c] != row[b][c];
+  unsigned na = 0, nb = 0;
+  for (unsigned c = 1; c < 256; c++) {
+    na += differ[c] & ((differ[c - 1] ^ 1) | step[a][c]);
+    nb += differ[c] & ((differ[c - 1] ^ 1) | step[b][c]);
+  }
+  *a_listed = na;
+  *b_listed = nb;
+}
+
+d2fa dfa_to_d2fa(dfa *D, unsigned max_chain) {
+  state_id_t n = D->n_states;
+  d2fa F = {
+      .n_states = n,
+      .t_matrix = L_VEC(),
+      .accepting_states = D->accepting_states,
+      .fallback = calloc(n, sizeof(state_id_t)),
+  };
+
+  // the full rows, where the bytes without a path lead to 0.
+  state_id_t(*row)[256] = calloc(n, sizeof(*row));
+  ITER(line, l, &D->t_matrix) {
+    ITER(path, p, &l->paths) {
+      for (unsigned c = p->first; c <= p->last; c++)
+        row[l->id][c] = p->end_state;
+    }
+  }
+
+  unsigned char(*step)[256] = calloc(n, sizeof(*step));
+  for (state_id_t s = 1; s < n; s++)
+    for (unsigned c = 2; c < 256; c++)
+      step[s][c] = row[s][c] != row[s][c - 1];
+  unsigned *alone = calloc(n, sizeof(unsigned));
+  unsigned ignored;
+  for (state_id_t s = 1; s < n; s++)
+    listed_ranges(row, step, s, 0, &alone[s], &ignored);
+
+  // only the defaults that save a state some ranges are candidates.
+  edge *best = calloc((size_t)n * CANDIDATES, sizeof(edge));
+  for (state_id_t a = 1; a < n; a++) {
+    for (state_id_t b = a + 1; b < n; b++) {
+      unsigned a_listed, b_listed;
+      listed_ranges(row, step, a, b, &a_listed, &b_listed);
+      if (a_listed < alone[a])
+        keep_candidate(&best[a * CANDIDATES],
+                       (edge){alone[a] - a_listed, a, b});
+      if (b_listed < alone[b])
+        keep_candidate(&best[b * CANDIDATES],
+                       (edge){alone[b] - b_listed, b, a});
+    }
+  }
+  size_t n_edges = 0;
+  for (size_t i = 0; i < (size_t)n * CANDIDATES; i++)
+    if (best[i].weight)
+      best[n_edges++] = best[i];
+  qsort(best, n_edges, sizeof(edge), edge_cmp);
+
+  // the defaults that save the most first, as long as a state has none yet,
+  // they make no cycle, and no state ends up following more than
+  // `max_chain` of them. `below` is the longest chain of defaults that ends
+  // at a state.
+  unsigned *below = calloc(n, sizeof(unsigned));
+  for (size_t i = 0; i < n_edges; i++) {
+    state_id_t a = best[i].a, b = best[i].b;
+    if (F.fallback[a])
+      continue;
+    unsigned above = 1;
+    state_id_t t = b;
+    for (; F.fallback[t] && t != a; t = F.fallback[t])
+      above++;
+    if (t == a || below[a] + above > max_chain)
+      continue;
+    F.fallback[a] = b;
+    for (unsigned k = below[a] + 1; b; b = F.fallback[b], k++)
+      if (below[b] < k)
+        below[b] = k;
+    if (below[a] + above > F.max_chain)
+      F.max_chain = below[a] + above;
+  }
+
+  // the listed transitions are the ones that differ from the default.
+  for (state_id_t s = 1; s < n; s++) {
+    state_id_t d = F.fallback[s];
+    for (unsigned c = 1, next; c < 256; c = next) {
+      state_id_t to = row[s][c];
+      for (next = c + 1; next < 256 && row[s][next] == to; next++)
+        ;
+      for (unsigned k = c; k < next; k++) {
+        if (d ? row[d][k] == to : !to)
+          continue;
+        unsigned last = k;
+        while (last + 1 < next && (d ? row[d][last + 1] != to : 1))
+          last++;
+        transition_matrix_insert(&F.t_matrix, s, k, last, to);
+        F.listed += last - k + 1;
+        k = last;
+      }
+    }
+  }
+
+  free(row);
+  free(step);
+  free(alone);
+  free(best);
+  free(below);
+  return F;
+}
+
+void delete_d2fa(d2fa *F) {
+  ITER(line, l, &F->t_matrix) { destroy(&l->paths); }
+  destroy(&F->t_matrix);
+  free(F->fallback);
+}
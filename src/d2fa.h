@@ -0,0 +1,32 @@
+#ifndef D2FA_H_
+#define D2FA_H_
+#include "automata.h"
+
+// a DFA whose states only list the transitions on which they differ from
+// another state, their default, and take the transitions of the default on
+// the other bytes (Kumar et al.'s delayed input DFA, or D²FA). following a
+// default does not read a byte.
+//
+// the defaults are chosen greedily, the ones that save a state the most
+// listed ranges first, as long as they make no cycle and no state follows
+// more than the longest chain allowed to read a byte. a default that saves
+// a state nothing is never taken.
+typedef struct {
+  state_id_t n_states;
+  vector t_matrix;      // of line: the listed transitions, which may lead to
+                        // the error state 0
+  bit_set accepting_states;
+  state_id_t *fallback; // the default of each state, 0 if it has none
+  unsigned max_chain;   // the most defaults followed to read a byte
+  size_t listed;        // bytes listed by all the states
+} d2fa;
+
+// the longest chain of defaults of `dfa_to_d2fa`, the extra steps a byte
+// may take.
+#define D2FA_MAX_CHAIN 4
+
+// the D²FA of the minimal DFA `D`, whose states keep their ids.
+d2fa dfa_to_d2fa(dfa *D, unsigned max_chain);
+void delete_d2fa(d2fa *F);
+
+#endif // D2FA_H_
@@ -0,0 +1,475 @@
+#include "derivative.h"
+
+typedef enum {
+  T_NONE, // matches nothing
+  T_EPS,  // matches the empty string
+  T_SET,  // any byte of `set`
+  T_CAT,  // `a` followed by `b`
+  T_STAR, // any number of `a`
+  T_NOT,  // any string of bytes 1 to 255 not matched by `a`
+  T_ALT,  // any of the `n` terms of `kids` from `first`
+  T_AND,  // all of them
+} term_kind;
+
+typedef struct {
+  term_kind kind;
+  int nullable;    // matches the empty string
+  byte_set set;    // of a T_SET
+  unsigned a, b;   // operands of T_CAT, T_STAR and T_NOT
+  unsigned first;  // operands of T_ALT and T_AND, sorted and distinct
+  unsigned n;
+  uint64_t hash;
+  state_id_t state; // the DFA state of the term, 0 if it has none yet
+  unsigned seen;    // the last pass over the terms that visited it
+} term;
+
+// the terms are hash-consed, so two terms are equal iff their ids are.
+typedef struct {
+  vector terms;     // of term, by id
+  vector kids;      // of unsigned, the operands of T_ALT and T_AND
+  unsigned *slots;  // open addressing table of ids + 1, 0 if free
+  size_t cap;
+  // the derivatives found so far, by term and byte.
+  uint64_t *memo_keys; // (id << 8 | byte) + 1, 0 if free
+  unsigned *memo;
+  size_t memo_cap;
+  size_t memo_size;
+  unsigned pass;
+} builder;
+
+#define NONE 0
+#define EPS 1
+
+static term *at(builder *B, unsigned id) {
+  return (term *)B->terms.ptr + id;
+}
+
+static uint64_t term_hash(builder *B, const term *t) {
+  uint64_t h = hash_mix(HASH_INIT, t->kind);
+  const unsigned *kids = B->kids.ptr;
+  switch (t->kind) {
+  case T_SET:
+    for (int i = 0; i < 4; i++)
+      h = hash_mix(h, t->set.bits[i]);
+    break;
+  case T_CAT:
+    h = hash_mix(hash_mix(h, t->a), t->b);
+    break;
+  case T_STAR:
+  case T_NOT:
+    h = hash_mix(h, t->a);
+    break;
+  case T_ALT:
+  case T_AND:
+    for (unsigned i = 0; i < t->n; i++)
+      h = hash_mix(h, kids[t->first + i]);
+    break;
+  default:
+    break;
+  }
+  return hash_finish(h);
+}
+
+static int term_eq(builder *B, const term *x, const term *y) {
+  if (x->hash != y->hash || x->kind != y->kind)
+    return 0;
+  const unsigned *kids = B->kids.ptr;
+  switch (x->kind) {
+  case T_SET:
+    return !memcmp(&x->set, &y->set, sizeof(byte_set));
+  case T_CAT:
+    return x->a == y->a && x->b == y->b;
+  case T_STAR:
+  case T_NOT:
+    return x->a == y->a;
+  case T_ALT:
+  case T_AND:
+    return x->n == y->n && !memcmp(&kids[x->first], &kids[y->first],
+                                   x->n * sizeof(unsigned));
+  default:
+    return 1;
+  }
+}
+
+static unsigned *term_slot(builder *B, const term *t) {
+  size_t i = t->hash & (B->cap - 1);
+  while (B->slots[i] && !term_eq(B, at(B, B->slots[i] - 1), t))
+    i = (i + 1) & (B->cap - 1);
+  return &B->slots[i];
+}
+
+// the id of the term equal to `t`, which is added if it is new. the operands
+// of a new T_ALT or T_AND are the last ones of `kids`, and are dropped again
+// if the term exists.
+static unsigned intern(builder *B, term t) {
+  t.hash = term_hash(B, &t);
+  if (2 * (B->terms.size + 1) > B->cap) {
+    size_t cap = B->cap * 2;
+    free(B->slots);
+    B->slots = calloc(cap, sizeof(unsigned));
+    B->cap = cap;
+    for (unsigned id = 0; id < B->terms.size; id++)
+      *term_slot(B, at(B, id)) = id + 1;
+  }
+  unsigned *slot = term_slot(B, &t);
+  if (*slot) {
+    if (t.kind == T_ALT || t.kind == T_AND)
+      B->kids.size = t.first;
+    return *slot - 1;
+  }
+  *slot = B->terms.size + 1;
+  vec_insert(&B->terms, &t);
+  return B->terms.size - 1;
+}
+
+static unsigned mk_set(builder *B, const byte_set *set) {
+  term t = {.kind = T_SET, .set = *set};
+  // bytes are read from 1 to 255.
+  t.set.bits[0] &= ~(uint64_t)1;
+  if (!(t.set.bits[0] | t.set.bits[1] | t.set.bits[2] | t.set.bits[3]))
+    return NONE;
+  return intern(B, t);
+}
+
+static unsigned mk_nary(builder *B, term_kind kind, unsigned *ids, size_t n);
+
+static unsigned mk_cat(builder *B, unsigned x, unsigned y) {
+  if (x == NONE || y == NONE)
+    return NONE;
+  if (x == EPS)
+    return y;
+  if (y == EPS)
+    return x;
+  term tx = *at(B, x);
+  if (tx.kind == T_CAT)
+    return mk_cat(B, tx.a, mk_cat(B, tx.b, y));
+  // (r|s)·t is r·t|s·t: a state is then the set of concatenations it may be
+  // in, and the states that only group them differently are equal.
+  if (tx.kind == T_ALT) {
+    unsigned *ids = malloc(tx.n * sizeof(unsigned));
+    for (unsigned i = 0; i < tx.n; i++)
+      ids[i] = mk_cat(B, ((unsigned *)B->kids.ptr)[tx.first + i], y);
+    unsigned result = mk_nary(B, T_ALT, ids, tx.n);
+    free(ids);
+    return result;
+  }
+  return intern(B, (term){.kind = T_CAT, .nullable = tx.nullable &&
+                                                    at(B, y)->nullable,
+                          .a = x, .b = y});
+}
+
+static unsigned mk_star(builder *B, unsigned x) {
+  if (x == NONE || x == EPS)
+    return EPS;
+  if (at(B, x)->kind == T_STAR)
+    return x;
+  return intern(B, (term){.kind = T_STAR, .nullable = 1, .a = x});
+}
+
+static unsigned mk_not(builder *B, unsigned x) {
+  if (at(B, x)->kind == T_NOT)
+    return at(B, x)->a;
+  return intern(B, (term){.kind = T_NOT, .nullable = !at(B, x)->nullable,
+                          .a = x});
+}
+
+static int id_cmp(const void *a, const void *b) {
+  unsigned x = *(const unsigned *)a, y = *(const unsigned *)b;
+  return (x > y) - (x < y);
+}
+
+// the T_ALT or T_AND of the `n` terms of `ids`, which it may reorder.
+static unsigned mk_nary(builder *B, term_kind kind, unsigned *ids, size_t n) {
+  // ∅ is the identity of alternations and absorbs intersections, ¬∅ the
+  // other way around.
+  unsigned identity = kind == T_ALT ? NONE : mk_not(B, NONE);
+  unsigned absorbing = kind == T_ALT ? mk_not(B, NONE) : NONE;
+
+  size_t first = B->kids.size;
+  for (size_t i = 0; i < n; i++) {
+    term t = *at(B, ids[i]);
+    if (ids[i] == absorbing) {
+      B->kids.size = first;
+      return absorbing;
+    }
+    if (ids[i] == identity)
+      continue;
+    if (t.kind != kind) {
+      vec_insert(&B->kids, &ids[i]);
+      continue;
+    }
+    for (unsigned k = 0; k < t.n; k++) {
+      unsigned kid = ((unsigned *)B->kids.ptr)[t.first + k];
+      vec_insert(&B->kids, &kid);
+    }
+  }
+
+  size_t size = B->kids.size - first;
+  if (!size)
+    return identity;
+  unsigned *kids = (unsigned *)B->kids.ptr + first;
+  qsort(kids, size, sizeof(unsigned), id_cmp);
+  size_t distinct = 0;
+  for (size_t i = 0; i < size; i++)
+    if (!distinct || kids[i] != kids[distinct - 1])
+      kids[distinct++] = kids[i];
+  B->kids.size = first + distinct;
+
+  if (distinct == 1) {
+    B->kids.size = first;
+    return kids[0];
+  }
+  term t = {.kind = kind, .nullable = kind == T_AND, .first = first,
+            .n = distinct};
+  for (size_t i = 0; i < distinct; i++) {
+    if (kind == T_ALT)
+      t.nullable |= at(B, kids[i])->nullable;
+    else
+      t.nullable &= at(B, kids[i])->nullable;
+  }
+  return intern(B, t);
+}
+
+static unsigned mk_alt2(builder *B, unsigned x, unsigned y) {
+  unsigned ids[] = {x, y};
+  return mk_nary(B, T_ALT, ids, 2);
+}
+
+static unsigned from_ast(builder *B, const ast *a) {
+  size_t n = a->children.size;
+  ast *const *children = a->children.ptr;
+  switch (a->kind) {
+  case AST_EMPTY:
+    return EPS;
+  case AST_SET:
+    return mk_set(B, &a->set);
+  case AST_CONCAT: {
+    unsigned result = EPS;
+    for (size_t i = n; i-- > 0;)
+      result = mk_cat(B, from_ast(B, children[i]), result);
+    return result;
+  }
+  case AST_ALT:
+  case AST_AND:
+  case AST_DIFF: {
+    unsigned *ids = malloc(n * sizeof(unsigned));
+    for (size_t i = 0; i < n; i++) {
+      ids[i] = from_ast(B, children[i]);
+      if (a->kind == AST_DIFF && i)
+        ids[i] = mk_not(B, ids[i]);
+    }
+    unsigned result = mk_nary(B, a->kind == AST_ALT ? T_ALT : T_AND, ids, n);
+    free(ids);
+    return result;
+  }
+  case AST_STAR:
+    return mk_star(B, from_ast(B, children[0]));
+  case AST_PLUS: {
+    unsigned x = from_ast(B, children[0]);
+    return mk_cat(B, x, mk_star(B, x));
+  }
+  case AST_NOT:
+    return mk_not(B, from_ast(B, children[0]));
+  case AST_CAPTURE:
+    return from_ast(B, children[0]);
+  case AST_REPEAT: {
+    // x{2,4} is xx(x(x)?)?
+    unsigned x = from_ast(B, children[0]);
+    unsigned result = a->max == REPEAT_UNBOUNDED ? mk_star(B, x) : EPS;
+    if (a->max != REPEAT_UNBOUNDED)
+      for (unsigned i = a->min; i < a->max; i++)
+        result = mk_alt2(B, EPS, mk_cat(B, x, result));
+    for (unsigned i = 0; i < a->min; i++)
+      result = mk_cat(B, x, result);
+    return result;
+  }
+  }
+  return NONE;
+}
+
+static unsigned *memo_slot(builder *B, uint64_t key) {
+  size_t i = (key * 0x9e3779b97f4a7c15u >> 20) & (B->memo_cap - 1);
+  while (B->memo_keys[i] && B->memo_keys[i] != key)
+    i = (i + 1) & (B->memo_cap - 1);
+  B->memo_keys[i] = key;
+  return &B->memo[i];
+}
+
+static unsigned derive(builder *B, unsigned x, unsigned char c);
+
+static unsigned derive_uncached(builder *B, unsigned x, unsigned char c) {
+  term t = *at(B, x);
+  switch (t.kind) {
+  case T_NONE:
+  case T_EPS:
+    return NONE;
+  case T_SET:
+    return byte_set_has(&t.set, c) ? EPS : NONE;
+  case T_CAT: {
+    unsigned result = mk_cat(B, derive(B, t.a, c), t.b);
+    if (at(B, t.a)->nullable)
+      result = mk_alt2(B, result, derive(B, t.b, c));
+    return result;
+  }
+  case T_STAR:
+    return mk_cat(B, derive(B, t.a, c), x);
+  case T_NOT:
+    return mk_not(B, derive(B, t.a, c));
+  case T_ALT:
+  case T_AND: {
+    unsigned *ids = malloc(t.n * sizeof(unsigned));
+    for (unsigned i = 0; i < t.n; i++)
+      ids[i] = derive(B, ((unsigned *)B->kids.ptr)[t.first + i], c);
+    unsigned result = mk_nary(B, t.kind, ids, t.n);
+    free(ids);
+    return result;
+  }
+  }
+  return NONE;
+}
+
+// the regex matching the suffixes of the strings of `x` that start with `c`.
+static unsigned derive(builder *B, unsigned x, unsigned char c) {
+  if (x == NONE || x == EPS)
+    return NONE;
+  uint64_t key = ((uint64_t)x << 8 | c) + 1;
+  size_t i = (key * 0x9e3779b97f4a7c15u >> 20) & (B->memo_cap - 1);
+  for (; B->memo_keys[i]; i = (i + 1) & (B->memo_cap - 1))
+    if (B->memo_keys[i] == key)
+      return B->memo[i];
+
+  unsigned result = derive_uncached(B, x, c);
+  thread_counters.closures++;
+  if (2 * (B->memo_size + 1) > B->memo_cap) {
+    builder old = *B;
+    B->memo_cap *= 2;
+    B->memo_keys = calloc(B->memo_cap, sizeof(uint64_t));
+    B->memo = malloc(B->memo_cap * sizeof(unsigned));
+    for (size_t i = 0; i < old.memo_cap; i++)
+      if (old.memo_keys[i])
+        *memo_slot(B, old.memo_keys[i]) = old.memo[i];
+    free(old.memo_keys);
+    free(old.memo);
+  }
+  *memo_slot(B, key) = result;
+  B->memo_size++;
+  return result;
+}
+
+// splits the classes of `cls` by membership in `set`.
+static void refine(unsigned short cls[256], unsigned *n_classes,
+                   const byte_set *set) {
+  int split[2][256];
+  memset(split, -1, sizeof(split));
+  unsigned n = 0;
+  for (unsigned c = 1; c < 256; c++) {
+    int *to = &split[byte_set_has(set, c)][cls[c]];
+    if (*to < 0)
+      *to = n++;
+    cls[c] = *to;
+  }
+  *n_classes = n;
+}
+
+// refines `cls` so that the bytes of a class have the same derivative of `x`.
+static void classes(builder *B, unsigned x, unsigned short cls[256],
+                    unsigned *n_classes) {
+  term *t = at(B, x);
+  if (t->seen == B->pass || *n_classes == 255)
+    return;
+  t->seen = B->pass;
+  switch (t->kind) {
+  case T_SET:
+    refine(cls, n_classes, &t->set);
+    break;
+  case T_CAT:
+    classes(B, t->a, cls, n_classes);
+    if (at(B, t->a)->nullable)
+      classes(B, at(B, x)->b, cls, n_classes);
+    break;
+  case T_STAR:
+  case T_NOT:
+    classes(B, t->a, cls, n_classes);
+    break;
+  case T_ALT:
+  case T_AND:
+    for (unsigned i = 0, n = t->n; i < n; i++)
+      classes(B, ((unsigned *)B->kids.ptr)[at(B, x)->first + i], cls,
+              n_classes);
+    break;
+  default:
+    break;
+  }
+}
+
+dfa *ast_to_dfa_derivatives(const ast *a) {
+  builder B = {
+      .terms = VEC(term, NULL),
+      .kids = VEC(unsigned, NULL),
+      .cap = 64,
+      .memo_cap = 64,
+  };
+  B.slots = calloc(B.cap, sizeof(unsigned));
+  B.memo_keys = calloc(B.memo_cap, sizeof(uint64_t));
+  B.memo = malloc(B.memo_cap * sizeof(unsigned));
+  intern(&B, (term){.kind = T_NONE});
+  intern(&B, (term){.kind = T_EPS, .nullable = 1});
+
+  dfa *result = calloc(sizeof(dfa), 1);
+  result->t_matrix = L_VEC();
+  vector states = VEC(unsigned, NULL, NONE); // the term of each state
+  unsigned start = from_ast(&B, a);
+  vec_insert(&states, &start);
+  at(&B, start)->state = 1;
+
+  for (state_id_t id = 1; id < states.size; id++) {
+    unsigned x = ((unsigned *)states.ptr)[id];
+    if (at(&B, x)->nullable)
+      set_insert(&result->accepting_states, id);
+
+    unsigned short cls[256] = {0};
+    unsigned n_classes = 1;
+    B.pass++;
+    classes(&B, x, cls, &n_classes);
+
+    // the derivative by any byte of a class is the one of all its bytes.
+    state_id_t dest[256];
+    for (unsigned k = 0; k < n_classes; k++)
+      dest[k] = (state_id_t)-1;
+    for (unsigned c = 1; c < 256; c++) {
+      if (dest[cls[c]] != (state_id_t)-1)
+        continue;
+      unsigned y = derive(&B, x, c);
+      thread_counters.lookups++;
+      if (!at(&B, y)->state && y != NONE) {
+        if (states.size >= MAX_NFA_SIZE) {
+          delete_dfa(result);
+          free(result);
+          result = NULL;
+          goto done;
+        }
+        at(&B, y)->state = states.size;
+        vec_insert(&states, &y);
+      }
+      dest[cls[c]] = at(&B, y)->state;
+    }
+
+    for (unsigned c = 1, next; c < 256; c = next) {
+      state_id_t to = dest[cls[c]];
+      for (next = c + 1; next < 256 && dest[cls[next]] == to; next++)
+        ;
+      if (to)
+        transition_matrix_insert(&result->t_matrix, id, c, next - 1, to);
+    }
+  }
+  result->n_states = states.size;
+
+done:
+  destroy(&states);
+  destroy(&B.terms);
+  destroy(&B.kids);
+  free(B.slots);
+  free(B.memo_keys);
+  free(B.memo);
+  return result;
+}
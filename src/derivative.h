@@ -0,0 +1,18 @@
+#ifndef DERIVATIVE_H_
+#define DERIVATIVE_H_
+#include "ast.h"
+#include "automata.h"
+
+// builds the DFA of `a` directly from its Brzozowski derivatives, without an
+// NFA: every state is a regex, and reading a byte leads to the derivative of
+// that regex by the byte. the regexes are kept in the canonical form of
+// Owens, Reppy and Turon, so that there are finitely many of them and most
+// equivalent ones are equal, and the derivatives of a state are only taken
+// once per class of bytes the regex can not tell apart. intersections,
+// differences and complements are derived like any other operator.
+//
+// the DFA is often minimal, or close to it, but it is not minimized. NULL if
+// it would exceed MAX_NFA_SIZE states.
+dfa *ast_to_dfa_derivatives(const ast *a);
+
+#endif // DERIVATIVE_H_
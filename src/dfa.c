@@ -8,6 +8,25 @@
 
 #define FIRST_EXAMPLE_
 
+static void print_byte(unsigned char c, FILE *stream) {
+  if (c == '"' || c == '\\')
+    fprintf(stream, "\\%c", c);
+  else if (c > ' ' && c < 127)
+    fputc(c, stream);
+  else
+    fprintf(stream, "\\\\x%02x", c);
+}
+
+static void print_label(const path *p, FILE *stream) {
+  fprintf(stream, "[label = \"");
+  print_byte(p->first, stream);
+  if (p->last != p->first) {
+    fputc('-', stream);
+    print_byte(p->last, stream);
+  }
+  fprintf(stream, "\"]");
+}
+
 void dump_nfa_to_dot(nfa *N, FILE *stream) {
   assert(N);
   fprintf(stream, "digraph {\n");
@@ -17,12 +36,13 @@ void dump_nfa_to_dot(nfa *N, FILE *stream) {
 
   ITER(line, start, &N->t_matrix) {
     ITER(path, p, &start->paths) {
-      if (p->trigger == '\0') {
+      if (p->first == '\0') {
         fprintf(stream, "  d%u -> d%u [label = \"'eps'\", style=dashed];\n",
                 start->id, p->end_state);
       } else {
-        fprintf(stream, "  d%u -> d%u [label = \"%c\"];\n", start->id,
-                p->end_state, p->trigger);
+        fprintf(stream, "  d%u -> d%u ", start->id, p->end_state);
+        print_label(p, stream);
+        fprintf(stream, ";\n");
       }
     }
   }
@@ -48,8 +68,33 @@ void dump_dfa_to_dot(dfa *D, FILE *stream) {
 
   ITER(line, start, &D->t_matrix) {
     ITER(path, p, &start->paths) {
-      fprintf(stream, " d%u -> d%u [label = \"%c\"];\n", start->id, p->end_state,
-              p->trigger);
+      fprintf(stream, " d%u -> d%u ", start->id, p->end_state);
+      print_label(p, stream);
+      fprintf(stream, ";\n");
+    }
+  }
+
+  fprintf(stream, "}\n");
+}
+
+void dump_aho_corasick_to_dot(aho_corasick *A, FILE *stream) {
+  assert(A);
+  fprintf(stream, "digraph {\n");
+  fprintf(stream, "  node [shape = circle]\n");
+  fprintf(stream, "  d1 [shape = %s]\n", A->output[1] ? "Msquare" : "square");
+
+  for (state_id_t id = 2; id <= A->n_states; id++) {
+    if (A->output[id])
+      fprintf(stream, " d%u [shape = doublecircle];\n", id);
+    if (A->fail[id] != 1)
+      fprintf(stream, " d%u -> d%u [style = dashed];\n", id, A->fail[id]);
+  }
+
+  ITER(line, start, &A->t_matrix) {
+    ITER(path, p, &start->paths) {
+      fprintf(stream, " d%u -> d%u ", start->id, p->end_state);
+      print_label(p, stream);
+      fprintf(stream, ";\n");
     }
   }
 
@@ -2,8 +2,10 @@
 #define DFA_H_
 
 #include "automata.h"
+#include "trie.h"
 
 void dump_nfa_to_dot(nfa *N, FILE *stream);
 void dump_dfa_to_dot(dfa *D, FILE *stream);
+void dump_aho_corasick_to_dot(aho_corasick *A, FILE *stream);
 
 #endif // DFA_H_
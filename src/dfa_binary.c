@@ -0,0 +1,308 @@
+#define _POSIX_C_SOURCE 200809L
+#include "dfa_binary.h"
+#include "regex_automata.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define HEADER_SIZE 32
+#define ENTRY_SIZE 24
+static const char magic[8] = "RADFA\0\0\0";
+
+binary_dfa binary_from_dfa(dfa *D, unsigned flags) {
+  binary_dfa b = {.n_states = D->n_states, .flags = flags};
+  state_id_t *next = calloc((size_t)D->n_states * 256, sizeof(state_id_t));
+  ITER(line, l, &D->t_matrix) {
+    ITER(path, p, &l->paths) {
+      for (unsigned c = p->first; c <= p->last; c++)
+        next[l->id * 256 + c] = p->end_state;
+    }
+  }
+
+  // refined one state at a time: two bytes stay in the same class if they
+  // were, and the state maps them to the same successor. classes are
+  // numbered in the order of their first byte.
+  memset(b.classes, 0, 256);
+  b.n_classes = 1;
+  for (state_id_t s = 1; s < D->n_states; s++) {
+    uint32_t keys[512] = {0};
+    unsigned char ids[512];
+    unsigned char refined[256];
+    unsigned count = 0;
+    for (unsigned c = 0; c < 256; c++) {
+      uint32_t key = ((uint32_t)b.classes[c] << 16 | next[s * 256 + c]) + 1;
+      size_t i = (key * 2654435761u) & 511;
+      while (keys[i] && keys[i] != key)
+        i = (i + 1) & 511;
+      if (!keys[i]) {
+        keys[i] = key;
+        ids[i] = count++;
+      }
+      refined[c] = ids[i];
+    }
+    memcpy(b.classes, refined, 256);
+    b.n_classes = count;
+  }
+
+  unsigned char first_byte[256];
+  for (int c = 255; c >= 0; c--)
+    first_byte[b.classes[c]] = c;
+
+  b.width = D->n_states <= 256 ? 1 : 2;
+  b.accepting = calloc(D->n_states, 1);
+  b.table = calloc((size_t)D->n_states * b.n_classes, b.width);
+  for (state_id_t s = 1; s < D->n_states; s++) {
+    b.accepting[s] = set_has(&D->accepting_states, s);
+    for (unsigned k = 0; k < b.n_classes; k++) {
+      state_id_t dest = next[s * 256 + first_byte[k]];
+      size_t i = (size_t)s * b.n_classes + k;
+      if (b.width == 1)
+        b.table[i] = dest;
+      else
+        memcpy(b.table + 2 * i, &dest, 2);
+    }
+  }
+  free(next);
+  return b;
+}
+
+void delete_binary_dfa(binary_dfa *b) {
+  free(b->accepting);
+  free(b->table);
+}
+
+static size_t align8(size_t n) { return (n + 7) & ~(size_t)7; }
+
+static size_t tables_size(size_t n_states, size_t n_classes, size_t width) {
+  return 256 + 2 * n_states + n_states * n_classes * width;
+}
+
+static uint64_t checksum(const unsigned char *data, size_t size) {
+  uint64_t h = HASH_INIT;
+  for (size_t i = 0; i < size; i++) {
+    // the checksum field itself counts as zeros.
+    unsigned char c = (i >= 24 && i < 32) ? 0 : data[i];
+    h = hash_mix(h, c);
+  }
+  return hash_finish(h);
+}
+
+void write_binary(FILE *stream, const char **names, const binary_dfa *dfas,
+                  size_t count) {
+  size_t size = HEADER_SIZE + ENTRY_SIZE * count;
+  for (size_t i = 0; i < count; i++)
+    size += strlen(names[i]) + 1;
+  for (size_t i = 0; i < count; i++)
+    size = align8(size) + tables_size(dfas[i].n_states, dfas[i].n_classes,
+                                      dfas[i].width);
+  size = align8(size);
+
+  unsigned char *data = calloc(size, 1);
+  uint16_t version = BINARY_VERSION, byte_order = 0x0102;
+  uint32_t n = count;
+  uint64_t total = size;
+  memcpy(data, magic, 8);
+  memcpy(data + 8, &version, 2);
+  memcpy(data + 10, &byte_order, 2);
+  memcpy(data + 12, &n, 4);
+  memcpy(data + 16, &total, 8);
+
+  size_t name_at = HEADER_SIZE + ENTRY_SIZE * count;
+  size_t tables_at = name_at;
+  for (size_t i = 0; i < count; i++)
+    tables_at += strlen(names[i]) + 1;
+
+  for (size_t i = 0; i < count; i++) {
+    const binary_dfa *b = &dfas[i];
+    unsigned char *entry = data + HEADER_SIZE + ENTRY_SIZE * i;
+    tables_at = align8(tables_at);
+    uint64_t offset = tables_at;
+    uint32_t name_offset = name_at, n_states = b->n_states;
+    uint16_t n_classes = b->n_classes;
+    memcpy(entry, &offset, 8);
+    memcpy(entry + 8, &name_offset, 4);
+    memcpy(entry + 12, &n_states, 4);
+    memcpy(entry + 16, &n_classes, 2);
+    entry[18] = b->width;
+    entry[19] = b->flags;
+
+    size_t name_len = strlen(names[i]) + 1;
+    memcpy(data + name_at, names[i], name_len);
+    name_at += name_len;
+
+    unsigned char *t = data + tables_at;
+    memcpy(t, b->classes, 256);
+    for (size_t s = 0; s < b->n_states; s++) {
+      uint16_t accept = b->accepting[s] ? i + 1 : 0;
+      memcpy(t + 256 + 2 * s, &accept, 2);
+    }
+    memcpy(t + 256 + 2 * b->n_states, b->table,
+           (size_t)b->n_states * b->n_classes * b->width);
+    tables_at += tables_size(b->n_states, b->n_classes, b->width);
+  }
+
+  uint64_t sum = checksum(data, size);
+  memcpy(data + 24, &sum, 8);
+  fwrite(data, 1, size, stream);
+  free(data);
+}
+
+// the fields of a directory entry.
+typedef struct {
+  const unsigned char *classes;
+  const uint16_t *accept;
+  const void *table;
+  const char *name;
+  uint32_t n_states;
+  uint16_t n_classes;
+  uint8_t width;
+  uint8_t flags;
+} entry;
+
+static entry entry_at(const ra_binary *b, size_t index) {
+  const unsigned char *e = b->base + HEADER_SIZE + ENTRY_SIZE * index;
+  entry result;
+  uint64_t offset;
+  uint32_t name_offset;
+  memcpy(&offset, e, 8);
+  memcpy(&name_offset, e + 8, 4);
+  memcpy(&result.n_states, e + 12, 4);
+  memcpy(&result.n_classes, e + 16, 2);
+  result.width = e[18];
+  result.flags = e[19];
+  result.name = (const char *)b->base + name_offset;
+  result.classes = b->base + offset;
+  result.accept = (const uint16_t *)(result.classes + 256);
+  result.table = result.accept + result.n_states;
+  return result;
+}
+
+size_t ra_binary_count(const ra_binary *b) {
+  uint32_t n;
+  memcpy(&n, b->base + 12, 4);
+  return n;
+}
+
+// everything the matcher relies on is checked once here, so that a corrupt
+// file can not make it read out of bounds.
+ra_status ra_binary_view(const void *data, size_t size, ra_binary *out) {
+  const unsigned char *base = data;
+  *out = (ra_binary){0};
+  uint16_t version, byte_order;
+  uint64_t total, sum;
+  if ((uintptr_t)data % 8 || size < HEADER_SIZE || memcmp(base, magic, 8))
+    return RA_ERR_FORMAT;
+  memcpy(&version, base + 8, 2);
+  memcpy(&byte_order, base + 10, 2);
+  memcpy(&total, base + 16, 8);
+  memcpy(&sum, base + 24, 8);
+  if (version != BINARY_VERSION || byte_order != 0x0102 || total != size ||
+      sum != checksum(base, size))
+    return RA_ERR_FORMAT;
+
+  ra_binary b = {.base = base, .size = size};
+  size_t count = ra_binary_count(&b);
+  if (count > (size - HEADER_SIZE) / ENTRY_SIZE)
+    return RA_ERR_FORMAT;
+  for (size_t i = 0; i < count; i++) {
+    const unsigned char *e = base + HEADER_SIZE + ENTRY_SIZE * i;
+    uint64_t offset;
+    uint32_t name_offset;
+    memcpy(&offset, e, 8);
+    memcpy(&name_offset, e + 8, 4);
+    if (name_offset >= size || !memchr(base + name_offset, '\0',
+                                       size - name_offset))
+      return RA_ERR_FORMAT;
+
+    entry en = entry_at(&b, i);
+    if (offset % 8 || en.n_states < 2 || en.n_states > 65536 ||
+        en.n_classes < 1 || en.n_classes > 256 ||
+        (en.width != 1 && en.width != 2) ||
+        (en.width == 1 && en.n_states > 256) || offset > size ||
+        tables_size(en.n_states, en.n_classes, en.width) > size - offset)
+      return RA_ERR_FORMAT;
+    for (unsigned c = 0; c < 256; c++)
+      if (en.classes[c] >= en.n_classes)
+        return RA_ERR_FORMAT;
+    for (size_t s = 0; s < en.n_states * en.n_classes; s++) {
+      unsigned dest = en.width == 1 ? ((const uint8_t *)en.table)[s]
+                                    : ((const uint16_t *)en.table)[s];
+      if (dest >= en.n_states)
+        return RA_ERR_FORMAT;
+    }
+  }
+  *out = b;
+  return RA_OK;
+}
+
+ra_status ra_binary_open(const char *file_name, ra_binary *out) {
+  *out = (ra_binary){0};
+  int fd = open(file_name, O_RDONLY);
+  if (fd < 0)
+    return RA_ERR_IO;
+  struct stat st;
+  if (fstat(fd, &st)) {
+    close(fd);
+    return RA_ERR_IO;
+  }
+  if (st.st_size < HEADER_SIZE) {
+    close(fd);
+    return RA_ERR_FORMAT;
+  }
+  void *data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED)
+    return RA_ERR_IO;
+
+  ra_status status = ra_binary_view(data, st.st_size, out);
+  if (status != RA_OK) {
+    munmap(data, st.st_size);
+    return status;
+  }
+  out->mapped = 1;
+  return RA_OK;
+}
+
+void ra_binary_close(ra_binary *b) {
+  if (b->mapped)
+    munmap((void *)b->base, b->size);
+  *b = (ra_binary){0};
+}
+
+const char *ra_binary_name(const ra_binary *b, size_t index) {
+  return entry_at(b, index).name;
+}
+
+long ra_binary_find(const ra_binary *b, const char *name) {
+  size_t count = ra_binary_count(b);
+  for (size_t i = 0; i < count; i++)
+    if (!strcmp(entry_at(b, i).name, name))
+      return i;
+  return -1;
+}
+
+int ra_binary_match(const ra_binary *b, size_t index, const char *buf,
+                    size_t len, size_t *match_len) {
+  entry e = entry_at(b, index);
+  const unsigned char *s = (const unsigned char *)buf;
+  int stop_early = e.flags & BINARY_SEARCH;
+  unsigned state = 1;
+  int found = e.accept[state] != 0;
+  size_t last = 0;
+
+  for (size_t i = 0; i < len && !(found && stop_early); i++) {
+    size_t at = (size_t)state * e.n_classes + e.classes[s[i]];
+    state = e.width == 1 ? ((const uint8_t *)e.table)[at]
+                         : ((const uint16_t *)e.table)[at];
+    if (!state)
+      break;
+    if (e.accept[state]) {
+      found = 1;
+      last = i + 1;
+    }
+  }
+  if (found)
+    *match_len = last;
+  return found;
+}
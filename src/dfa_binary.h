@@ -0,0 +1,50 @@
+#ifndef DFA_BINARY_H_
+#define DFA_BINARY_H_
+#include "automata.h"
+
+// the binary format of a set of DFAs, meant to be mapped in memory and
+// executed in place. every offset is from the start of the file, and every
+// integer is in the byte order of the machine that wrote it, recorded in the
+// header. the layout is:
+//
+//   header     char magic[8] = "RADFA\0\0\0", u16 version, u16 byte order
+//              (0x0102), u32 number of automata, u64 file size, u64
+//              `hash_bytes` of the file with this field set to 0.
+//   directory  for each automaton: u64 offset of its tables, u32 offset of
+//              its NUL terminated name, u32 number of states including the
+//              error state 0, u16 number of byte classes, u8 width of a
+//              state id in the transition table (1 or 2), u8 flags, u32
+//              reserved.
+//   tables     for each automaton, at an 8 byte aligned offset: the class of
+//              every byte (256 x u8), the accept table (one u16 per state:
+//              0, or 1 + the index of the rule it accepts), and the
+//              transitions, one row of `classes` state ids per state.
+//
+// state 1 is the start state. automata with the BINARY_SEARCH flag come
+// from `-s`: a match ends at the first accepting state.
+
+#define BINARY_VERSION 2
+#define BINARY_SEARCH 1
+
+// one automaton of the file, before it is laid out.
+typedef struct {
+  state_id_t n_states;
+  unsigned n_classes;
+  unsigned width;
+  unsigned flags;
+  unsigned char classes[256];
+  unsigned char *accepting; // one flag per state
+  unsigned char *table;     // n_states * n_classes ids of `width` bytes
+} binary_dfa;
+
+// the byte classes are the coarsest partition of the bytes that every
+// state maps to the same successor.
+binary_dfa binary_from_dfa(dfa *D, unsigned flags);
+void delete_binary_dfa(binary_dfa *b);
+
+// writes the file for the automata `dfas`, named after `names`. the accept
+// table of automaton `i` holds `i + 1` for its accepting states.
+void write_binary(FILE *stream, const char **names, const binary_dfa *dfas,
+                  size_t count);
+
+#endif // DFA_BINARY_H_
@@ -0,0 +1,362 @@
+#define _POSIX_C_SOURCE 200809L
+#include "dfa_cache.h"
+#include <errno.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// bumped whenever the layout below changes.
+#define CACHE_MAGIC "DFACACHE"
+#define RULES_MAGIC "DFARULES"
+#define CACHE_VERSION 1
+
+// after the magic and the version, native endian:
+//   u32 key length, the key,
+//   u16 number of states, the accepting states as one byte per state,
+//   u32 number of lines, then for each line:
+//     u16 id, u16 number of paths, and per path u8 first, u8 last, u16 end.
+//
+// the files of rule sets, `.rules`, have their own magic, then:
+//   u32 number of slots, and per slot u32 key length and the key of its
+//   rule, 0 for a free slot,
+//   the DFA as above, then for each state u16 number of slots accepting in
+//   it and the slots as u16.
+
+static void cache_file(dfa_cache *c, const char *key, size_t key_len,
+                       const char *extension, char name[1024]) {
+  snprintf(name, 1024, "%s/%016llx%s", c->dir,
+           (unsigned long long)hash_bytes(key, key_len), extension);
+}
+
+struct cache_entry {
+  uint64_t hash;
+  char *key; // NULL marks an empty slot
+  size_t key_len;
+  dfa *D;
+};
+
+int cache_open(dfa_cache *c, const char *dir, int in_memory) {
+  *c = (dfa_cache){.dir = dir, .in_memory = in_memory};
+  pthread_mutex_init(&c->lock, NULL);
+  atomic_init(&c->hits, 0);
+  atomic_init(&c->misses, 0);
+  return dir && mkdir(dir, 0777) && errno != EEXIST;
+}
+
+void cache_close(dfa_cache *c) {
+  for (size_t i = 0; i < c->cap; i++) {
+    if (c->slots[i].key) {
+      free(c->slots[i].key);
+      delete_dfa(c->slots[i].D);
+      free(c->slots[i].D);
+    }
+  }
+  free(c->slots);
+  pthread_mutex_destroy(&c->lock);
+}
+
+static struct cache_entry *memory_slot(struct cache_entry *slots, size_t cap,
+                                       uint64_t hash, const char *key,
+                                       size_t key_len) {
+  size_t i = hash & (cap - 1);
+  while (slots[i].key &&
+         (slots[i].hash != hash || slots[i].key_len != key_len ||
+          memcmp(slots[i].key, key, key_len)))
+    i = (i + 1) & (cap - 1);
+  return &slots[i];
+}
+
+static dfa *memory_load(dfa_cache *c, const char *key, size_t key_len) {
+  dfa *D = NULL;
+  pthread_mutex_lock(&c->lock);
+  if (c->cap) {
+    struct cache_entry *e =
+        memory_slot(c->slots, c->cap, hash_bytes(key, key_len), key, key_len);
+    if (e->key)
+      D = copy_dfa(e->D);
+  }
+  pthread_mutex_unlock(&c->lock);
+  return D;
+}
+
+static void memory_store(dfa_cache *c, const char *key, size_t key_len,
+                         dfa *D) {
+  pthread_mutex_lock(&c->lock);
+  if (2 * (c->size + 1) > c->cap) {
+    size_t cap = c->cap ? c->cap * 2 : 64;
+    struct cache_entry *slots = calloc(cap, sizeof(struct cache_entry));
+    for (size_t i = 0; i < c->cap; i++)
+      if (c->slots[i].key)
+        *memory_slot(slots, cap, c->slots[i].hash, c->slots[i].key,
+                     c->slots[i].key_len) = c->slots[i];
+    free(c->slots);
+    c->slots = slots;
+    c->cap = cap;
+  }
+  uint64_t hash = hash_bytes(key, key_len);
+  struct cache_entry *e = memory_slot(c->slots, c->cap, hash, key, key_len);
+  if (!e->key) {
+    *e = (struct cache_entry){.hash = hash, .key_len = key_len};
+    e->key = malloc(key_len);
+    memcpy(e->key, key, key_len);
+    // the table outlives the arena of the compilation that fills it.
+    arena *compilation_arena = arena_swap(NULL);
+    e->D = copy_dfa(D);
+    arena_swap(compilation_arena);
+    c->size++;
+  }
+  pthread_mutex_unlock(&c->lock);
+}
+
+static int read_u16(FILE *f, uint16_t *v) { return fread(v, 2, 1, f) == 1; }
+static int read_u32(FILE *f, uint32_t *v) { return fread(v, 4, 1, f) == 1; }
+
+// reads the magic, the version and the key, returns 0 if they are not the
+// expected ones.
+static int read_header(FILE *f, const char *magic, const char *key,
+                       size_t key_len) {
+  char stored_magic[sizeof(CACHE_MAGIC) - 1];
+  uint32_t version, stored_len;
+  if (fread(stored_magic, sizeof(stored_magic), 1, f) != 1 ||
+      memcmp(stored_magic, magic, sizeof(stored_magic)) ||
+      !read_u32(f, &version) || version != CACHE_VERSION ||
+      !read_u32(f, &stored_len) || stored_len != key_len)
+    return 0;
+
+  char *stored = malloc(key_len + 1);
+  int same = fread(stored, 1, key_len, f) == key_len &&
+             !memcmp(stored, key, key_len);
+  free(stored);
+  return same;
+}
+
+static dfa *read_dfa(FILE *f) {
+  uint16_t n_states;
+  if (!read_u16(f, &n_states) || n_states < 1 || n_states > MAX_NFA_SIZE)
+    return NULL;
+
+  dfa *D = calloc(sizeof(dfa), 1);
+  D->n_states = n_states;
+  D->t_matrix = L_VEC();
+  D->accepting_states = (bit_set){0};
+  for (state_id_t id = 0; id < n_states; id++) {
+    int c = fgetc(f);
+    if (c == EOF)
+      goto corrupt;
+    if (c)
+      set_insert(&D->accepting_states, id);
+  }
+
+  // lines and paths are checked to be sorted and in range, as they are
+  // appended without going through `transition_matrix_insert`.
+  uint32_t n_lines;
+  if (!read_u32(f, &n_lines) || n_lines >= n_states)
+    goto corrupt;
+  for (uint32_t i = 0; i < n_lines; i++) {
+    line l = {.paths = P_VEC()};
+    uint16_t n_paths;
+    if (!read_u16(f, &l.id) || !read_u16(f, &n_paths) || !l.id ||
+        l.id >= n_states ||
+        (D->t_matrix.size &&
+         ((line *)elem_at(&D->t_matrix, D->t_matrix.size - 1))->id >= l.id)) {
+      destroy(&l.paths);
+      goto corrupt;
+    }
+    vec_insert(&D->t_matrix, &l);
+    line *ll = elem_at(&D->t_matrix, D->t_matrix.size - 1);
+    for (unsigned j = 0; j < n_paths; j++) {
+      path p;
+      if (fread(&p.first, 1, 1, f) != 1 || fread(&p.last, 1, 1, f) != 1 ||
+          !read_u16(f, &p.end_state) || p.first > p.last || !p.first ||
+          p.end_state >= n_states ||
+          (j && ((path *)elem_at(&ll->paths, j - 1))->last >= p.first))
+        goto corrupt;
+      vec_insert(&ll->paths, &p);
+    }
+  }
+  return D;
+
+corrupt:
+  delete_dfa(D);
+  free(D);
+  return NULL;
+}
+
+// the DFA of a file, which must end right after it.
+static dfa *read_dfa_file(FILE *f, const char *key, size_t key_len) {
+  dfa *D = read_header(f, CACHE_MAGIC, key, key_len) ? read_dfa(f) : NULL;
+  if (D && fgetc(f) != EOF) {
+    delete_dfa(D);
+    free(D);
+    return NULL;
+  }
+  return D;
+}
+
+dfa *cache_load(dfa_cache *c, const char *key, size_t key_len) {
+  dfa *D = c->in_memory ? memory_load(c, key, key_len) : NULL;
+  if (!D && c->dir) {
+    char name[1024];
+    cache_file(c, key, key_len, ".dfa", name);
+    FILE *f = fopen(name, "rb");
+    D = f ? read_dfa_file(f, key, key_len) : NULL;
+    if (f)
+      fclose(f);
+    if (D && c->in_memory)
+      memory_store(c, key, key_len, D);
+  }
+  atomic_fetch_add(D ? &c->hits : &c->misses, 1);
+  return D;
+}
+
+static void write_u16(FILE *f, uint16_t v) { fwrite(&v, 2, 1, f); }
+static void write_u32(FILE *f, uint32_t v) { fwrite(&v, 4, 1, f); }
+
+static void write_header(FILE *f, const char *magic, const char *key,
+                         size_t key_len) {
+  fwrite(magic, sizeof(CACHE_MAGIC) - 1, 1, f);
+  write_u32(f, CACHE_VERSION);
+  write_u32(f, key_len);
+  fwrite(key, 1, key_len, f);
+}
+
+static void write_dfa(FILE *f, dfa *D) {
+  write_u16(f, D->n_states);
+  for (state_id_t id = 0; id < D->n_states; id++)
+    fputc(set_has(&D->accepting_states, id), f);
+  write_u32(f, D->t_matrix.size);
+  ITER(line, l, &D->t_matrix) {
+    write_u16(f, l->id);
+    write_u16(f, l->paths.size);
+    ITER(path, p, &l->paths) {
+      fputc(p->first, f);
+      fputc(p->last, f);
+      write_u16(f, p->end_state);
+    }
+  }
+}
+
+// opens a temporary file next to the one named by `key` and `extension`.
+static FILE *open_temporary(dfa_cache *c, const char *key, size_t key_len,
+                            const char *extension, char tmp[1024]) {
+  char pattern[64];
+  snprintf(pattern, sizeof(pattern), "%s.XXXXXX", extension);
+  cache_file(c, key, key_len, pattern, tmp);
+  int fd = mkstemp(tmp);
+  return fd < 0 ? NULL : fdopen(fd, "wb");
+}
+
+// closes the temporary file and renames it over the one named by `key`.
+static void commit_temporary(dfa_cache *c, const char *key, size_t key_len,
+                             const char *extension, FILE *f,
+                             const char tmp[1024]) {
+  char name[1024];
+  cache_file(c, key, key_len, extension, name);
+  if (fclose(f) || rename(tmp, name))
+    unlink(tmp);
+}
+
+void cache_store(dfa_cache *c, const char *key, size_t key_len, dfa *D) {
+  if (c->in_memory)
+    memory_store(c, key, key_len, D);
+  if (!c->dir)
+    return;
+
+  char tmp[1024];
+  FILE *f = open_temporary(c, key, key_len, ".dfa", tmp);
+  if (!f)
+    return;
+  write_header(f, CACHE_MAGIC, key, key_len);
+  write_dfa(f, D);
+  commit_temporary(c, key, key_len, ".dfa", f, tmp);
+}
+
+rule_set *cache_load_rules(dfa_cache *c, const char *key, size_t key_len,
+                           vector *rule_keys) {
+  if (!c->dir)
+    return NULL;
+  char name[1024];
+  cache_file(c, key, key_len, ".rules", name);
+  FILE *f = fopen(name, "rb");
+  if (!f)
+    return NULL;
+
+  rule_set *S = NULL;
+  uint32_t n_slots;
+  if (!read_header(f, RULES_MAGIC, key, key_len) || !read_u32(f, &n_slots) ||
+      n_slots > MAX_NFA_SIZE)
+    goto done;
+  for (uint32_t i = 0; i < n_slots; i++) {
+    uint32_t len;
+    if (!read_u32(f, &len))
+      goto done;
+    char *rule_key = NULL;
+    if (len) {
+      rule_key = malloc(len + 1);
+      rule_key[len] = '\0';
+      if (fread(rule_key, 1, len, f) != len) {
+        free(rule_key);
+        goto done;
+      }
+    }
+    vec_insert(rule_keys, &rule_key);
+  }
+
+  dfa *D = read_dfa(f);
+  if (!D)
+    goto done;
+  S = calloc(sizeof(rule_set), 1);
+  S->D = D;
+  S->accepts = VEC(bit_set, NULL);
+  for (state_id_t id = 0; id < D->n_states; id++) {
+    bit_set slots = {0};
+    uint16_t n, slot;
+    if (!read_u16(f, &n))
+      goto corrupt;
+    for (unsigned k = 0; k < n; k++) {
+      if (!read_u16(f, &slot) || slot >= n_slots)
+        goto corrupt;
+      set_insert(&slots, slot);
+    }
+    if (empty(&slots) == set_has(&D->accepting_states, id))
+      goto corrupt;
+    vec_insert(&S->accepts, &slots);
+  }
+  if (fgetc(f) == EOF)
+    goto done;
+
+corrupt:
+  delete_rule_set(S);
+  S = NULL;
+done:
+  fclose(f);
+  if (!S) {
+    ITER(char *, k, rule_keys) { free(*k); }
+    rule_keys->size = 0;
+  }
+  return S;
+}
+
+void cache_store_rules(dfa_cache *c, const char *key, size_t key_len,
+                       const rule_set *S, const vector *rule_keys) {
+  if (!c->dir)
+    return;
+  char tmp[1024];
+  FILE *f = open_temporary(c, key, key_len, ".rules", tmp);
+  if (!f)
+    return;
+  write_header(f, RULES_MAGIC, key, key_len);
+  write_u32(f, rule_keys->size);
+  ITER(char *, k, rule_keys) {
+    write_u32(f, *k ? strlen(*k) : 0);
+    if (*k)
+      fputs(*k, f);
+  }
+  write_dfa(f, S->D);
+  ITER(bit_set, slots, &S->accepts) {
+    uint16_t n = 0;
+    ITERATE_BITSET(slot, *slots) { n++; }
+    write_u16(f, n);
+    ITERATE_BITSET(slot, *slots) { write_u16(f, slot); }
+  }
+  commit_temporary(c, key, key_len, ".rules", f, tmp);
+}
@@ -0,0 +1,43 @@
+#ifndef DFA_CACHE_H_
+#define DFA_CACHE_H_
+#include "automata.h"
+#include "rule_set.h"
+#include <pthread.h>
+#include <stdatomic.h>
+
+// a directory of minimal DFAs, each in a file named after the hash of the
+// key it was stored with, and optionally a table of the ones already loaded
+// or stored in this process. the key is kept with the DFA too, so that a
+// hash collision is a miss. can be shared by threads.
+typedef struct {
+  const char *dir; // NULL if nothing is kept on disk
+  int in_memory;
+  pthread_mutex_t lock; // of the table
+  struct cache_entry *slots;
+  size_t cap;
+  size_t size;
+  atomic_size_t hits;
+  atomic_size_t misses;
+} dfa_cache;
+
+// creates the directory if it does not exist. returns 1 on failure.
+int cache_open(dfa_cache *c, const char *dir, int in_memory);
+void cache_close(dfa_cache *c);
+
+// a copy of the DFA stored with `key`, or NULL if there is none or it is
+// unreadable.
+dfa *cache_load(dfa_cache *c, const char *key, size_t key_len);
+
+// files are written under a temporary name and renamed, so readers never
+// see a partial DFA. failures are ignored, the cache is only an optimization.
+void cache_store(dfa_cache *c, const char *key, size_t key_len, dfa *D);
+
+// the rule set stored with `key`, and the keys of the rules in its slots
+// appended to `rule_keys` as strings, NULL for a free slot. NULL if there
+// is none, or it is unreadable. rule sets are only kept on disk.
+rule_set *cache_load_rules(dfa_cache *c, const char *key, size_t key_len,
+                           vector *rule_keys);
+void cache_store_rules(dfa_cache *c, const char *key, size_t key_len,
+                       const rule_set *S, const vector *rule_keys);
+
+#endif // DFA_CACHE_H_
@@ -0,0 +1,70 @@
+#include "levenshtein.h"
+
+static void add_path(nfa *N, state_id_t start, unsigned char first,
+                     unsigned char last, state_id_t end) {
+  const path p = {.first = first, .last = last, .end_state = end};
+  line l = {.id = start};
+
+  line *ll = vec_find_sorted(&N->t_matrix, &l);
+  if (ll) {
+    vec_insert_sorted(&ll->paths, &p);
+  } else {
+    l.paths = P_VEC(p);
+    vec_insert_sorted(&N->t_matrix, &l);
+  }
+}
+
+// state `q` of the DFA after `edits` edits.
+static state_id_t after(size_t width, unsigned edits, state_id_t q) {
+  return edits * width + q;
+}
+
+nfa levenshtein_nfa(dfa *D, unsigned distance) {
+  nfa N = {.t_matrix = L_VEC()};
+  // every accepting state moves to the end state on epsilon.
+  size_t width = D->n_states - 1;
+  size_t end = (distance + 1) * width + 1;
+  if (end >= MAX_NFA_SIZE)
+    return N;
+
+  ITER(line, l, &D->t_matrix) {
+    if (!l->id)
+      continue;
+    // the states a byte of the regex leads to, once each.
+    bit_set next = {0};
+    ITER(path, p, &l->paths) {
+      if (p->end_state)
+        set_insert(&next, p->end_state);
+    }
+    for (unsigned e = 0; e <= distance; e++) {
+      ITER(path, p, &l->paths) {
+        if (p->end_state)
+          add_path(&N, after(width, e, l->id), p->first, p->last,
+                   after(width, e, p->end_state));
+      }
+      if (e == distance)
+        continue;
+      ITERATE_BITSET(t, next) {
+        // a byte read instead of the one of the regex, or skipped in the
+        // regex.
+        add_path(&N, after(width, e, l->id), 1, 255, after(width, e + 1, t));
+        add_path(&N, after(width, e, l->id), '\0', '\0',
+                 after(width, e + 1, t));
+      }
+    }
+  }
+  for (state_id_t q = 1; q < D->n_states; q++) {
+    int accepting = set_has(&D->accepting_states, q);
+    for (unsigned e = 0; e <= distance; e++) {
+      // a byte that is not in the regex.
+      if (e < distance)
+        add_path(&N, after(width, e, q), 1, 255, after(width, e + 1, q));
+      if (accepting)
+        add_path(&N, after(width, e, q), '\0', '\0', end);
+    }
+  }
+
+  N.start_id = 1;
+  N.end_id = end;
+  return N;
+}
@@ -0,0 +1,13 @@
+#ifndef LEVENSHTEIN_H_
+#define LEVENSHTEIN_H_
+#include "automata.h"
+
+// an NFA accepting the strings within `distance` edits of a string accepted
+// by the DFA `D`: byte insertions, deletions and substitutions, over the
+// bytes 1 to 255. it is `distance + 1` copies of `D`, one per number of
+// edits made so far, where an edit moves to the next copy. returns an NFA
+// with `start_id == 0`, and no transitions, if it would exceed MAX_NFA_SIZE
+// states.
+nfa levenshtein_nfa(dfa *D, unsigned distance);
+
+#endif // LEVENSHTEIN_H_
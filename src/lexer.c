@@ -0,0 +1,194 @@
+#include "regex_automata.h"
+#include <stdlib.h>
+#include <string.h>
+
+// the tokens are kept in a gap buffer, the gap at the last edit. the offsets
+// of the tokens after the gap are counted from the end of the buffer, so
+// that an edit does not change them.
+typedef struct {
+  size_t offset;
+  size_t length;
+  // the bytes examined from the offset to find the token, or the tokens
+  // skipped before it: an edit before offset + reach leaves it alone.
+  size_t reach;
+  // the bytes from the offset up to the farthest that this token or any
+  // before it examined: an edit from offset + covered on leaves all of them
+  // alone.
+  size_t covered;
+  unsigned rule;
+} entry;
+
+struct ra_lexer {
+  ra_scanner scan;
+  entry *tokens; // [0, gap) and [gap + cap - n, cap)
+  size_t n;
+  size_t cap;
+  size_t gap;
+  size_t len;  // of the buffer
+  size_t end;  // where the tokens stop, from the end of the buffer
+  size_t tail; // the bytes examined from `end` on to stop there
+};
+
+static entry *after_gap(ra_lexer *L) {
+  return &L->tokens[L->gap + L->cap - L->n];
+}
+
+// moves the gap to the first token starting at `at` or later.
+static void move_gap(ra_lexer *L, size_t at) {
+  size_t width = L->cap - L->n;
+  while (L->gap > 0 && L->tokens[L->gap - 1].offset >= at) {
+    entry e = L->tokens[--L->gap];
+    e.offset = L->len - e.offset;
+    L->tokens[L->gap + width] = e;
+  }
+  while (L->gap < L->n && L->len - after_gap(L)->offset < at) {
+    entry e = *after_gap(L);
+    e.offset = L->len - e.offset;
+    L->tokens[L->gap++] = e;
+  }
+}
+
+// the bytes from `offset` that a token which examined `reach` of them
+// covers, after a token before it that covers up to `before`.
+static size_t cover(size_t before, size_t offset, size_t reach) {
+  return before > offset + reach ? before - offset : reach;
+}
+
+static void insert(ra_lexer *L, entry e) {
+  if (L->n == L->cap) {
+    size_t cap = L->cap ? 2 * L->cap : 64;
+    L->tokens = realloc(L->tokens, cap * sizeof(entry));
+    size_t moved = L->n - L->gap;
+    memmove(&L->tokens[cap - moved], &L->tokens[L->cap - moved],
+            moved * sizeof(entry));
+    L->cap = cap;
+  }
+  const entry *prev = L->gap ? &L->tokens[L->gap - 1] : NULL;
+  e.covered = cover(prev ? prev->offset + prev->covered : 0, e.offset, e.reach);
+  L->tokens[L->gap++] = e;
+  L->n++;
+}
+
+// the tokens after the gap follow new ones: updates what they cover, up to
+// the first one that covers as much as before, after which nothing changed.
+// a token that reached far and is gone stops counting here.
+static void recover(ra_lexer *L) {
+  const entry *prev = L->gap ? &L->tokens[L->gap - 1] : NULL;
+  size_t before = prev ? prev->offset + prev->covered : 0;
+  for (entry *e = after_gap(L); e < L->tokens + L->cap; e++) {
+    size_t offset = L->len - e->offset;
+    size_t covered = cover(before, offset, e->reach);
+    if (covered == e->covered)
+      return;
+    e->covered = covered;
+    before = offset + covered;
+  }
+}
+
+// scans from `p`, a token boundary, replacing the tokens after the gap until
+// a new token starts where one of them does at `synced` or later.
+static void rescan(ra_lexer *L, const char *buf, size_t p, size_t synced,
+                   ra_relex_result *r) {
+  size_t from = p;
+  for (;;) {
+    unsigned long start, read;
+    unsigned rule;
+    size_t length = L->scan(buf + p, L->len - p, &start, &rule, &read);
+    size_t q = p + start;
+    size_t reach = p + read - q;
+    r->scanned = (p + read > L->len ? L->len : p + read) - from;
+
+    // the old tokens that start before the new one are gone.
+    while (L->gap < L->n && after_gap(L)->offset > L->len - q) {
+      L->n--;
+      r->removed++;
+    }
+    if (!length) {
+      r->removed += L->n - L->gap;
+      L->n = L->gap;
+      L->end = L->len - q;
+      L->tail = reach;
+      return;
+    }
+    if (q >= synced && L->gap < L->n && after_gap(L)->offset == L->len - q) {
+      // the text from here on is the one scanned before, but the tokens
+      // skipped before this one may have changed.
+      after_gap(L)->reach = reach;
+      recover(L);
+      return;
+    }
+    insert(L, (entry){q, length, reach, 0, rule});
+    r->inserted++;
+    p = q + length;
+  }
+}
+
+ra_lexer *ra_lexer_new(ra_scanner scan) {
+  ra_lexer *L = calloc(1, sizeof(ra_lexer));
+  L->scan = scan;
+  return L;
+}
+
+void ra_lexer_free(ra_lexer *L) {
+  if (!L)
+    return;
+  free(L->tokens);
+  free(L);
+}
+
+void ra_lex(ra_lexer *L, const char *buf, size_t len) {
+  L->n = L->gap = 0;
+  L->len = len;
+  ra_relex_result r = {0};
+  rescan(L, buf, 0, len + 1, &r);
+}
+
+ra_relex_result ra_relex(ra_lexer *L, const char *buf, size_t at,
+                         size_t removed, size_t inserted) {
+  size_t len = L->len - removed + inserted;
+  move_gap(L, at);
+  // the tokens before the gap start before the edit, but the first ones it
+  // damages may be further back, as long as one before covers the edit.
+  ra_relex_result r = {0};
+  size_t first = L->gap;
+  for (size_t i = L->gap; i-- > 0;) {
+    const entry *e = &L->tokens[i];
+    if (e->offset + e->covered <= at)
+      break;
+    r.visited++;
+    if (e->offset + e->reach > at)
+      first = i;
+  }
+  r.first = first;
+
+  size_t stop = L->len - L->end;
+  if (first == L->n && stop + L->tail <= at) {
+    // the edit is past everything the tokens depend on.
+    L->end += len - L->len;
+    L->len = len;
+    return r;
+  }
+
+  size_t p = 0;
+  if (first)
+    p = L->tokens[first - 1].offset + L->tokens[first - 1].length;
+  r.removed = L->gap - first;
+  L->n -= L->gap - first;
+  L->gap = first;
+  L->len = len;
+  rescan(L, buf, p, at + inserted, &r);
+  return r;
+}
+
+size_t ra_lexer_count(const ra_lexer *L) { return L->n; }
+
+ra_token ra_lexer_token(const ra_lexer *L, size_t index) {
+  if (index < L->gap) {
+    const entry *e = &L->tokens[index];
+    return (ra_token){e->offset, e->length, e->rule};
+  }
+  const entry *e = &L->tokens[index + L->cap - L->n];
+  return (ra_token){L->len - e->offset, e->length, e->rule};
+}
+
+size_t ra_lexer_end(const ra_lexer *L) { return L->len - L->end; }
@@ -0,0 +1,221 @@
+#include "parallel_dfa.h"
+#include "thread_pool.h"
+#include <pthread.h>
+#include <stdatomic.h>
+
+#define N_STRIPES 64
+
+typedef struct subset {
+  bit_set set;
+  uint64_t hash;
+  vector paths;   // of `range`, in byte order
+  state_id_t id;  // the final number, 0 until it is assigned
+} subset;
+
+typedef struct {
+  unsigned char first;
+  unsigned char last;
+  subset *dest;
+} range;
+
+// an open addressing table of subsets, each stripe behind its own lock.
+typedef struct {
+  pthread_mutex_t lock;
+  subset **slots;
+  size_t cap;
+  size_t size;
+} stripe;
+
+typedef struct {
+  stripe stripes[N_STRIPES];
+  atomic_size_t n_states; // including the error state
+} subset_table;
+
+typedef struct {
+  nfa *N;
+  subset_table *table;
+  subset **frontier;
+  vector *found;          // new subsets, for each subset of the frontier
+  atomic_int too_large;
+  // the work of the tasks, which run on other threads than the caller.
+  atomic_size_t closures;
+  atomic_size_t lookups;
+  atomic_size_t bytes;
+} level;
+
+static uint64_t set_hash(const bit_set *s) {
+  uint64_t h = HASH_INIT;
+  for (size_t i = 0; i < BS_N_BLOCKS; i++)
+    h = hash_mix(h, s->data[i]);
+  return hash_finish(h);
+}
+
+static subset **stripe_slot(stripe *st, const bit_set *s, uint64_t hash) {
+  size_t i = (hash / N_STRIPES) & (st->cap - 1);
+  while (st->slots[i] && (st->slots[i]->hash != hash ||
+                          memcmp(&st->slots[i]->set, s, sizeof(bit_set))))
+    i = (i + 1) & (st->cap - 1);
+  return &st->slots[i];
+}
+
+static void stripe_grow(stripe *st) {
+  stripe bigger = {.cap = st->cap ? st->cap * 2 : 16, .size = st->size};
+  bigger.slots = calloc(bigger.cap, sizeof(subset *));
+  for (size_t i = 0; i < st->cap; i++)
+    if (st->slots[i])
+      *stripe_slot(&bigger, &st->slots[i]->set, st->slots[i]->hash) =
+          st->slots[i];
+  free(st->slots);
+  st->slots = bigger.slots;
+  st->cap = bigger.cap;
+}
+
+// the subset equal to `s`, created if it is new. NULL if there is no state
+// left for it.
+static subset *intern(subset_table *T, const bit_set *s, int *created) {
+  uint64_t hash = set_hash(s);
+  stripe *st = &T->stripes[hash % N_STRIPES];
+  subset *result = NULL;
+  *created = 0;
+
+  pthread_mutex_lock(&st->lock);
+  if (2 * (st->size + 1) > st->cap)
+    stripe_grow(st);
+  subset **slot = stripe_slot(st, s, hash);
+  if (*slot) {
+    result = *slot;
+  } else if (atomic_fetch_add(&T->n_states, 1) < MAX_NFA_SIZE) {
+    result = calloc(sizeof(subset), 1);
+    result->set = *s;
+    result->hash = hash;
+    result->paths = VEC(range, NULL);
+    *slot = result;
+    st->size++;
+    *created = 1;
+  }
+  pthread_mutex_unlock(&st->lock);
+  return result;
+}
+
+static void expand(void *arg, size_t task) {
+  level *l = arg;
+  subset *q = l->frontier[task];
+  if (atomic_load(&l->too_large))
+    return;
+  work_counters before = thread_counters;
+
+  unsigned char cut[257];
+  mark_cuts(&l->N->t_matrix, &q->set, cut);
+
+  for (unsigned c = 1, next; c < 256; c = next) {
+    for (next = c + 1; next < 256 && !cut[next]; next++)
+      ;
+
+    bit_set tmp = delta(l->N, &q->set, c);
+    if (empty(&tmp))
+      continue;
+
+    bit_set t = eps_closure(l->N, &tmp);
+    int created;
+    subset *dest = intern(l->table, &t, &created);
+    thread_counters.lookups++;
+    if (!dest) {
+      atomic_store(&l->too_large, 1);
+      break;
+    }
+    if (created)
+      vec_insert(&l->found[task], &dest);
+    range r = {.first = c, .last = next - 1, .dest = dest};
+    vec_insert(&q->paths, &r);
+  }
+
+  // moved to the caller's counters once the construction is done.
+  atomic_fetch_add(&l->closures, thread_counters.closures - before.closures);
+  atomic_fetch_add(&l->lookups, thread_counters.lookups - before.lookups);
+  atomic_fetch_add(&l->bytes, thread_counters.bytes - before.bytes);
+  thread_counters = before;
+}
+
+dfa *to_dfa_parallel(nfa *N, unsigned n_threads) {
+  // the subsets are grown by every thread, so they can not live in the
+  // caller's arena. only the result does.
+  arena *caller_arena = arena_swap(NULL);
+  subset_table table = {0};
+  for (unsigned i = 0; i < N_STRIPES; i++)
+    pthread_mutex_init(&table.stripes[i].lock, NULL);
+  atomic_init(&table.n_states, 1);
+
+  bit_set n0 = {0};
+  set_insert(&n0, N->start_id);
+  bit_set q0 = eps_closure(N, &n0);
+  int created;
+  subset *start = intern(&table, &q0, &created);
+
+  level l = {.N = N, .table = &table};
+  atomic_init(&l.too_large, 0);
+  atomic_init(&l.closures, 0);
+  atomic_init(&l.lookups, 0);
+  atomic_init(&l.bytes, 0);
+  vector frontier = VEC(subset *, NULL, start);
+  while (frontier.size && !atomic_load(&l.too_large)) {
+    l.frontier = frontier.ptr;
+    l.found = calloc(frontier.size, sizeof(vector));
+    for (size_t i = 0; i < frontier.size; i++)
+      l.found[i] = VEC(subset *, NULL);
+
+    parallel_for(frontier.size, n_threads, expand, &l);
+
+    vector next = VEC(subset *, NULL);
+    for (size_t i = 0; i < frontier.size; i++) {
+      ITER(subset *, s, &l.found[i]) { vec_insert(&next, s); }
+      destroy(&l.found[i]);
+    }
+    free(l.found);
+    destroy(&frontier);
+    frontier = next;
+  }
+  destroy(&frontier);
+  thread_counters.closures += atomic_load(&l.closures);
+  thread_counters.lookups += atomic_load(&l.lookups);
+  thread_counters.bytes += atomic_load(&l.bytes);
+  arena_swap(caller_arena);
+
+  dfa *result = NULL;
+  if (!atomic_load(&l.too_large)) {
+    result = calloc(sizeof(dfa), 1);
+    result->t_matrix = L_VEC();
+    result->accepting_states = (bit_set){0};
+
+    // the canonical numbering: breadth first, successors in byte order.
+    vector order = VEC(subset *, NULL, start);
+    start->id = 1;
+    for (size_t head = 0; head < order.size; head++) {
+      subset *s = *(subset **)elem_at(&order, head);
+      if (set_has(&s->set, N->end_id))
+        set_insert(&result->accepting_states, s->id);
+      ITER(range, r, &s->paths) {
+        if (!r->dest->id) {
+          r->dest->id = order.size + 1;
+          vec_insert(&order, &r->dest);
+        }
+        transition_matrix_insert(&result->t_matrix, s->id, r->first, r->last,
+                                 r->dest->id);
+      }
+    }
+    result->n_states = order.size + 1; // 1 for the ERR state
+    destroy(&order);
+  }
+
+  for (unsigned i = 0; i < N_STRIPES; i++) {
+    stripe *st = &table.stripes[i];
+    for (size_t j = 0; j < st->cap; j++) {
+      if (st->slots[j]) {
+        destroy(&st->slots[j]->paths);
+        free(st->slots[j]);
+      }
+    }
+    free(st->slots);
+    pthread_mutex_destroy(&st->lock);
+  }
+  return result;
+}
@@ -0,0 +1,14 @@
+#ifndef PARALLEL_DFA_H_
+#define PARALLEL_DFA_H_
+#include "automata.h"
+
+// subset construction on `n_threads` threads. the frontier of new subsets is
+// expanded one breadth first level at a time, the threads sharing the
+// subsets of a level and interning their successors in a striped hash
+// table. states are then numbered breadth first from the start state,
+// following the transitions in byte order, so the result does not depend on
+// the number of threads or on their timing.
+// NULL if the DFA would exceed MAX_NFA_SIZE states.
+dfa *to_dfa_parallel(nfa *N, unsigned n_threads);
+
+#endif // PARALLEL_DFA_H_
@@ -0,0 +1,226 @@
+#include "product.h"
+#include "thompson.h"
+
+// maps pairs of states to the id of their product state.
+typedef struct {
+  uint32_t *keys; // (a << 16 | b) + 1, 0 marks an empty slot
+  state_id_t *ids;
+  size_t cap;
+  size_t size;
+} pair_map;
+
+static size_t pair_slot(pair_map *m, uint32_t key) {
+  size_t i = (key * 2654435761u) & (m->cap - 1);
+  while (m->keys[i] && m->keys[i] != key)
+    i = (i + 1) & (m->cap - 1);
+  return i;
+}
+
+static void pair_map_grow(pair_map *m) {
+  pair_map bigger = {.cap = m->cap ? m->cap * 2 : 256, .size = m->size};
+  bigger.keys = calloc(bigger.cap, sizeof(uint32_t));
+  bigger.ids = calloc(bigger.cap, sizeof(state_id_t));
+  for (size_t i = 0; i < m->cap; i++) {
+    if (m->keys[i]) {
+      size_t j = pair_slot(&bigger, m->keys[i]);
+      bigger.keys[j] = m->keys[i];
+      bigger.ids[j] = m->ids[i];
+    }
+  }
+  free(m->keys);
+  free(m->ids);
+  *m = bigger;
+}
+
+static int alive(state_pair p, product_op op) {
+  switch (op) {
+  case PRODUCT_AND:
+    return p.a && p.b;
+  case PRODUCT_DIFF:
+    return p.a != 0;
+  case PRODUCT_OR:
+    return p.a || p.b;
+  }
+  return 0;
+}
+
+static int accepts(dfa *A, dfa *B, state_pair p, product_op op) {
+  int a = p.a && set_has(&A->accepting_states, p.a);
+  int b = p.b && set_has(&B->accepting_states, p.b);
+  switch (op) {
+  case PRODUCT_AND:
+    return a && b;
+  case PRODUCT_DIFF:
+    return a && !b;
+  case PRODUCT_OR:
+    return a || b;
+  }
+  return 0;
+}
+
+static void mark_line_cuts(line *l, unsigned char cut[257]) {
+  if (!l)
+    return;
+  ITER(path, p, &l->paths) {
+    cut[p->first] = 1;
+    cut[p->last + 1] = 1;
+  }
+}
+
+static state_id_t step(line *l, unsigned char c) {
+  path *p = l ? find_path(l, c) : NULL;
+  return p ? p->end_state : 0;
+}
+
+// the id of the product state for `q`, queueing it if it is new. 0 if there
+// is no id left for it.
+static state_id_t intern(pair_map *m, vector *queue, state_pair q) {
+  if (2 * (m->size + 1) > m->cap)
+    pair_map_grow(m);
+
+  uint32_t key = ((uint32_t)q.a << 16 | q.b) + 1;
+  size_t slot = pair_slot(m, key);
+  if (!m->keys[slot]) {
+    if (queue->size + 1 >= MAX_NFA_SIZE)
+      return 0;
+    m->keys[slot] = key;
+    m->ids[slot] = queue->size + 1;
+    m->size++;
+    vec_insert(queue, &q);
+  }
+  return m->ids[slot];
+}
+
+dfa *dfa_product(dfa *A, dfa *B, product_op op) {
+  vector pairs = VEC(state_pair, NULL);
+  dfa *result = dfa_product_pairs(A, B, op, &pairs);
+  destroy(&pairs);
+  return result;
+}
+
+dfa *dfa_product_pairs(dfa *A, dfa *B, product_op op, vector *pairs) {
+  dfa *result = calloc(sizeof(dfa), 1);
+  result->t_matrix = L_VEC();
+  result->accepting_states = (bit_set){0};
+
+  // states are numbered in the order they are discovered, the start pair
+  // being state 1. only the reachable pairs are ever built.
+  pair_map ids = {0};
+  intern(&ids, pairs, (state_pair){1, 1});
+
+  for (size_t head = 0; head < pairs->size; head++) {
+    state_pair p = *(state_pair *)elem_at(pairs, head);
+    state_id_t id = head + 1;
+    if (accepts(A, B, p, op))
+      set_insert(&result->accepting_states, id);
+
+    line *la = p.a ? find_line(&A->t_matrix, p.a) : NULL;
+    line *lb = p.b ? find_line(&B->t_matrix, p.b) : NULL;
+    unsigned char cut[257] = {0};
+    mark_line_cuts(la, cut);
+    mark_line_cuts(lb, cut);
+
+    for (unsigned c = 1, next; c < 256; c = next) {
+      for (next = c + 1; next < 256 && !cut[next]; next++)
+        ;
+
+      state_pair q = {step(la, c), step(lb, c)};
+      if (!alive(q, op))
+        continue;
+      state_id_t dest = intern(&ids, pairs, q);
+      if (!dest) {
+        delete_dfa(result);
+        free(result);
+        result = NULL;
+        goto done;
+      }
+      transition_matrix_insert(&result->t_matrix, id, c, next - 1, dest);
+    }
+  }
+  result->n_states = pairs->size + 1; // 1 for the ERR state
+
+done:
+  free(ids.keys);
+  free(ids.ids);
+  return result;
+}
+
+dfa *dfa_complement(dfa *A) {
+  // missing transitions lead to a new, accepting, sink state.
+  state_id_t sink = A->n_states;
+  if (sink >= MAX_NFA_SIZE)
+    return NULL;
+
+  dfa *result = calloc(sizeof(dfa), 1);
+  result->t_matrix = L_VEC();
+  result->accepting_states = (bit_set){0};
+  result->n_states = A->n_states + 1;
+
+  for (state_id_t id = 1; id <= sink; id++) {
+    if (id == sink || !set_has(&A->accepting_states, id))
+      set_insert(&result->accepting_states, id);
+
+    line *l = id == sink ? NULL : find_line(&A->t_matrix, id);
+    unsigned c = 1;
+    if (l) {
+      ITER(path, p, &l->paths) {
+        if (c < p->first)
+          transition_matrix_insert(&result->t_matrix, id, c, p->first - 1,
+                                   sink);
+        transition_matrix_insert(&result->t_matrix, id, p->first, p->last,
+                                 p->end_state);
+        c = p->last + 1;
+      }
+    }
+    if (c < 256)
+      transition_matrix_insert(&result->t_matrix, id, c, 255, sink);
+  }
+  return result;
+}
+
+static dfa *minimized(dfa *D) {
+  if (!D)
+    return NULL;
+  dfa *M = minimize(D);
+  delete_dfa(D);
+  free(D);
+  return M;
+}
+
+static void free_dfa(dfa *D) {
+  if (!D)
+    return;
+  delete_dfa(D);
+  free(D);
+}
+
+dfa *ast_to_dfa(const ast *a) {
+  dfa *D;
+  switch (a->kind) {
+  case AST_AND:
+  case AST_DIFF:
+    D = ast_to_dfa(ast_child(a, 0));
+    for (size_t i = 1; D && i < a->children.size; i++) {
+      dfa *operand = ast_to_dfa(ast_child(a, i));
+      dfa *P = operand ? dfa_product(D, operand, a->kind == AST_AND
+                                                     ? PRODUCT_AND
+                                                     : PRODUCT_DIFF)
+                       : NULL;
+      free_dfa(D);
+      free_dfa(operand);
+      D = minimized(P);
+    }
+    return D;
+  case AST_NOT:
+    D = ast_to_dfa(ast_child(a, 0));
+    dfa *C = D ? dfa_complement(D) : NULL;
+    free_dfa(D);
+    return minimized(C);
+  default: {
+    nfa N = ast_to_nfa(a);
+    D = N.start_id ? to_dfa(&N) : NULL;
+    delete_nfa(&N);
+    return minimized(D);
+  }
+  }
+}
@@ -0,0 +1,33 @@
+#ifndef PRODUCT_H_
+#define PRODUCT_H_
+#include "ast.h"
+#include "automata.h"
+
+typedef enum {
+  PRODUCT_AND,  // accepts what both automata accept
+  PRODUCT_DIFF, // accepts what the first accepts and the second does not
+  PRODUCT_OR,   // accepts what either automaton accepts
+} product_op;
+
+typedef struct {
+  state_id_t a;
+  state_id_t b;
+} state_pair;
+
+// product of `A` and `B`, restricted to the pairs of states reachable from
+// the pair of start states. like every construction below, returns NULL if
+// the result would exceed MAX_NFA_SIZE states.
+dfa *dfa_product(dfa *A, dfa *B, product_op op);
+// also stores in `pairs`, a vector of state_pair, the states of `A` and `B`
+// that every product state stands for, from state 1 on. 0 is the error
+// state of either automaton.
+dfa *dfa_product_pairs(dfa *A, dfa *B, product_op op, vector *pairs);
+
+// accepts every string `A` rejects, over the bytes 1 to 255.
+dfa *dfa_complement(dfa *A);
+
+// the minimal DFA of `a`. intersections, differences and complements are
+// built from the minimal DFAs of their operands.
+dfa *ast_to_dfa(const ast *a);
+
+#endif // PRODUCT_H_
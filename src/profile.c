@@ -0,0 +1,112 @@
+#define _POSIX_C_SOURCE 200809L
+#include "profile.h"
+#include <inttypes.h>
+
+// a line of the profile file.
+typedef struct {
+  char *rule;
+  uint64_t fingerprint;
+  state_id_t state;
+  unsigned long visits;
+  vector taken; // of unsigned long
+} row;
+
+uint64_t dfa_fingerprint(const dfa *D) {
+  uint64_t h = HASH_INIT;
+#define MIX(x) (h = hash_mix(h, (x)))
+  MIX(D->n_states);
+  for (state_id_t id = 1; id < D->n_states; id++)
+    MIX(set_has((bit_set *)&D->accepting_states, id));
+  ITER(line, l, &D->t_matrix) {
+    MIX(l->id);
+    ITER(path, p, &l->paths) {
+      MIX(p->first);
+      MIX(p->last);
+      MIX(p->end_state);
+    }
+  }
+#undef MIX
+  return hash_finish(h);
+}
+
+void path_offsets(const dfa *D, size_t *first) {
+  memset(first, 0, (D->n_states + 1) * sizeof(size_t));
+  ITER(line, l, &D->t_matrix) { first[l->id + 1] = l->paths.size; }
+  for (state_id_t id = 1; id <= D->n_states; id++)
+    first[id] += first[id - 1];
+}
+
+int profile_load(profile_set *set, const char *file) {
+  set->rows = VEC(row, NULL);
+  FILE *f = fopen(file, "r");
+  if (!f)
+    return 1;
+
+  char *text = NULL;
+  size_t cap = 0;
+  while (getline(&text, &cap, f) != -1) {
+    char rule[256];
+    unsigned state;
+    int n;
+    row r = {0};
+    if (sscanf(text, "%255s %" SCNx64 " %u %lu%n", rule, &r.fingerprint,
+               &state, &r.visits, &n) != 4 ||
+        state == 0 || state >= MAX_NFA_SIZE)
+      continue;
+    r.state = state;
+    r.taken = VEC(unsigned long, NULL);
+    unsigned long count;
+    for (int m; sscanf(text + n, "%lu%n", &count, &m) == 1; n += m)
+      vec_insert(&r.taken, &count);
+    r.rule = strdup(rule);
+    vec_insert(&set->rows, &r);
+  }
+  free(text);
+  fclose(f);
+  return 0;
+}
+
+void profile_set_free(profile_set *set) {
+  ITER(row, r, &set->rows) {
+    free(r->rule);
+    destroy(&r->taken);
+  }
+  destroy(&set->rows);
+}
+
+dfa_profile *profile_find(const profile_set *set, const char *name,
+                          const dfa *D) {
+  uint64_t fingerprint = dfa_fingerprint(D);
+  dfa_profile *p = NULL;
+  ITER(row, r, &set->rows) {
+    if (r->fingerprint != fingerprint || strcmp(r->rule, name) ||
+        r->state >= D->n_states)
+      continue;
+    if (!p) {
+      p = calloc(sizeof(dfa_profile), 1);
+      p->n_states = D->n_states;
+      p->first_path = malloc((D->n_states + 1) * sizeof(size_t));
+      path_offsets(D, p->first_path);
+      p->visits = calloc(D->n_states, sizeof(unsigned long));
+      p->taken = calloc(p->first_path[D->n_states] + 1, sizeof(unsigned long));
+    }
+    size_t first = p->first_path[r->state];
+    size_t n_paths = p->first_path[r->state + 1] - first;
+    if (r->taken.size != n_paths)
+      continue;
+    p->visits[r->state] += r->visits;
+    unsigned long *taken = r->taken.ptr;
+    for (size_t i = 0; i < n_paths; i++)
+      p->taken[first + i] += taken[i];
+  }
+  return p;
+}
+
+void delete_profile(dfa_profile *p) {
+  if (!p)
+    return;
+  free(p->visits);
+  free(p->taken);
+  free(p->first_path);
+  free(p);
+}
@@ -0,0 +1,42 @@
+#ifndef PROFILE_H_
+#define PROFILE_H_
+#include "automata.h"
+
+// the counts collected by scanners built with `--profile-generate`. each
+// run appends one line per visited state to the profile file:
+//
+//   <rule> <fingerprint> <state> <visits> <taken>...
+//
+// where `taken` holds, for every path of the state in the order of its
+// line, how many times it was followed. the lines of several runs add up.
+// the fingerprint identifies the DFA the counts belong to, so that the
+// counts of an older version of a rule are ignored.
+
+typedef struct {
+  state_id_t n_states;
+  unsigned long *visits; // by state id
+  unsigned long *taken;  // by path, line after line of `t_matrix`
+  size_t *first_path;    // of each state in `taken`, n_states + 1 entries
+} dfa_profile;
+
+// the profiles read from a file, by rule.
+typedef struct {
+  vector rows;
+} profile_set;
+
+uint64_t dfa_fingerprint(const dfa *D);
+
+// the index of every path of `D` in `taken`: the paths of state `id` are
+// [first[id], first[id + 1]). `first` has n_states + 1 entries.
+void path_offsets(const dfa *D, size_t *first);
+
+// returns 1 if the file can not be read. malformed lines are skipped.
+int profile_load(profile_set *set, const char *file);
+void profile_set_free(profile_set *set);
+
+// the counts of the rule `name` for `D`, NULL if the profile has none.
+dfa_profile *profile_find(const profile_set *set, const char *name,
+                          const dfa *D);
+void delete_profile(dfa_profile *p);
+
+#endif // PROFILE_H_
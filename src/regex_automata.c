@@ -0,0 +1,232 @@
+#include "regex_automata.h"
+#include "automata.h"
+#include "simplify.h"
+#include "thompson.h"
+#include "trie.h"
+
+// a DFA flattened for matching: the successor of `s` on `c` is
+// `next[s * 256 + c]`, 0 being the error state.
+typedef struct {
+  state_id_t n_states;
+  state_id_t *next;
+  unsigned char *accepting;
+} table;
+
+struct ra_regex {
+  table anchored;
+  table reversed; // of `[\x01-\xff]*` and the reversed regex, no states
+                  // unless compiled with RA_SEARCH
+  ra_stats stats;
+};
+
+static table flatten(dfa *D) {
+  table t = {.n_states = D->n_states};
+  t.next = calloc((size_t)D->n_states * 256, sizeof(state_id_t));
+  t.accepting = calloc(D->n_states, 1);
+  ITER(line, l, &D->t_matrix) {
+    ITER(path, p, &l->paths) {
+      for (unsigned c = p->first; c <= p->last; c++)
+        t.next[l->id * 256 + c] = p->end_state;
+    }
+  }
+  for (state_id_t id = 1; id < D->n_states; id++)
+    t.accepting[id] = set_has(&D->accepting_states, id);
+  return t;
+}
+
+// the minimal DFA of `a`, which is consumed.
+static ra_status build(ast *a, ra_stats *stats, dfa **out) {
+  dfa *minimal;
+  vector literals = LIT_VEC();
+  if (ast_literals(a, &literals)) {
+    ast_free(a);
+    minimal = literals_to_dfa(&literals);
+    delete_literals(&literals);
+    if (!minimal)
+      return RA_ERR_TOO_LARGE;
+    stats->dfa_states = minimal->n_states - 1;
+  } else {
+    delete_literals(&literals);
+    a = simplify(a);
+    // the library has no counters: its repetitions are all unrolled.
+    ra_status too_large =
+        ast_has_counted(a) ? RA_ERR_COUNTED : RA_ERR_TOO_LARGE;
+    nfa N = ast_to_nfa(a);
+    ast_free(a);
+    stats->nfa_states = nfa_size(&N);
+    dfa *naive = N.start_id ? to_dfa(&N) : NULL;
+    delete_nfa(&N);
+    if (!naive)
+      return too_large;
+    stats->dfa_states = naive->n_states - 1;
+    minimal = minimize(naive);
+    delete_dfa(naive);
+    free(naive);
+  }
+
+  stats->minimal_states = minimal->n_states - 1;
+  ITER(line, l, &minimal->t_matrix) { stats->transitions += l->paths.size; }
+  *out = minimal;
+  return RA_OK;
+}
+
+static ra_status fail(ra_status status, ra_error *err) {
+  if (err)
+    *err = (ra_error){.message = ra_strerror(status)};
+  return status;
+}
+
+static ra_status compile(const char *regex, size_t regex_len, unsigned flags,
+                         ra_regex **out, ra_error *err) {
+  parse_error perr;
+  ast *tree = parse_regex(regex, regex_len, &perr);
+  if (!tree) {
+    if (err)
+      *err = (ra_error){.message = perr.message, .offset = perr.offset};
+    return RA_ERR_SYNTAX;
+  }
+
+  // read backwards, the prefixed reversed regex accepts where a match starts.
+  ast *prefixed = NULL;
+  if (flags & RA_SEARCH) {
+    byte_set any = {0};
+    for (unsigned c = 1; c < 256; c++)
+      byte_set_insert(&any, c);
+    prefixed = ast_new(AST_CONCAT);
+    ast_append(prefixed, ast_new_unary(AST_STAR, ast_new_set(&any)));
+    ast_append(prefixed, ast_reverse(tree));
+  }
+
+  ra_regex *re = calloc(sizeof(ra_regex), 1);
+  dfa *D;
+  ra_status status = build(tree, &re->stats, &D);
+  if (status != RA_OK) {
+    ast_free(prefixed);
+    free(re);
+    return fail(status, err);
+  }
+  re->anchored = flatten(D);
+  delete_dfa(D);
+  free(D);
+
+  if (prefixed) {
+    ra_stats search_stats = {0};
+    status = build(prefixed, &search_stats, &D);
+    if (status != RA_OK) {
+      ra_free(re);
+      return fail(status, err);
+    }
+    re->reversed = flatten(D);
+    delete_dfa(D);
+    free(D);
+  }
+
+  if (err)
+    *err = (ra_error){0};
+  *out = re;
+  return RA_OK;
+}
+
+ra_status ra_compile(const char *regex, size_t regex_len, unsigned flags,
+                     ra_regex **out, ra_error *err) {
+  *out = NULL;
+  // the automata are built in an arena, only the tables are kept.
+  arena *outer = arena_swap(arena_new());
+  ra_status status = compile(regex, regex_len, flags, out, err);
+  arena_delete(arena_swap(outer));
+  return status;
+}
+
+void ra_free(ra_regex *re) {
+  if (!re)
+    return;
+  free(re->anchored.next);
+  free(re->anchored.accepting);
+  free(re->reversed.next);
+  free(re->reversed.accepting);
+  free(re);
+}
+
+const char *ra_strerror(ra_status status) {
+  switch (status) {
+  case RA_OK:
+    return "success";
+  case RA_ERR_SYNTAX:
+    return "malformed regex";
+  case RA_ERR_TOO_LARGE:
+    return "the automaton exceeds the state limit";
+  case RA_ERR_IO:
+    return "the file could not be read";
+  case RA_ERR_FORMAT:
+    return "the file is not a valid binary DFA";
+  case RA_ERR_COUNTED:
+    return "counted repetition not supported in this mode";
+  }
+  return "unknown error";
+}
+
+ra_stats ra_get_stats(const ra_regex *re) { return re->stats; }
+
+static int longest(const table *t, const unsigned char *s, size_t len,
+                   size_t *match_len) {
+  state_id_t state = 1;
+  int found = t->accepting[state];
+  size_t last = 0;
+  for (size_t i = 0; i < len; i++) {
+    state = t->next[state * 256 + s[i]];
+    if (!state)
+      break;
+    if (t->accepting[state]) {
+      found = 1;
+      last = i + 1;
+    }
+  }
+  if (found)
+    *match_len = last;
+  return found;
+}
+
+int ra_match(const ra_regex *re, const char *buf, size_t len,
+             size_t *match_len) {
+  return longest(&re->anchored, (const unsigned char *)buf, len, match_len);
+}
+
+int ra_search(const ra_regex *re, const char *buf, size_t len, size_t *start,
+              size_t *end) {
+  const unsigned char *s = (const unsigned char *)buf;
+  size_t n;
+
+  const table *t = &re->reversed;
+  if (!t->n_states) {
+    for (size_t i = 0; i <= len; i++) {
+      if (longest(&re->anchored, s + i, len - i, &n)) {
+        *start = i;
+        *end = i + n;
+        return 1;
+      }
+    }
+    return 0;
+  }
+
+  // a single pass from the end finds every offset where a match starts, the
+  // last one found is the leftmost.
+  state_id_t state = 1;
+  int found = t->accepting[state];
+  size_t first = len;
+  for (size_t i = len; i-- > 0;) {
+    // only a NUL byte leads to the error state, matches restart before it.
+    state = t->next[state * 256 + s[i]];
+    if (!state)
+      state = 1;
+    if (t->accepting[state]) {
+      found = 1;
+      first = i;
+    }
+  }
+  // a match starts at `first`, so the anchored DFA finds one there.
+  if (!found || !longest(&re->anchored, s + first, len - first, &n))
+    return 0;
+  *start = first;
+  *end = first + n;
+  return 1;
+}
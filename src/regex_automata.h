@@ -0,0 +1,134 @@
+#ifndef REGEX_AUTOMATA_H_
+#define REGEX_AUTOMATA_H_
+#include <stddef.h>
+
+// the public interface of libregex_automata. a compiled regex is immutable,
+// so one handle can be matched from any number of threads, and separate
+// handles can be compiled concurrently: the library keeps no global state.
+
+#ifndef RA_API
+#define RA_API __attribute__((visibility("default")))
+#endif
+
+typedef enum {
+  RA_OK = 0,
+  RA_ERR_SYNTAX,    // the regex is malformed
+  RA_ERR_TOO_LARGE, // some automaton exceeds the state limit
+  RA_ERR_IO,        // a file could not be read
+  RA_ERR_FORMAT,    // a binary file is corrupt, or from another version
+  RA_ERR_COUNTED,   // a long counted repetition exceeds the state limit once
+                    // unrolled: only the generated scanners count them
+} ra_status;
+
+enum {
+  // also build the DFA of `[\x01-\xff]*` followed by the reversed regex,
+  // which makes `ra_search` linear in the length of the text. without it
+  // `ra_search` tries every offset in turn.
+  RA_SEARCH = 1 << 0,
+};
+
+typedef struct {
+  const char *message; // static string, NULL on success
+  size_t offset;       // in the regex, for syntax errors
+} ra_error;
+
+typedef struct {
+  size_t nfa_states;     // 0 if the regex did not need an NFA
+  size_t dfa_states;     // before minimization
+  size_t minimal_states; // without the error state
+  size_t transitions;    // byte ranges in the minimal DFA
+} ra_stats;
+
+typedef struct ra_regex ra_regex;
+
+// compiles the first `regex_len` bytes of `regex`. on success `*out` must be
+// released with `ra_free`, on failure it is set to NULL and `err`, if not
+// NULL, describes the problem.
+RA_API ra_status ra_compile(const char *regex, size_t regex_len,
+                            unsigned flags, ra_regex **out, ra_error *err);
+RA_API void ra_free(ra_regex *re);
+RA_API const char *ra_strerror(ra_status status);
+RA_API ra_stats ra_get_stats(const ra_regex *re);
+
+// longest match anchored at the start of `buf`. returns 1, and the length
+// in `*match_len`, if there is one. a NUL byte is never matched.
+RA_API int ra_match(const ra_regex *re, const char *buf, size_t len,
+                    size_t *match_len);
+
+// leftmost-longest match anywhere in `buf`. returns 1, and its bounds in
+// `[*start, *end)`, if there is one.
+RA_API int ra_search(const ra_regex *re, const char *buf, size_t len,
+                     size_t *start, size_t *end);
+
+// a file of DFAs written by `bin/dfa --emit-binary`, matched in place. the
+// layout is described in dfa_binary.h.
+typedef struct {
+  const unsigned char *base;
+  size_t size;
+  int mapped; // whether `ra_binary_close` unmaps it
+} ra_binary;
+
+// maps the file in memory and checks it, so that matching needs no further
+// checks. `ra_binary_view` checks a file already in memory, which must be
+// 8 byte aligned and outlive `out`.
+RA_API ra_status ra_binary_open(const char *file_name, ra_binary *out);
+RA_API ra_status ra_binary_view(const void *data, size_t size,
+                                ra_binary *out);
+RA_API void ra_binary_close(ra_binary *b);
+
+// the automata are in the order of the rules they come from.
+RA_API size_t ra_binary_count(const ra_binary *b);
+RA_API const char *ra_binary_name(const ra_binary *b, size_t index);
+// the index of the automaton called `name`, or -1.
+RA_API long ra_binary_find(const ra_binary *b, const char *name);
+
+// like `ra_match` for the automaton at `index`. automata compiled with `-s`
+// stop at the end of the earliest match instead, like `search_<name>`.
+RA_API int ra_binary_match(const ra_binary *b, size_t index, const char *buf,
+                           size_t len, size_t *match_len);
+
+// a lexer keeps the tokens of a buffer, as found by the `next_token_<name>`
+// function that `bin/dfa --tokenize NAME` generates, and after an edit only
+// scans the buffer again from the first token the edit may change, until
+// the new tokens fall in step with the old ones. every token starts from the
+// start state of the DFA, so the scan is back in step once a new token
+// starts where an old one started after the edit. the work grows with the
+// edit and the tokens around it, not with the buffer.
+typedef unsigned long (*ra_scanner)(const char *buf, unsigned long len,
+                                    unsigned long *start, unsigned *rule,
+                                    unsigned long *read);
+
+typedef struct {
+  size_t offset;
+  size_t length;
+  unsigned rule;
+} ra_token;
+
+// the tokens [first, first + removed) of an edited buffer were replaced by
+// the tokens [first, first + inserted).
+typedef struct {
+  size_t first;
+  size_t removed;
+  size_t inserted;
+  size_t scanned; // bytes examined again
+  size_t visited; // tokens looked at to find the first one
+} ra_relex_result;
+
+typedef struct ra_lexer ra_lexer;
+
+RA_API ra_lexer *ra_lexer_new(ra_scanner scan);
+RA_API void ra_lexer_free(ra_lexer *L);
+
+// scans the whole of `buf`.
+RA_API void ra_lex(ra_lexer *L, const char *buf, size_t len);
+// `buf` is the buffer scanned last, where the `removed` bytes at `at` were
+// replaced by `inserted` bytes.
+RA_API ra_relex_result ra_relex(ra_lexer *L, const char *buf, size_t at,
+                                size_t removed, size_t inserted);
+
+RA_API size_t ra_lexer_count(const ra_lexer *L);
+RA_API ra_token ra_lexer_token(const ra_lexer *L, size_t index);
+// where the tokens stop: the end of the buffer, or a byte that starts none.
+RA_API size_t ra_lexer_end(const ra_lexer *L);
+
+#endif // REGEX_AUTOMATA_H_
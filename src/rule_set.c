@@ -0,0 +1,250 @@
+#include "rule_set.h"
+#include "product.h"
+
+static rule_set *rule_set_alloc(state_id_t n_states) {
+  rule_set *S = calloc(sizeof(rule_set), 1);
+  S->D = calloc(sizeof(dfa), 1);
+  S->D->n_states = n_states;
+  S->D->t_matrix = L_VEC();
+  S->accepts = VEC(bit_set, NULL);
+  return S;
+}
+
+rule_set *rule_set_new(void) {
+  rule_set *S = rule_set_alloc(2);
+  bit_set none = {0};
+  vec_insert(&S->accepts, &none);
+  vec_insert(&S->accepts, &none);
+  return S;
+}
+
+void delete_rule_set(rule_set *S) {
+  delete_dfa(S->D);
+  free(S->D);
+  destroy(&S->accepts);
+  free(S);
+}
+
+// the rule set of `D` renumbered breadth first from `start`, where `label`
+// holds the slots accepting in each state of `D`.
+static rule_set *canonical(dfa *D, state_id_t start, const bit_set *label) {
+  state_id_t *order = malloc(D->n_states * sizeof(state_id_t));
+  state_id_t *new_id = calloc(D->n_states, sizeof(state_id_t));
+  state_id_t size = 1;
+  order[size] = start;
+  new_id[start] = size++;
+  for (state_id_t head = 1; head < size; head++) {
+    line *l = find_line(&D->t_matrix, order[head]);
+    if (!l)
+      continue;
+    ITER(path, p, &l->paths) {
+      if (!new_id[p->end_state]) {
+        new_id[p->end_state] = size;
+        order[size++] = p->end_state;
+      }
+    }
+  }
+
+  rule_set *S = rule_set_alloc(size);
+  bit_set none = {0};
+  vec_insert(&S->accepts, &none);
+  for (state_id_t id = 1; id < size; id++) {
+    vec_insert(&S->accepts, &label[order[id]]);
+    if (!empty(&label[order[id]]))
+      set_insert(&S->D->accepting_states, id);
+    line *l = find_line(&D->t_matrix, order[id]);
+    if (!l)
+      continue;
+    ITER(path, p, &l->paths) {
+      transition_matrix_insert(&S->D->t_matrix, id, p->first, p->last,
+                               new_id[p->end_state]);
+    }
+  }
+  free(order);
+  free(new_id);
+  return S;
+}
+
+// appends to `T` one block for each set of slots of the `states`, and marks
+// the new blocks dirty. each of the `others` joins the block of its set of
+// slots if there is one, and is a block of its own otherwise: it must already
+// differ from the rest of them.
+static void blocks_by_label(const bit_set *label, state_id_t n_states,
+                            const bit_set *states, const bit_set *others,
+                            vector *T, bit_set *dirty) {
+  // open addressing on the hash of the slots, from which blocks of `T`.
+  size_t cap = 2;
+  while (cap < 2 * (size_t)n_states)
+    cap *= 2;
+  size_t *slots = malloc(cap * sizeof(size_t));
+  for (size_t i = 0; i < cap; i++)
+    slots[i] = SIZE_MAX;
+  const bit_set *sets[] = {states, others};
+  for (int k = 0; k < 2; k++) {
+    ITERATE_BITSET(id, *sets[k]) {
+      size_t i = hash_bytes(&label[id], sizeof(bit_set)) & (cap - 1);
+      for (; slots[i] != SIZE_MAX; i = (i + 1) & (cap - 1)) {
+        state_id_t member = set_peek(elem_at(T, slots[i]));
+        if (!memcmp(&label[member], &label[id], sizeof(bit_set)))
+          break;
+      }
+      size_t b = slots[i];
+      if (b == SIZE_MAX) {
+        bit_set block = {0};
+        b = T->size;
+        vec_insert(T, &block);
+        // the others are never looked up: their blocks keep to themselves.
+        if (!k) {
+          slots[i] = b;
+          set_insert(dirty, b);
+        }
+      }
+      set_insert(elem_at(T, b), id);
+    }
+  }
+  free(slots);
+}
+
+// minimizes `D` from the blocks `T`, and frees it.
+static rule_set *minimized(dfa *D, vector *T, bit_set dirty,
+                           const bit_set *label) {
+  state_id_t *map = malloc(D->n_states * sizeof(state_id_t));
+  dfa *M = minimize_blocks(D, T, dirty, map);
+  bit_set *minimal_label = calloc(M->n_states, sizeof(bit_set));
+  for (state_id_t id = 1; id < D->n_states; id++)
+    if (map[id])
+      minimal_label[map[id]] = label[id];
+  // the start state keeps its block, which may not be the first one.
+  rule_set *S = canonical(M, map[1], minimal_label);
+
+  free(minimal_label);
+  free(map);
+  delete_dfa(M);
+  free(M);
+  delete_dfa(D);
+  free(D);
+  return S;
+}
+
+rule_set *rule_set_add(const rule_set *S, dfa *rule, unsigned slot) {
+  const bit_set *accepts = S->accepts.ptr;
+  if (empty(&rule->accepting_states))
+    return canonical(S->D, 1, accepts);
+
+  vector pairs = VEC(state_pair, NULL);
+  dfa *P = dfa_product_pairs(S->D, rule, PRODUCT_OR, &pairs);
+  if (!P) {
+    destroy(&pairs);
+    return NULL;
+  }
+
+  // every state of a minimal DFA but the error state can still reach a match
+  // of the rule, which no state of the set can. so the pairs where the rule
+  // has failed are copies of states of the set, different from each other
+  // and from the rest, and each is a block of its own that can not split:
+  // only the pairs where the rule is alive are minimized.
+  bit_set *label = calloc(P->n_states, sizeof(bit_set));
+  bit_set alive = {0};
+  vector T = VEC(bit_set, NULL);
+  const state_pair *pair = pairs.ptr;
+  for (state_id_t id = 1; id < P->n_states; id++) {
+    state_pair q = pair[id - 1];
+    label[id] = accepts[q.a];
+    if (!q.b) {
+      bit_set block = {0};
+      set_insert(&block, id);
+      vec_insert(&T, &block);
+      continue;
+    }
+    if (set_has(&rule->accepting_states, q.b))
+      set_insert(&label[id], slot);
+    set_insert(&alive, id);
+  }
+  bit_set dirty = {0}, none = {0};
+  blocks_by_label(label, P->n_states, &alive, &none, &T, &dirty);
+
+  rule_set *result = minimized(P, &T, dirty, label);
+  free(label);
+  destroy(&pairs);
+  return result;
+}
+
+rule_set *rule_set_remove(const rule_set *S, unsigned slot) {
+  dfa *D = copy_dfa(S->D);
+  state_id_t n = D->n_states;
+  bit_set *label = malloc(n * sizeof(bit_set));
+  memcpy(label, S->accepts.ptr, n * sizeof(bit_set));
+  bit_set affected = {0};
+  for (state_id_t id = 1; id < n; id++) {
+    if (!set_has(&label[id], slot))
+      continue;
+    set_insert(&affected, id);
+    set_remove(&label[id], slot);
+    if (empty(&label[id]))
+      set_remove(&D->accepting_states, id);
+  }
+
+  // the states with a transition to each state: pred[first[id]..first[id+1]).
+  size_t *first = calloc(n + 1, sizeof(size_t));
+  ITER(line, l, &D->t_matrix) {
+    ITER(path, p, &l->paths) { first[p->end_state + 1]++; }
+  }
+  for (state_id_t id = 1; id <= n; id++)
+    first[id] += first[id - 1];
+  state_id_t *pred = malloc((first[n] + 1) * sizeof(state_id_t));
+  size_t *fill = malloc(n * sizeof(size_t));
+  memcpy(fill, first, n * sizeof(size_t));
+  ITER(line, l, &D->t_matrix) {
+    ITER(path, p, &l->paths) { pred[fill[p->end_state]++] = l->id; }
+  }
+  free(fill);
+
+  // only the states that reach a match of the rule see their future change.
+  // the others were told apart from each other by the minimal set, and still
+  // are, so they need no splitting: they can only merge with affected ones.
+  bit_set todo = affected;
+  for (state_id_t id; (id = set_pop(&todo));) {
+    for (size_t k = first[id]; k < first[id + 1]; k++) {
+      if (pred[k] && !set_has(&affected, pred[k])) {
+        set_insert(&affected, pred[k]);
+        set_insert(&todo, pred[k]);
+      }
+    }
+  }
+
+  // the states that only led to matches of the rule lead nowhere now. their
+  // transitions are dropped, so that they are not told apart from the error
+  // state.
+  bit_set live = D->accepting_states;
+  todo = live;
+  for (state_id_t id; (id = set_pop(&todo));) {
+    for (size_t k = first[id]; k < first[id + 1]; k++) {
+      if (pred[k] && !set_has(&live, pred[k])) {
+        set_insert(&live, pred[k]);
+        set_insert(&todo, pred[k]);
+      }
+    }
+  }
+  free(first);
+  free(pred);
+  ITER(line, l, &D->t_matrix) {
+    if (!set_has(&affected, l->id))
+      continue;
+    path *paths = l->paths.ptr;
+    size_t kept = 0;
+    for (size_t i = 0; i < l->paths.size; i++)
+      if (set_has(&live, paths[i].end_state))
+        paths[kept++] = paths[i];
+    l->paths.size = kept;
+  }
+
+  vector T = VEC(bit_set, NULL);
+  bit_set states = set_iota(1, n);
+  bit_set others = set_complement(&states, &affected);
+  bit_set dirty = {0};
+  blocks_by_label(label, n, &affected, &others, &T, &dirty);
+
+  rule_set *result = minimized(D, &T, dirty, label);
+  free(label);
+  return result;
+}
@@ -0,0 +1,34 @@
+#ifndef RULE_SET_H_
+#define RULE_SET_H_
+#include "automata.h"
+
+// the minimal DFA of a set of rules, which matches what any of them matches
+// and knows which rules accept in each of its states, so that rules can be
+// added and removed without determinizing the others again. rules are
+// identified by a slot, below MAX_NFA_SIZE.
+//
+// states are numbered breadth first from the start state, taking the bytes
+// in order, so the sets of the same rules are equal however they were built.
+
+typedef struct {
+  dfa *D;         // accepting where some rule accepts
+  vector accepts; // of bit_set, by state id: the slots of the rules accepting
+} rule_set;
+
+// the set without rules, whose DFA only has a start state.
+rule_set *rule_set_new(void);
+
+// adds the minimal DFA of a rule in the free `slot`. only the pairs of states
+// of the product with the rule are built, and only the ones where the rule
+// has not failed yet are minimized: the others are a copy of the set. NULL
+// if the result would exceed MAX_NFA_SIZE states.
+rule_set *rule_set_add(const rule_set *S, dfa *rule, unsigned slot);
+
+// drops the rule in `slot`. the DFA is minimized again from the rules that
+// still accept in each state, without being determinized: only the states
+// that could reach a match of the rule are split again.
+rule_set *rule_set_remove(const rule_set *S, unsigned slot);
+
+void delete_rule_set(rule_set *S);
+
+#endif // RULE_SET_H_
@@ -1,39 +1,963 @@
-#include "automata.h"
+#include "scanner_generator.h"
 #include "thompson.h"
 #include "util.h"
 
-void scanner_from_dfa(dfa *D, const char *scanner_name, FILE *stream) {
-  fprintf(stream, "unsigned long scan_%s (const char *s) {\n", scanner_name);
+// ranges of bytes compile to a single comparison (a GNU C extension).
+// `counter` is the profile counter of the path, if it has one.
+static void emit_case(const path *p, const char *counter, size_t index,
+                      FILE *stream) {
+  if (p->first == p->last)
+    fprintf(stream, "    case %u: ", p->first);
+  else
+    fprintf(stream, "    case %u ... %u: ", p->first, p->last);
+  if (counter)
+    fprintf(stream, "%s[%zu]++; ", counter, index);
+  fprintf(stream, "goto s_%u;\n", p->end_state);
+}
+
+typedef enum { SCANNER, SEARCHER } code_kind;
+
+static void emit_string(const char *s, FILE *stream) {
+  fputc('"', stream);
+  for (; *s; s++) {
+    if (*s == '"' || *s == '\\')
+      fputc('\\', stream);
+    fputc(*s, stream);
+  }
+  fputc('"', stream);
+}
+
+// the counters of an instrumented scanner: the visits of state `id` at
+// `id`, the times path `k` of the DFA was taken at `n_states + k`. they are
+// appended to the profile when the program exits.
+static void emit_profile_writer(dfa *D, const char *name, const size_t *first,
+                                const char *file, FILE *stream) {
+  fprintf(stream, "#include <stdio.h>\n#include <stdlib.h>\n\n");
+  fprintf(stream, "static unsigned long profile_%s[%zu];\n", name,
+          D->n_states + first[D->n_states]);
+  fprintf(stream, "static const unsigned short profile_paths_%s[%u] = {",
+          name, D->n_states);
+  for (state_id_t id = 0; id < D->n_states; id++)
+    fprintf(stream, "%s%zu", id ? ", " : "", first[id + 1] - first[id]);
+  fprintf(stream, "};\n");
+
+  fprintf(stream,
+          "__attribute__((destructor)) static void write_profile_%s(void) {\n"
+          "  const char *file = getenv(\"DFA_PROFILE\");\n"
+          "  FILE *f = fopen(file ? file : ",
+          name);
+  emit_string(file, stream);
+  fprintf(stream,
+          ", \"a\");\n"
+          "  if (!f)\n"
+          "    return;\n"
+          "  const unsigned long *taken = profile_%s + %u;\n"
+          "  for (unsigned s = 1; s < %u; taken += profile_paths_%s[s++]) {\n"
+          "    if (!profile_%s[s])\n"
+          "      continue;\n"
+          "    fprintf(f, \"%s %016llx %%u %%lu\", s, profile_%s[s]);\n"
+          "    for (unsigned p = 0; p < profile_paths_%s[s]; p++)\n"
+          "      fprintf(f, \" %%lu\", taken[p]);\n"
+          "    fputc('\\n', f);\n"
+          "  }\n"
+          "  fclose(f);\n"
+          "}\n\n",
+          name, D->n_states, D->n_states, name, name, name,
+          (unsigned long long)dfa_fingerprint(D), name, name);
+}
+
+typedef struct {
+  unsigned long visits;
+  state_id_t id;
+} heat;
+
+static int heat_cmp(const void *a, const void *b) {
+  const heat *aa = a, *bb = b;
+  if (aa->visits != bb->visits)
+    return aa->visits < bb->visits ? 1 : -1;
+  return aa->id - bb->id;
+}
+
+// the order in which the states are emitted: the order of the ids, or with
+// a profile, chains that follow the hottest transition out of each state,
+// so that it usually falls through to the next label. a chain that ends
+// continues from the hottest state left, and the states that were never
+// visited go last, out of the way of the others.
+static state_id_t *layout(dfa *D, const dfa_profile *p) {
+  state_id_t *order = malloc(D->n_states * sizeof(state_id_t));
+  size_t n = 0;
+  if (!p) {
+    for (state_id_t id = 1; id < D->n_states; id++)
+      order[n++] = id;
+    return order;
+  }
+
+  unsigned char *placed = calloc(D->n_states, 1);
+  heat *by_heat = malloc(D->n_states * sizeof(heat));
+  for (state_id_t id = 1; id < D->n_states; id++)
+    by_heat[id - 1] = (heat){p->visits[id], id};
+  qsort(by_heat, D->n_states - 1, sizeof(heat), heat_cmp);
+
+  size_t hottest_left = 0;
+  for (state_id_t s = 1; s;) {
+    placed[s] = 1;
+    order[n++] = s;
+
+    state_id_t next = 0;
+    unsigned long best = 0;
+    line *l = find_line(&D->t_matrix, s);
+    if (l) {
+      ITER(path, q, &l->paths) {
+        unsigned long taken = p->taken[p->first_path[s] + index_of(&l->paths, q)];
+        if (taken > best && !placed[q->end_state]) {
+          best = taken;
+          next = q->end_state;
+        }
+      }
+    }
+    for (; !next && hottest_left < D->n_states - 1U; hottest_left++) {
+      const heat *h = &by_heat[hottest_left];
+      if (!h->visits)
+        break;
+      if (!placed[h->id])
+        next = h->id;
+    }
+    s = next;
+  }
+  for (state_id_t id = 1; id < D->n_states; id++)
+    if (!placed[id])
+      order[n++] = id;
+
+  free(by_heat);
+  free(placed);
+  return order;
+}
+
+// a path and the times it was taken.
+typedef struct {
+  const path *p;
+  size_t index; // in the profile
+  unsigned long taken;
+} hot_path;
+
+static int hot_path_cmp(const void *a, const void *b) {
+  const hot_path *aa = a, *bb = b;
+  if (aa->taken != bb->taken)
+    return aa->taken < bb->taken ? 1 : -1;
+  return aa->p->first - bb->p->first;
+}
+
+// the code of state `id`. with a profile, its paths are tested hottest
+// first, and the ones taken on most visits are peeled out of the switch
+// into a test of their own.
+static void emit_state(dfa *D, state_id_t id, code_kind kind,
+                       const char *counter, const size_t *first,
+                       const dfa_profile *use, FILE *stream) {
+  const char *miss = kind == SCANNER ? "goto s_out;" : "return 0;";
+  fprintf(stream, "s_%u:\n", id);
+  if (counter)
+    fprintf(stream, "  %s[%u]++;\n", counter, id);
+
+  if (set_has(&D->accepting_states, id)) {
+    // the first accepting state reached ends the earliest match.
+    if (kind == SEARCHER) {
+      fprintf(stream, "  return count;\n");
+      return;
+    }
+    fprintf(stream, "  last_accepting = count;\n");
+  }
+  fprintf(stream, "  c = s[count++];\n");
+
+  line *l = find_line(&D->t_matrix, id);
+  if (!l) {
+    fprintf(stream, "  %s\n", miss);
+    return;
+  }
+
+  size_t n = l->paths.size;
+  hot_path *paths = malloc(n * sizeof(hot_path));
+  for (size_t i = 0; i < n; i++) {
+    size_t index = first[id] + i;
+    paths[i] = (hot_path){elem_at(&l->paths, i), index,
+                          use ? use->taken[index] : 0};
+  }
+  size_t peeled = 0;
+  if (use) {
+    qsort(paths, n, sizeof(hot_path), hot_path_cmp);
+    for (unsigned long left = use->visits[id];
+         peeled < 2 && peeled < n && paths[peeled].taken &&
+         2 * paths[peeled].taken >= left;
+         left -= paths[peeled++].taken) {
+      const path *p = paths[peeled].p;
+      if (p->first == p->last)
+        fprintf(stream, "  if (__builtin_expect(c == %u, 1)) {", p->first);
+      else
+        fprintf(stream, "  if (__builtin_expect(c >= %u && c <= %u, 1)) {",
+                p->first, p->last);
+      if (counter)
+        fprintf(stream, " %s[%zu]++;", counter,
+                D->n_states + paths[peeled].index);
+      fprintf(stream, " goto s_%u; }\n", p->end_state);
+    }
+  }
+
+  if (peeled < n) {
+    fprintf(stream, "  switch (c) {\n");
+    for (size_t i = peeled; i < n; i++)
+      emit_case(paths[i].p, counter, D->n_states + paths[i].index, stream);
+    fprintf(stream, "    default: %s\n", miss);
+    fprintf(stream, "  }\n");
+  } else {
+    fprintf(stream, "  %s\n", miss);
+  }
+  free(paths);
+}
+
+// runs of states that only count, like the states of `[0-9]{1,64}`: each
+// goes on to the next one on the same bytes, and all of them have the same
+// other paths and acceptance. a run is emitted as a single state that counts
+// its steps in `repeat`, so that the code does not grow with the bounds of
+// the repetition. shorter runs are not worth it.
+#define MIN_RUN 4
+
+typedef struct {
+  state_id_t *first;  // for each state, the first state of its run, or 0
+  state_id_t *index;  // for each state, its position in its run
+  state_id_t *length; // of the run, at its first state
+  state_id_t *second; // the next state after the first, at the first state
+  state_id_t *exit;   // where the last state of the run goes, at the first
+  size_t n_runs;
+} runs;
+
+// whether `a`, going on to `a_next`, and `b`, going on to `b_next`, have
+// the same paths and acceptance otherwise.
+static int same_step(dfa *D, state_id_t a, state_id_t a_next, state_id_t b,
+                     state_id_t b_next) {
+  if (set_has(&D->accepting_states, a) != set_has(&D->accepting_states, b))
+    return 0;
+  line *la = find_line(&D->t_matrix, a);
+  line *lb = find_line(&D->t_matrix, b);
+  if (!la || !lb || la->paths.size != lb->paths.size)
+    return 0;
+  for (size_t i = 0; i < la->paths.size; i++) {
+    const path *p = elem_at(&la->paths, i), *q = elem_at(&lb->paths, i);
+    if (p->first != q->first || p->last != q->last ||
+        (p->end_state == a_next) != (q->end_state == b_next) ||
+        (p->end_state != a_next && p->end_state != q->end_state))
+      return 0;
+  }
+  return 1;
+}
+
+static runs find_runs(dfa *D) {
+  runs R = {
+      .first = calloc(D->n_states, sizeof(state_id_t)),
+      .index = calloc(D->n_states, sizeof(state_id_t)),
+      .length = calloc(D->n_states, sizeof(state_id_t)),
+      .second = calloc(D->n_states, sizeof(state_id_t)),
+      .exit = calloc(D->n_states, sizeof(state_id_t)),
+  };
+  state_id_t *members = malloc(D->n_states * sizeof(state_id_t));
+  state_id_t *seen = calloc(D->n_states, sizeof(state_id_t));
+  for (state_id_t id = 1; id < D->n_states; id++) {
+    line *l = find_line(&D->t_matrix, id);
+    if (R.first[id] || !l)
+      continue;
+    ITER(path, p, &l->paths) {
+      state_id_t next = p->end_state;
+      if (next == id || R.first[next])
+        continue;
+      size_t n = 0;
+      members[n++] = id;
+      seen[id] = id;
+      state_id_t candidate = next;
+      for (;;) {
+        line *lc = find_line(&D->t_matrix, candidate);
+        path *step = lc ? find_path(lc, p->first) : NULL;
+        state_id_t after = step ? step->end_state : 0;
+        if (!after || R.first[candidate] || seen[candidate] == id ||
+            !same_step(D, id, next, candidate, after))
+          break;
+        members[n++] = candidate;
+        seen[candidate] = id;
+        candidate = after;
+      }
+      if (n < MIN_RUN)
+        continue;
+      for (size_t i = 0; i < n; i++) {
+        R.first[members[i]] = id;
+        R.index[members[i]] = i;
+      }
+      R.length[id] = n;
+      R.second[id] = next;
+      R.exit[id] = candidate;
+      R.n_runs++;
+      break;
+    }
+  }
+  free(members);
+  free(seen);
+  return R;
+}
+
+static void delete_runs(runs *R) {
+  free(R->first);
+  free(R->index);
+  free(R->length);
+  free(R->second);
+  free(R->exit);
+}
+
+// the states of runs that are entered from anywhere but the previous state
+// of the run, the start state and the `n_entries` entries.
+static unsigned char *run_entries(dfa *D, const runs *R,
+                                  const state_id_t *entries,
+                                  size_t n_entries) {
+  unsigned char *entered = calloc(D->n_states, 1);
+  entered[1] = 1;
+  for (size_t i = 0; i < n_entries; i++)
+    entered[entries[i]] = 1;
+  ITER(line, l, &D->t_matrix) {
+    ITER(path, p, &l->paths) {
+      state_id_t to = p->end_state;
+      if (!R->first[l->id] || R->first[to] != R->first[l->id] ||
+          R->index[to] != R->index[l->id] + 1)
+        entered[to] = 1;
+    }
+  }
+  return entered;
+}
+
+// a run, whose states `s_<id>` set the counter and jump to its code at
+// `k_<first>`. `id` is the state of the run emitted first.
+static void emit_run(dfa *D, const runs *R, state_id_t id,
+                     const unsigned char *entered, code_kind kind,
+                     FILE *stream) {
+  state_id_t first = R->first[id];
+  if (entered[id])
+    fprintf(stream, "s_%u: repeat = %u; goto k_%u;\n", id, R->index[id],
+            first);
+  for (state_id_t s = 1; s < D->n_states; s++)
+    if (s != id && R->first[s] == first && entered[s])
+      fprintf(stream, "s_%u: repeat = %u; goto k_%u;\n", s, R->index[s],
+              first);
+
+  fprintf(stream, "k_%u:\n", first);
+  if (set_has(&D->accepting_states, first)) {
+    if (kind == SEARCHER) {
+      fprintf(stream, "  return count;\n");
+      return;
+    }
+    fprintf(stream, "  last_accepting = count;\n");
+  }
+  fprintf(stream, "  c = s[count++];\n"
+                  "  switch (c) {\n");
+  ITER(path, p, &find_line(&D->t_matrix, first)->paths) {
+    if (p->end_state != R->second[first]) {
+      emit_case(p, NULL, 0, stream);
+      continue;
+    }
+    if (p->first == p->last)
+      fprintf(stream, "    case %u: ", p->first);
+    else
+      fprintf(stream, "    case %u ... %u: ", p->first, p->last);
+    fprintf(stream, "if (++repeat < %u) goto k_%u; goto s_%u;\n",
+            R->length[first], first, R->exit[first]);
+  }
+  fprintf(stream, "    default: %s\n",
+          kind == SCANNER ? "goto s_out;" : "return 0;");
+  fprintf(stream, "  }\n");
+}
+
+// with `entries`, the code is a function `scanner_name(s, entry)` that
+// starts from state `entries[entry]`.
+static void code_from_dfa(dfa *D, const char *scanner_name, code_kind kind,
+                          const profile_mode *profile,
+                          const state_id_t *entries, size_t n_entries,
+                          FILE *stream) {
+  const dfa_profile *use = profile ? profile->use : NULL;
+  size_t *first = malloc((D->n_states + 1) * sizeof(size_t));
+  path_offsets(D, first);
+
+  char counter[256];
+  snprintf(counter, sizeof(counter), "profile_%s", scanner_name);
+  if (profile && profile->generate)
+    emit_profile_writer(D, scanner_name, first, profile->generate, stream);
+
+  if (entries)
+    fprintf(stream,
+            "static unsigned long %s (const char *s, unsigned entry) {\n",
+            scanner_name);
+  else if (kind == SCANNER)
+    fprintf(stream, "unsigned long scan_%s (const char *s) {\n", scanner_name);
+  else
+    fprintf(stream, "unsigned long search_%s (const char *s) {\n",
+            scanner_name);
+  if (kind == SCANNER)
+    fprintf(stream, "  unsigned last_accepting = 0;\n");
+  fprintf(stream, "  unsigned char c;\n"
+                  "  unsigned long count = 0;\n");
+
+  // the counters of instrumented code are by state, so runs are only
+  // folded in plain code.
+  int plain = !use && !(profile && profile->generate);
+  runs R = {0};
+  unsigned char *entered = NULL;
+  if (plain) {
+    R = find_runs(D);
+    entered = run_entries(D, &R, entries, n_entries);
+  }
+  if (R.n_runs)
+    fprintf(stream, "  unsigned repeat;\n");
+  if (entries) {
+    fprintf(stream, "  switch (entry) {\n");
+    for (size_t i = 0; i < n_entries; i++)
+      fprintf(stream, "    case %zu: goto s_%u;\n", i, entries[i]);
+    fprintf(stream, "  }\n");
+  }
+
+  // the start state comes first in every layout.
+  state_id_t *order = layout(D, use);
+  for (state_id_t i = 0; i + 1 < D->n_states; i++) {
+    state_id_t id = order[i];
+    if (plain && R.first[id]) {
+      // the whole run is emitted with the state of it that comes first.
+      if (R.length[R.first[id]]) {
+        emit_run(D, &R, id, entered, kind, stream);
+        R.length[R.first[id]] = 0;
+      }
+      continue;
+    }
+    emit_state(D, id, kind, profile && profile->generate ? counter : NULL,
+               first, use, stream);
+  }
+  if (plain) {
+    delete_runs(&R);
+    free(entered);
+  }
+
+  if (kind == SCANNER)
+    fprintf(stream, "s_out: return last_accepting;\n");
+  fprintf(stream, "}\n");
+  free(order);
+  free(first);
+}
+
+void scanner_from_dfa(dfa *D, const char *scanner_name,
+                      const profile_mode *profile, FILE *stream) {
+  code_from_dfa(D, scanner_name, SCANNER, profile, NULL, 0, stream);
+}
+
+void searcher_from_dfa(dfa *D, const char *scanner_name,
+                       const profile_mode *profile, FILE *stream) {
+  code_from_dfa(D, scanner_name, SEARCHER, profile, NULL, 0, stream);
+}
+
+void shared_code_from_dfa(dfa *D, const char *shared_name,
+                          const char *const *names, const state_id_t *entries,
+                          size_t n, int search, FILE *stream) {
+  code_from_dfa(D, shared_name, search ? SEARCHER : SCANNER, NULL, entries, n,
+                stream);
+  for (size_t i = 0; i < n; i++)
+    fprintf(stream,
+            "unsigned long %s_%s (const char *s) {\n"
+            "  return %s(s, %zu);\n"
+            "}\n",
+            search ? "search" : "scan", names[i], shared_name, i);
+}
+
+void tokenizer_from_dfa(dfa *D, const char *name, const char *const *rules,
+                        const int *token, const unsigned char *skip,
+                        size_t n_rules, FILE *stream) {
+  fprintf(stream,
+          "typedef struct {\n"
+          "  unsigned long *offset;\n"
+          "  unsigned long *length;\n"
+          "  unsigned short *rule;\n"
+          "} %s_tokens;\n",
+          name);
+  fprintf(stream, "enum {");
+  for (size_t r = 0; r < n_rules; r++)
+    fprintf(stream, " %s_%s,", name, rules[r]);
+  fprintf(stream, " %s_n_rules };\n", name);
+  fprintf(stream, "static const unsigned char skip_%s[%zu] = {", name,
+          n_rules + !n_rules);
+  for (size_t r = 0; r < n_rules; r++)
+    fprintf(stream, "%s%u", r ? ", " : "", skip[r]);
+  fprintf(stream, "};\n");
+
+  // the states scan one token, bounded by the end of the buffer instead of
+  // a terminating 0. they are inlined in both callers.
+  fprintf(stream,
+          "static inline __attribute__((always_inline)) unsigned long\n"
+          "token_%s (const char *s, unsigned long rest, unsigned *rule,\n"
+          "          unsigned long *read) {\n"
+          "  unsigned long count = 0, last_accepting = 0;\n"
+          "  unsigned char c;\n"
+          "  *rule = 0;\n",
+          name);
+  // only the states some path leads to get a label, the start state falls
+  // through from the top.
+  unsigned char *targeted = calloc(D->n_states, 1);
+  int reads = 0;
+  ITER(line, l, &D->t_matrix) {
+    reads = 1;
+    ITER(path, p, &l->paths) { targeted[p->end_state] = 1; }
+  }
+  for (state_id_t id = 1; id < D->n_states; id++) {
+    if (targeted[id])
+      fprintf(stream, "s_%u:\n", id);
+    if (token[id] >= 0)
+      fprintf(stream, "  last_accepting = count; *rule = %d;\n", token[id]);
+    line *l = find_line(&D->t_matrix, id);
+    if (!l) {
+      fprintf(stream, "  goto s_out;\n");
+      continue;
+    }
+    fprintf(stream, "  if (count == rest) goto s_end;\n"
+                    "  c = s[count++];\n"
+                    "  switch (c) {\n");
+    ITER(path, p, &l->paths) { emit_case(p, NULL, 0, stream); }
+    fprintf(stream, "    default: goto s_out;\n"
+                    "  }\n");
+  }
+  free(targeted);
+  // reaching the end of the buffer counts as reading one more byte: the
+  // token may change if bytes are appended.
+  if (reads)
+    fprintf(stream, "s_end:\n"
+                    "  count = rest + 1;\n");
+  fprintf(stream, "s_out:\n"
+                  "  *read = count;\n"
+                  "  return last_accepting;\n"
+                  "}\n");
+
+  fprintf(stream,
+          "unsigned long tokenize_%s (const char *buf, unsigned long len,\n"
+          "                           unsigned long *offset, %s_tokens *out,\n"
+          "                           unsigned long cap) {\n"
+          "  unsigned long n = 0, start = *offset, read, length;\n"
+          "  unsigned rule;\n"
+          "  while (n < cap && start < len) {\n"
+          "    length = token_%s(buf + start, len - start, &rule, &read);\n"
+          "    if (!length)\n"
+          "      break;\n"
+          "    if (!skip_%s[rule]) {\n"
+          "      out->offset[n] = start;\n"
+          "      out->length[n] = length;\n"
+          "      out->rule[n++] = rule;\n"
+          "    }\n"
+          "    start += length;\n"
+          "  }\n"
+          "  *offset = start;\n"
+          "  return n;\n"
+          "}\n",
+          name, name, name, name);
+
+  fprintf(stream,
+          "unsigned long next_token_%s (const char *buf, unsigned long len,\n"
+          "                             unsigned long *start, unsigned *rule,\n"
+          "                             unsigned long *read) {\n"
+          "  unsigned long p = 0, reach = 0, length, r;\n"
+          "  for (;;) {\n"
+          "    length = token_%s(buf + p, len - p, rule, &r);\n"
+          "    if (p + r > reach)\n"
+          "      reach = p + r;\n"
+          "    if (!length || !skip_%s[*rule])\n"
+          "      break;\n"
+          "    p += length;\n"
+          "  }\n"
+          "  *start = p;\n"
+          "  *read = reach;\n"
+          "  return length;\n"
+          "}\n",
+          name, name, name);
+}
+
+static void emit_register(reg_t r, FILE *stream) {
+  if (r == REG_TEMP)
+    fprintf(stream, "t");
+  else if (r == REG_OFFSET)
+    fprintf(stream, "count");
+  else
+    fprintf(stream, "r%u", r);
+}
+
+static void emit_ops(const tdfa *T, unsigned ops, FILE *stream) {
+  ITER(reg_op, op, (vector *)elem_at(&T->op_lists, ops)) {
+    emit_register(op->dst, stream);
+    fprintf(stream, " = ");
+    emit_register(op->src, stream);
+    fprintf(stream, "; ");
+  }
+}
+
+void scanner_from_tdfa(tdfa *T, const char *scanner_name,
+                       const char *const *groups, FILE *stream) {
+  unsigned n_groups = T->n_tags / 2;
+  fprintf(stream, "enum {");
+  for (unsigned g = 0; g < n_groups; g++)
+    fprintf(stream, " %s_%s,", scanner_name, groups[g]);
+  fprintf(stream, " %s_n_groups };\n", scanner_name);
+
+  fprintf(stream,
+          "unsigned long scan_%s (const char *s, long *captures) {\n",
+          scanner_name);
   fprintf(stream, "  unsigned last_accepting = 0;\n"
                   "  unsigned char c;\n"
                   "  unsigned long count = 0;\n");
+  int uses_temp = 0;
+  ITER(vector, list, &T->op_lists) {
+    ITER(reg_op, op, list) { uses_temp |= op->dst == REG_TEMP; }
+  }
+  if (T->n_registers || uses_temp) {
+    fprintf(stream, "  long");
+    for (unsigned r = 1; r <= T->n_registers; r++)
+      fprintf(stream, "%s r%u = -1", r > 1 ? "," : "", r);
+    if (uses_temp)
+      fprintf(stream, "%s t", T->n_registers ? "," : "");
+    fprintf(stream, ";\n");
+  }
+  ITER(reg_op, op, (vector *)elem_at(&T->op_lists, T->start_ops)) {
+    fprintf(stream, "  ");
+    emit_register(op->dst, stream);
+    fprintf(stream, " = 0;\n");
+  }
+
+  for (state_id_t id = 1; id < T->n_states; id++) {
+    fprintf(stream, "s_%u:\n", id);
+    if (set_has(&T->accepting_states, id)) {
+      fprintf(stream, "  last_accepting = count;\n");
+      for (unsigned t = 0; t < T->n_tags; t++) {
+        reg_t r = *(reg_t *)elem_at(&T->final, id * T->n_tags + t);
+        if (r == REG_UNSET)
+          fprintf(stream, "  captures[%u] = -1;\n", t);
+        else
+          fprintf(stream, "  captures[%u] = r%u;\n", t, r);
+      }
+    }
+    fprintf(stream, "  c = s[count++];\n");
+    vector *row = elem_at(&T->rows, id);
+    if (!row->size) {
+      fprintf(stream, "  goto s_out;\n");
+      continue;
+    }
+    fprintf(stream, "  switch (c) {\n");
+    ITER(tagged_path, p, row) {
+      if (p->first == p->last)
+        fprintf(stream, "    case %u: ", p->first);
+      else
+        fprintf(stream, "    case %u ... %u: ", p->first, p->last);
+      emit_ops(T, p->ops, stream);
+      fprintf(stream, "goto s_%u;\n", p->end_state);
+    }
+    fprintf(stream, "    default: goto s_out;\n");
+    fprintf(stream, "  }\n");
+  }
+  fprintf(stream, "s_out: return last_accepting;\n");
+  fprintf(stream, "}\n");
+}
+
+// the test of case `x` of the register `k<i>` of counter `k`.
+static void emit_count_case(const counter *k, unsigned i, count_case x,
+                            FILE *stream) {
+  int bounded = k->max != REPEAT_UNBOUNDED;
+  if (x == COUNT_BELOW)
+    fprintf(stream, "k%u < %u", i, k->min - 1);
+  else if (x == COUNT_TOP)
+    fprintf(stream, "k%u >= %u", i, k->max - 1);
+  else if (k->min >= 2 && bounded)
+    fprintf(stream, "k%u >= %u && k%u < %u", i, k->min - 1, i, k->max - 1);
+  else if (k->min >= 2)
+    fprintf(stream, "k%u >= %u", i, k->min - 1);
+  else if (bounded)
+    fprintf(stream, "k%u < %u", i, k->max - 1);
+  else
+    fprintf(stream, "1");
+}
 
-  for (state_id_t i = 1; i < D->n_states; i++) {
-    line key = {.id = i};
-    line *ll = vec_find(&D->t_matrix, &key);
-    fprintf(stream, "s_%u:\n", i);
+static void emit_arm(const counted_dfa *D, const count_arm *a,
+                     const char *miss, FILE *stream) {
+  for (unsigned k = 0; k < D->n_counters; k++) {
+    if (a->ops[k] == COUNT_INC)
+      fprintf(stream, "k%u++; ", k);
+    else if (a->ops[k] == COUNT_RESET)
+      fprintf(stream, "k%u = 0; ", k);
+  }
+  if (a->end_state)
+    fprintf(stream, "goto s_%u;", a->end_state);
+  else
+    fprintf(stream, "%s", miss);
+}
+
+void scanner_from_counted_dfa(counted_dfa *D, const char *scanner_name,
+                              int search, FILE *stream) {
+  const char *miss = search ? "return 0;" : "goto s_out;";
+  if (search) {
+    fprintf(stream, "unsigned long search_%s (const char *s) {\n",
+            scanner_name);
+  } else {
+    fprintf(stream, "unsigned long scan_%s (const char *s) {\n", scanner_name);
+    fprintf(stream, "  unsigned last_accepting = 0;\n");
+  }
+  fprintf(stream, "  unsigned char c;\n"
+                  "  unsigned long count = 0;\n");
+  for (unsigned k = 0; k < D->n_counters; k++)
+    fprintf(stream, "%s k%u = 0", k ? "," : "  unsigned", k);
+  if (D->n_counters)
+    fprintf(stream, ";\n");
 
-    if (set_has(&D->accepting_states, i))
+  for (state_id_t id = 1; id < D->n_states; id++) {
+    fprintf(stream, "s_%u:\n", id);
+    if (set_has(&D->accepting_states, id)) {
+      if (search) {
+        fprintf(stream, "  return count;\n");
+        continue;
+      }
       fprintf(stream, "  last_accepting = count;\n");
+    }
     fprintf(stream, "  c = s[count++];\n");
+    vector *row = elem_at(&D->rows, id);
+    if (!row->size) {
+      fprintf(stream, "  %s\n", miss);
+      continue;
+    }
+    fprintf(stream, "  switch (c) {\n");
+    ITER(counted_path, p, row) {
+      if (p->first == p->last)
+        fprintf(stream, "    case %u:", p->first);
+      else
+        fprintf(stream, "    case %u ... %u:", p->first, p->last);
+      // every arm but the last tests the cases of its counters.
+      ITER(count_arm, a, &p->arms) {
+        fprintf(stream, " ");
+        if (a + 1 == (count_arm *)p->arms.ptr + p->arms.size) {
+          emit_arm(D, a, miss, stream);
+          break;
+        }
+        fprintf(stream, "if (");
+        const char *and = "";
+        for (unsigned k = 0; k < D->n_counters; k++) {
+          if (!a->cases[k])
+            continue;
+          fprintf(stream, "%s", and);
+          emit_count_case(&D->counters[k], k, a->cases[k], stream);
+          and = " && ";
+        }
+        fprintf(stream, ") { ");
+        emit_arm(D, a, miss, stream);
+        fprintf(stream, " }");
+      }
+      fprintf(stream, "\n");
+    }
+    fprintf(stream, "    default: %s\n", miss);
+    fprintf(stream, "  }\n");
+  }
+  if (!search)
+    fprintf(stream, "s_out: return last_accepting;\n");
+  fprintf(stream, "}\n");
+}
+
+void scanner_from_d2fa(d2fa *F, const char *scanner_name, int search,
+                       FILE *stream) {
+  const char *miss = search ? "return 0;" : "goto s_out;";
+  // states that are the default of some other state dispatch on the byte
+  // read by that state.
+  unsigned char *is_default = calloc(F->n_states, 1);
+  for (state_id_t id = 1; id < F->n_states; id++)
+    is_default[F->fallback[id]] = 1;
+
+  if (search) {
+    fprintf(stream, "unsigned long search_%s (const char *s) {\n",
+            scanner_name);
+  } else {
+    fprintf(stream, "unsigned long scan_%s (const char *s) {\n", scanner_name);
+    fprintf(stream, "  unsigned last_accepting = 0;\n");
+  }
+  fprintf(stream, "  unsigned char c;\n"
+                  "  unsigned long count = 0;\n");
 
-    if (ll) {
+  for (state_id_t id = 1; id < F->n_states; id++) {
+    fprintf(stream, "s_%u:\n", id);
+    int accepting = set_has(&F->accepting_states, id);
+    if (search && accepting) {
+      fprintf(stream, "  return count;\n");
+      // the states that default to it still take its transitions.
+      if (!is_default[id])
+        continue;
+    } else {
+      if (accepting)
+        fprintf(stream, "  last_accepting = count;\n");
+      fprintf(stream, "  c = s[count++];\n");
+    }
+    if (is_default[id])
+      fprintf(stream, "d_%u:\n", id);
+
+    line *l = find_line(&F->t_matrix, id);
+    if (l) {
       fprintf(stream, "  switch (c) {\n");
-      ITER(path, p, &ll->paths)
-      fprintf(stream, "    case %u: goto s_%u;\n", p->trigger, p->end_state);
-      fprintf(stream, "    default: goto s_out;\n");
+      ITER(path, p, &l->paths) {
+        if (p->end_state) {
+          emit_case(p, NULL, 0, stream);
+          continue;
+        }
+        if (p->first == p->last)
+          fprintf(stream, "    case %u: %s\n", p->first, miss);
+        else
+          fprintf(stream, "    case %u ... %u: %s\n", p->first, p->last, miss);
+      }
       fprintf(stream, "  }\n");
-    } else {
-      fprintf(stream, "  goto s_out;\n");
     }
+    if (F->fallback[id])
+      fprintf(stream, "  goto d_%u;\n", F->fallback[id]);
+    else
+      fprintf(stream, "  %s\n", miss);
   }
-  fprintf(stream, "s_out: return last_accepting;\n");
+  if (!search)
+    fprintf(stream, "s_out: return last_accepting;\n");
   fprintf(stream, "}\n");
+  free(is_default);
+}
+
+// a table of `n` numbers.
+static void emit_table(const char *type, const char *name, const unsigned *v,
+                       size_t n, FILE *stream) {
+  fprintf(stream, "  static const %s %s[%zu] = {", type, name, n);
+  for (size_t i = 0; i < n; i++)
+    fprintf(stream, "%s%s%u", i ? "," : "", i % 16 ? " " : "\n    ", v[i]);
+  fprintf(stream, "};\n");
+}
+
+void table_scanner_from_d2fa(d2fa *F, const char *scanner_name, int search,
+                             FILE *stream) {
+  size_t n_ranges = 0;
+  ITER(line, l, &F->t_matrix) { n_ranges += l->paths.size; }
+  size_t n = F->n_states;
+  unsigned *first = calloc(n + 1, sizeof(unsigned));
+  unsigned *fallback = calloc(n, sizeof(unsigned));
+  unsigned *accepting = calloc(n, sizeof(unsigned));
+  // an empty table would not be valid C.
+  unsigned *lo = calloc(n_ranges + 1, sizeof(unsigned));
+  unsigned *hi = calloc(n_ranges + 1, sizeof(unsigned));
+  unsigned *to = calloc(n_ranges + 1, sizeof(unsigned));
+  size_t k = 0;
+  for (state_id_t id = 0; id < n; id++) {
+    first[id] = k;
+    fallback[id] = F->fallback[id];
+    accepting[id] = id && set_has(&F->accepting_states, id);
+    line *l = find_line(&F->t_matrix, id);
+    if (!l)
+      continue;
+    ITER(path, p, &l->paths) {
+      lo[k] = p->first;
+      hi[k] = p->last;
+      to[k++] = p->end_state;
+    }
+  }
+  first[n] = k;
+
+  const char *state_type = n > 256 ? "unsigned short" : "unsigned char";
+  fprintf(stream, "unsigned long %s_%s (const char *s) {\n",
+          search ? "search" : "scan", scanner_name);
+  emit_table(state_type, "fallback", fallback, n, stream);
+  emit_table("unsigned char", "accepting", accepting, n, stream);
+  emit_table("unsigned", "first", first, n + 1, stream);
+  emit_table("unsigned char", "lo", lo, n_ranges + 1, stream);
+  emit_table("unsigned char", "hi", hi, n_ranges + 1, stream);
+  emit_table(state_type, "to", to, n_ranges + 1, stream);
+  fprintf(stream,
+          "  unsigned long count = 0%s;\n"
+          "  unsigned state = 1;\n"
+          "  for (;;) {\n"
+          "    if (accepting[state])\n"
+          "      %s;\n"
+          "    unsigned char c = s[count++];\n"
+          "    unsigned q = state, k;\n"
+          "    for (;;) {\n"
+          "      for (k = first[q]; k < first[q + 1] && hi[k] < c; k++)\n"
+          "        ;\n"
+          "      if (k < first[q + 1] && lo[k] <= c)\n"
+          "        break;\n"
+          "      if (!(q = fallback[q]))\n"
+          "        break;\n"
+          "    }\n"
+          "    if (!q || !(state = to[k]))\n"
+          "      return %s;\n"
+          "  }\n"
+          "}\n",
+          search ? "" : ", last_accepting = 0",
+          search ? "return count" : "last_accepting = count",
+          search ? "0" : "last_accepting");
+  free(first);
+  free(fallback);
+  free(accepting);
+  free(lo);
+  free(hi);
+  free(to);
+}
+
+// the searcher is a table of the goto function with the failure links
+// resolved, which keeps the generated code small and quick to compile
+// however many literals there are. bytes that no literal contains share a
+// column of the table, every other byte has its own.
+void searcher_from_aho_corasick(aho_corasick *A, const char *scanner_name,
+                                FILE *stream) {
+  unsigned byte_class[256] = {0};
+  unsigned n_classes = 1;
+  ITER(line, l, &A->t_matrix) {
+    ITER(path, p, &l->paths) {
+      if (!byte_class[p->first])
+        byte_class[p->first] = n_classes++;
+    }
+  }
+
+  // a transition to a state where some literal ends is 0, the match.
+  state_id_t *delta = aho_corasick_delta(A);
+  size_t n = (size_t)(A->n_states + 1) * n_classes;
+  unsigned *table = calloc(n, sizeof(unsigned));
+  for (state_id_t id = 1; id <= A->n_states; id++) {
+    for (unsigned c = 1; c < 256; c++) {
+      state_id_t to = delta[(size_t)id * 256 + c];
+      table[id * n_classes + byte_class[c]] = A->output[to] ? 0 : to;
+    }
+  }
+
+  fprintf(stream, "unsigned long search_%s (const char *s) {\n", scanner_name);
+  if (A->output[1]) {
+    // the empty literal matches at the start.
+    fprintf(stream, "  (void)s;\n  return 0;\n}\n");
+  } else {
+    emit_table("unsigned char", "byte_class", byte_class, 256, stream);
+    emit_table(A->n_states > 255 ? "unsigned short" : "unsigned char",
+               "delta", table, n, stream);
+    fprintf(stream,
+            "  unsigned long count = 0;\n"
+            "  unsigned state = 1;\n"
+            "  for (;;) {\n"
+            "    unsigned char c = s[count++];\n"
+            "    if (!c)\n"
+            "      return 0;\n"
+            "    if (!(state = delta[state * %u + byte_class[c]]))\n"
+            "      return count;\n"
+            "  }\n"
+            "}\n",
+            n_classes);
+  }
+  free(table);
+  free(delta);
 }
 
-void scanner_from_regex(const char *regex, const char *scanner_name, FILE *stream) {
+int scanner_from_regex(const char *regex, const char *scanner_name, FILE *stream) {
   nfa initial = regex_to_nfa(regex, strlen(regex));
-  dfa *intermediate = to_dfa(&initial);
+  dfa *intermediate = initial.start_id ? to_dfa(&initial) : NULL;
+  delete_nfa(&initial);
+  if (!intermediate)
+    return 1;
   dfa *minimal = minimize(intermediate);
-  scanner_from_dfa(minimal, scanner_name, stream);
+  scanner_from_dfa(minimal, scanner_name, NULL, stream);
+  delete_dfa(intermediate);
+  free(intermediate);
+  delete_dfa(minimal);
+  free(minimal);
+  return 0;
 }
@@ -1,4 +1,66 @@
 #include "automata.h"
+#include "counted.h"
+#include "d2fa.h"
+#include "profile.h"
+#include "tdfa.h"
+#include "trie.h"
 
-void scanner_from_dfa(dfa * D, const char *scanner_name, FILE *stream);
-void scanner_from_regex(const char *regex, const char *scanner_name, FILE *stream);
+// how the code of a DFA is instrumented and laid out. NULL for neither.
+typedef struct {
+  // the code counts the visits of its states and the paths they take, and
+  // appends them to this file, or to $DFA_PROFILE, when the program exits.
+  const char *generate;
+  // the states are laid out and their paths tested by these counts.
+  const dfa_profile *use;
+} profile_mode;
+
+void scanner_from_dfa(dfa *D, const char *scanner_name,
+                      const profile_mode *profile, FILE *stream);
+// `scan_<name>(s, captures)` also stores the offsets of the start and the
+// end of group `i` of the match in captures[2 * i] and captures[2 * i + 1],
+// -1 if the group is not part of it. `groups` holds the names of the groups.
+void scanner_from_tdfa(tdfa *T, const char *scanner_name,
+                       const char *const *groups, FILE *stream);
+// the scanner, or searcher with `search`, of a DFA with counters: the
+// register `k<i>` of counter `i` is tested and updated on the transitions.
+void scanner_from_counted_dfa(counted_dfa *D, const char *scanner_name,
+                              int search, FILE *stream);
+// the scanner, or searcher with `search`, of a D²FA: a state jumps to the
+// `switch` of its default for the bytes it does not list, without reading
+// another byte.
+void scanner_from_d2fa(d2fa *F, const char *scanner_name, int search,
+                       FILE *stream);
+// the same, reading the listed ranges of each state and its default from
+// tables.
+void table_scanner_from_d2fa(d2fa *F, const char *scanner_name, int search,
+                             FILE *stream);
+// returns 1 if the regex is malformed or its DFA is too large.
+int scanner_from_regex(const char *regex, const char *scanner_name, FILE *stream);
+
+// `search_<name>` functions return the offset just past the end of the
+// earliest ending match in `s`, or 0 if there is none.
+void searcher_from_dfa(dfa *D, const char *scanner_name,
+                       const profile_mode *profile, FILE *stream);
+// the scanners, or searchers with `search`, of the `n` rules `names`, which
+// start from the states `entries` of `D`. the code of the states is emitted
+// once, in the static function `shared_name`, so the rules share the code of
+// the states they have in common.
+void shared_code_from_dfa(dfa *D, const char *shared_name,
+                          const char *const *names, const state_id_t *entries,
+                          size_t n, int search, FILE *stream);
+// `tokenize_<name>(buf, len, offset, out, cap)`, which splits `buf` from
+// `*offset` on into the longest matches of the `n_rules` rules `rules`, the
+// first rule winning ties: `token[s]` is the rule accepting in state `s` of
+// their union `D`, -1 if none. the tokens of the rules where `skip` is set
+// are dropped, the others stored in the arrays of the struct `<name>_tokens`.
+// it stops at the end of `buf`, once `cap` tokens are stored, or before a
+// byte that starts no nonempty token, and leaves `*offset` where it stopped.
+// `next_token_<name>(buf, len, &start, &rule, &read)` returns the length of
+// the first token of `buf` that is not skipped, and stores where it starts,
+// its rule, and how many bytes were examined to find it, one past `len` if
+// the end of `buf` was; it is the scanner of `ra_lexer_new`.
+void tokenizer_from_dfa(dfa *D, const char *name, const char *const *rules,
+                        const int *token, const unsigned char *skip,
+                        size_t n_rules, FILE *stream);
+void searcher_from_aho_corasick(aho_corasick *A, const char *scanner_name,
+                                FILE *stream);
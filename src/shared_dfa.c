@@ -0,0 +1,148 @@
+#include "shared_dfa.h"
+
+// the states of all the DFAs have global ids: 0 is the error state, and
+// state `s` of `dfas[i]` is `offset[i] + s`.
+typedef struct {
+  const vector *paths; // NULL if the state has none
+  state_id_t offset;   // of the DFA of the state
+  int accepting;
+} member;
+
+static state_id_t global(const member *m, state_id_t s) {
+  return s ? m->offset + s : 0;
+}
+
+static uint64_t signature_hash(const member *states, const state_id_t *cls,
+                               state_id_t s) {
+  uint64_t h = hash_mix(HASH_INIT, cls[s]);
+  if (!states[s].paths)
+    return hash_finish(h);
+  ITER(path, p, states[s].paths) {
+    h = hash_mix(h, p->first | p->last << 8);
+    h = hash_mix(h, cls[global(&states[s], p->end_state)]);
+  }
+  return hash_finish(h);
+}
+
+// whether `a` and `b` are in the same class and their paths take the same
+// bytes to the same classes.
+static int same_signature(const member *states, const state_id_t *cls,
+                          state_id_t a, state_id_t b) {
+  if (cls[a] != cls[b])
+    return 0;
+  const vector *pa = states[a].paths, *pb = states[b].paths;
+  size_t n = pa ? pa->size : 0;
+  if (n != (pb ? pb->size : 0))
+    return 0;
+  for (size_t i = 0; i < n; i++) {
+    const path *p = elem_at(pa, i), *q = elem_at(pb, i);
+    if (p->first != q->first || p->last != q->last ||
+        cls[global(&states[a], p->end_state)] !=
+            cls[global(&states[b], q->end_state)])
+      return 0;
+  }
+  return 1;
+}
+
+dfa *share_states(dfa *const *dfas, size_t n, state_id_t *starts) {
+  size_t total = 1;
+  for (size_t i = 0; i < n; i++)
+    total += dfas[i]->n_states - 1;
+  assert(total <= MAX_NFA_SIZE);
+
+  member *states = calloc(total, sizeof(member));
+  state_id_t offset = 0;
+  for (size_t i = 0; i < n; i++) {
+    for (state_id_t s = 1; s < dfas[i]->n_states; s++) {
+      states[offset + s].offset = offset;
+      states[offset + s].accepting = set_has(&dfas[i]->accepting_states, s);
+    }
+    ITER(line, l, &dfas[i]->t_matrix) {
+      if (l->id)
+        states[offset + l->id].paths = &l->paths;
+    }
+    offset += dfas[i]->n_states - 1;
+  }
+
+  // Moore's refinement, from the accepting and the other states: a round
+  // splits the classes whose states go to different classes, and the
+  // classes are stable once a round splits none. the error state is a class
+  // of its own.
+  state_id_t *cls = malloc(total * sizeof(state_id_t));
+  state_id_t *next = malloc(total * sizeof(state_id_t));
+  int kinds[2] = {0};
+  cls[0] = 0;
+  for (state_id_t s = 1; s < total; s++) {
+    cls[s] = 1 + states[s].accepting;
+    kinds[states[s].accepting] = 1;
+  }
+  size_t cap = 16;
+  while (cap < 2 * total)
+    cap *= 2;
+  state_id_t *slots = malloc(cap * sizeof(state_id_t)); // state + 1, 0 if free
+  for (size_t n_classes = 0, count = 1 + kinds[0] + kinds[1];
+       count != n_classes;) {
+    n_classes = count;
+    memset(slots, 0, cap * sizeof(state_id_t));
+    next[0] = 0;
+    count = 1;
+    for (state_id_t s = 1; s < total; s++) {
+      size_t i = signature_hash(states, cls, s) & (cap - 1);
+      while (slots[i] && !same_signature(states, cls, slots[i] - 1, s))
+        i = (i + 1) & (cap - 1);
+      if (slots[i]) {
+        next[s] = next[slots[i] - 1];
+      } else {
+        slots[i] = s + 1;
+        next[s] = count++;
+      }
+    }
+    state_id_t *tmp = cls;
+    cls = next;
+    next = tmp;
+  }
+  free(slots);
+
+  // one state for each class reached from the starts, breadth first.
+  state_id_t *new_id = calloc(total, sizeof(state_id_t));
+  state_id_t *member_of = malloc(total * sizeof(state_id_t));
+  state_id_t size = 1;
+  offset = 0;
+  for (size_t i = 0; i < n; i++) {
+    state_id_t start = cls[offset + 1];
+    if (!new_id[start]) {
+      new_id[start] = size;
+      member_of[size++] = offset + 1;
+    }
+    starts[i] = new_id[start];
+    offset += dfas[i]->n_states - 1;
+  }
+
+  dfa *result = calloc(sizeof(dfa), 1);
+  result->t_matrix = L_VEC();
+  for (state_id_t id = 1; id < size; id++) {
+    const member *m = &states[member_of[id]];
+    if (m->accepting)
+      set_insert(&result->accepting_states, id);
+    if (!m->paths)
+      continue;
+    ITER(path, p, m->paths) {
+      state_id_t to = cls[global(m, p->end_state)];
+      if (to && !new_id[to]) {
+        new_id[to] = size;
+        member_of[size++] = global(m, p->end_state);
+      }
+      if (to)
+        transition_matrix_insert(&result->t_matrix, id, p->first, p->last,
+                                 new_id[to]);
+    }
+  }
+  result->n_states = size;
+
+  free(new_id);
+  free(member_of);
+  free(cls);
+  free(next);
+  free(states);
+  return result;
+}
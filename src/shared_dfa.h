@@ -0,0 +1,13 @@
+#ifndef SHARED_DFA_H_
+#define SHARED_DFA_H_
+#include "automata.h"
+
+// the `n` minimal DFAs as one, where the states of different DFAs that match
+// the same strings are hash-consed into one state: they are merged when they
+// accept alike and their paths take the same bytes to merged states. the
+// start state of `dfas[i]` becomes `starts[i]`, and the states are numbered
+// breadth first from the starts, in order. the DFAs may not have more than
+// MAX_NFA_SIZE states in all, their error states counted once.
+dfa *share_states(dfa *const *dfas, size_t n, state_id_t *starts);
+
+#endif // SHARED_DFA_H_
@@ -0,0 +1,266 @@
+#include "simplify.h"
+
+static ast *simplify_concat(ast *a);
+static ast *simplify_alt(ast *a);
+
+// the first (or last) element of a concatenation, or the node itself.
+static ast *edge_of(ast *a, int last) {
+  if (a->kind == AST_CONCAT && a->children.size > 0)
+    return ast_child(a, last ? a->children.size - 1 : 0);
+  return a;
+}
+
+// removes the first (or last) element from `a`, consuming it.
+static ast *drop_edge(ast *a, int last) {
+  if (a->kind != AST_CONCAT) {
+    ast_free(a);
+    return ast_new(AST_EMPTY);
+  }
+  ast *e;
+  if (last) {
+    vec_pop_back(&a->children, &e);
+  } else {
+    e = ast_child(a, 0);
+    ast **p = a->children.ptr;
+    memmove(p, p + 1, (a->children.size - 1) * sizeof(ast *));
+    a->children.size--;
+  }
+  ast_free(e);
+  return simplify_concat(a);
+}
+
+static void flatten(ast *a) {
+  vector flat = VEC(ast *, NULL);
+  ITER(ast *, c, &a->children) {
+    if ((*c)->kind == a->kind) {
+      ITER(ast *, cc, &(*c)->children) { vec_insert(&flat, cc); }
+      (*c)->children.size = 0;
+      ast_free(*c);
+    } else {
+      vec_insert(&flat, c);
+    }
+  }
+  destroy(&a->children);
+  a->children = flat;
+}
+
+static ast *unwrap(ast *a) {
+  if (a->children.size == 0) {
+    ast_free(a);
+    return ast_new(AST_EMPTY);
+  }
+  if (a->children.size == 1) {
+    ast *c = ast_child(a, 0);
+    a->children.size = 0;
+    ast_free(a);
+    return c;
+  }
+  return a;
+}
+
+static ast *simplify_concat(ast *a) {
+  flatten(a);
+  vector kept = VEC(ast *, NULL);
+  ITER(ast *, c, &a->children) {
+    if ((*c)->kind == AST_EMPTY)
+      ast_free(*c);
+    else
+      vec_insert(&kept, c);
+  }
+  destroy(&a->children);
+  a->children = kept;
+  return unwrap(a);
+}
+
+// replaces every group of alternatives sharing their first (or last)
+// element `x` with the single alternative `x(rest|...)` (or `(rest|...)x`).
+static int factor(ast *a, int last) {
+  int changed = 0;
+  for (size_t i = 0; i < a->children.size; i++) {
+    ast *head = edge_of(ast_child(a, i), last);
+    if (head->kind == AST_EMPTY)
+      continue;
+
+    size_t matches = 0;
+    ITER(ast *, c, &a->children) {
+      matches += ast_cmp(edge_of(*c, last), head) == 0;
+    }
+    if (matches < 2)
+      continue;
+
+    ast *shared = ast_clone(head);
+    ast *rest = ast_new(AST_ALT);
+    size_t out = 0;
+    ITER(ast *, c, &a->children) {
+      if (index_of(&a->children, c) >= i &&
+          ast_cmp(edge_of(*c, last), shared) == 0)
+        ast_append(rest, drop_edge(*c, last));
+      else
+        *(ast **)elem_at(&a->children, out++) = *c;
+    }
+    a->children.size = out;
+
+    ast *factored = ast_new(AST_CONCAT);
+    if (!last)
+      ast_append(factored, shared);
+    ast_append(factored, simplify_alt(rest));
+    if (last)
+      ast_append(factored, shared);
+    factored = simplify_concat(factored);
+
+    vec_insert(&a->children, &factored);
+    ast **p = a->children.ptr;
+    memmove(p + i + 1, p + i, (a->children.size - i - 1) * sizeof(ast *));
+    p[i] = factored;
+    changed = 1;
+  }
+  return changed;
+}
+
+static ast *simplify_alt(ast *a) {
+  flatten(a);
+
+  // merge every single-byte alternative into one set, and drop duplicates.
+  vector kept = VEC(ast *, NULL);
+  ast *set = NULL;
+  int has_empty = 0;
+  ITER(ast *, c, &a->children) {
+    if ((*c)->kind == AST_SET && set) {
+      byte_set_union(&set->set, &(*c)->set);
+      ast_free(*c);
+      continue;
+    }
+    if ((*c)->kind == AST_SET)
+      set = *c;
+    if ((*c)->kind == AST_EMPTY)
+      has_empty = 1;
+
+    int dup = 0;
+    ITER(ast *, k, &kept) {
+      if (ast_cmp(*k, *c) == 0) {
+        dup = 1;
+        break;
+      }
+    }
+    if (dup)
+      ast_free(*c);
+    else
+      vec_insert(&kept, c);
+  }
+  destroy(&a->children);
+  a->children = kept;
+
+  // `|x*` is `x*`, and `|x+` is also `x*`.
+  if (has_empty) {
+    int absorbed = 0;
+    ITER(ast *, c, &a->children) {
+      if ((*c)->kind == AST_STAR || (*c)->kind == AST_PLUS) {
+        (*c)->kind = AST_STAR;
+        absorbed = 1;
+        break;
+      }
+    }
+    if (absorbed) {
+      size_t out = 0;
+      ITER(ast *, c, &a->children) {
+        if ((*c)->kind == AST_EMPTY)
+          ast_free(*c);
+        else
+          *(ast **)elem_at(&a->children, out++) = *c;
+      }
+      a->children.size = out;
+    }
+  }
+
+  if (a->children.size > 1 && (factor(a, 0) | factor(a, 1))) {
+    // factoring may have exposed new sets or duplicates.
+    return simplify_alt(a);
+  }
+  return unwrap(a);
+}
+
+// `(|x)*` is `x*`, `(x*)*` and `(x+)*` are `x*`.
+static ast *simplify_repeat(ast *a) {
+  ast *c = ast_child(a, 0);
+
+  if (c->kind == AST_EMPTY) {
+    ast_free(a);
+    return ast_new(AST_EMPTY);
+  }
+
+  if (c->kind == AST_ALT) {
+    size_t out = 0;
+    int had_empty = 0;
+    ITER(ast *, cc, &c->children) {
+      if ((*cc)->kind == AST_EMPTY) {
+        ast_free(*cc);
+        had_empty = 1;
+      } else {
+        *(ast **)elem_at(&c->children, out++) = *cc;
+      }
+    }
+    c->children.size = out;
+    if (had_empty) {
+      a->kind = AST_STAR;
+      *(ast **)elem_at(&a->children, 0) = c = unwrap(c);
+    }
+    if (c->kind == AST_EMPTY) {
+      ast_free(a);
+      return ast_new(AST_EMPTY);
+    }
+  }
+
+  if (c->kind == AST_STAR || c->kind == AST_PLUS) {
+    ast_kind kind = (a->kind == AST_PLUS && c->kind == AST_PLUS)
+                        ? AST_PLUS
+                        : AST_STAR;
+    a->children.size = 0;
+    ast_free(a);
+    c->kind = kind;
+    return c;
+  }
+  return a;
+}
+
+// `x{0,}` is `x*`, `x{1,}` is `x+`, `x{1}` is `x`, `x{0}` and `(){n,m}`
+// are empty.
+static ast *simplify_counted(ast *a) {
+  ast *c = ast_child(a, 0);
+  if (a->max == 0 || c->kind == AST_EMPTY) {
+    ast_free(a);
+    return ast_new(AST_EMPTY);
+  }
+  if (a->max == REPEAT_UNBOUNDED && a->min <= 1) {
+    a->kind = a->min ? AST_PLUS : AST_STAR;
+    return simplify_repeat(a);
+  }
+  if (a->min == 1 && a->max == 1)
+    return unwrap(a);
+  return a;
+}
+
+ast *simplify(ast *a) {
+  ITER(ast *, c, &a->children) { *c = simplify(*c); }
+
+  switch (a->kind) {
+  case AST_CONCAT:
+    return simplify_concat(a);
+  case AST_ALT:
+    return simplify_alt(a);
+  case AST_STAR:
+  case AST_PLUS:
+    return simplify_repeat(a);
+  case AST_CAPTURE:
+    // the groups only matter to the tagged DFA, which is built before.
+    return unwrap(a);
+  case AST_REPEAT:
+    return simplify_counted(a);
+  case AST_EMPTY:
+  case AST_SET:
+  case AST_AND:
+  case AST_DIFF:
+  case AST_NOT:
+    break;
+  }
+  return a;
+}
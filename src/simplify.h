@@ -0,0 +1,9 @@
+#ifndef SIMPLIFY_H_
+#define SIMPLIFY_H_
+#include "ast.h"
+
+// rewrites `a` into an equivalent, usually smaller, tree.
+// `a` is consumed and must not be used after the call.
+ast *simplify(ast *a);
+
+#endif // SIMPLIFY_H_
@@ -0,0 +1,692 @@
+#include "tdfa.h"
+#include "product.h"
+
+// the tagged NFA is Thompson's, except that the epsilon moves of a state are
+// kept in the order they are preferred in, and may set a tag.
+typedef struct {
+  state_id_t to;
+  int tag; // -1 if none
+} eps_move;
+
+typedef struct {
+  vector eps;   // of `eps_move`, the preferred first
+  vector paths; // of `path`, on bytes
+} tnfa_state;
+
+typedef struct {
+  vector states; // of `tnfa_state`, by id. 0 is not a state
+  state_id_t end;
+  int too_large;
+} tnfa;
+
+typedef struct {
+  state_id_t start;
+  state_id_t end;
+} fragment;
+
+// past the limit every new state is 0, and the NFA is thrown away at the end.
+static state_id_t new_state(tnfa *N) {
+  if (N->states.size >= MAX_NFA_SIZE) {
+    N->too_large = 1;
+    return 0;
+  }
+  tnfa_state s = {.eps = VEC(eps_move, NULL), .paths = P_VEC()};
+  vec_insert(&N->states, &s);
+  return N->states.size - 1;
+}
+
+static tnfa_state *state_at(const tnfa *N, state_id_t id) {
+  return elem_at(&N->states, id);
+}
+
+static void add_eps(tnfa *N, state_id_t from, state_id_t to, int tag) {
+  if (!from)
+    return;
+  const eps_move e = {.to = to, .tag = tag};
+  vec_insert(&state_at(N, from)->eps, &e);
+}
+
+static void add_range(tnfa *N, state_id_t from, unsigned char first,
+                      unsigned char last, state_id_t to) {
+  if (!from)
+    return;
+  const path p = {.first = first, .last = last, .end_state = to};
+  vec_insert(&state_at(N, from)->paths, &p);
+}
+
+// the operands of `&`, `-` and `~` have no groups: their minimal DFA is
+// copied into the NFA, and freed.
+static fragment embed_dfa(tnfa *N, dfa *D) {
+  if (!D) {
+    N->too_large = 1;
+    return (fragment){0};
+  }
+  state_id_t *ids = calloc(D->n_states, sizeof(state_id_t));
+  for (state_id_t id = 1; id < D->n_states; id++)
+    ids[id] = new_state(N);
+
+  fragment f = {.start = ids[1], .end = new_state(N)};
+  for (state_id_t id = 1; id < D->n_states; id++)
+    if (set_has(&D->accepting_states, id))
+      add_eps(N, ids[id], f.end, -1);
+  ITER(line, l, &D->t_matrix) {
+    ITER(path, p, &l->paths) {
+      add_range(N, ids[l->id], p->first, p->last, ids[p->end_state]);
+    }
+  }
+
+  free(ids);
+  delete_dfa(D);
+  free(D);
+  return f;
+}
+
+static fragment build(tnfa *N, const ast *a) {
+  fragment f = {.start = new_state(N), .end = new_state(N)};
+  fragment c;
+
+  switch (a->kind) {
+  case AST_EMPTY:
+    add_eps(N, f.start, f.end, -1);
+    break;
+  case AST_SET:
+    for (unsigned ch = 1; ch < 256; ch++) {
+      if (!byte_set_has(&a->set, ch))
+        continue;
+      unsigned last = ch;
+      while (last < 255 && byte_set_has(&a->set, last + 1))
+        last++;
+      add_range(N, f.start, ch, last, f.end);
+      ch = last;
+    }
+    break;
+  case AST_CONCAT: {
+    state_id_t end = f.start;
+    ITER(ast *, child, &a->children) {
+      c = build(N, *child);
+      add_eps(N, end, c.start, -1);
+      end = c.end;
+    }
+    add_eps(N, end, f.end, -1);
+    break;
+  }
+  case AST_ALT:
+    ITER(ast *, child, &a->children) {
+      c = build(N, *child);
+      add_eps(N, f.start, c.start, -1);
+      add_eps(N, c.end, f.end, -1);
+    }
+    break;
+  // repetitions are greedy: another round is preferred to leaving.
+  case AST_STAR:
+  case AST_PLUS:
+    c = build(N, ast_child(a, 0));
+    add_eps(N, f.start, c.start, -1);
+    if (a->kind == AST_STAR)
+      add_eps(N, f.start, f.end, -1);
+    add_eps(N, c.end, c.start, -1);
+    add_eps(N, c.end, f.end, -1);
+    break;
+  case AST_CAPTURE:
+    c = build(N, ast_child(a, 0));
+    add_eps(N, f.start, c.start, 2 * a->group);
+    add_eps(N, c.end, f.end, 2 * a->group + 1);
+    break;
+  case AST_REPEAT: {
+    int unbounded = a->max == REPEAT_UNBOUNDED;
+    unsigned copies = unbounded ? (a->min ? a->min : 1) : a->max;
+    state_id_t end = f.start;
+    for (unsigned i = 0; i < copies && !N->too_large; i++) {
+      c = build(N, ast_child(a, 0));
+      add_eps(N, end, c.start, -1);
+      if (i >= a->min)
+        add_eps(N, end, f.end, -1);
+      if (unbounded && i + 1 == copies)
+        add_eps(N, c.end, c.start, -1);
+      end = c.end;
+    }
+    add_eps(N, end, f.end, -1);
+    break;
+  }
+  case AST_AND:
+  case AST_DIFF:
+  case AST_NOT:
+    c = embed_dfa(N, ast_to_dfa(a));
+    add_eps(N, f.start, c.start, -1);
+    add_eps(N, c.end, f.end, -1);
+    break;
+  }
+  return f;
+}
+
+static void delete_tnfa(tnfa *N) {
+  ITER(tnfa_state, s, &N->states) {
+    destroy(&s->eps);
+    destroy(&s->paths);
+  }
+  destroy(&N->states);
+}
+
+// the configurations of a state of the TDFA: NFA states in the order of
+// their priority, each with the register holding every tag.
+typedef struct {
+  vector q;    // of state_id_t
+  vector regs; // of reg_t, n_tags for each state of `q`
+} kernel;
+
+// new registers are named after their tag until the kernel is renamed.
+#define REG_FRESH 0x8000
+
+typedef struct {
+  const tnfa *N;
+  unsigned n_tags;
+  bit_set seen;
+  kernel *out;
+  vector tags; // of uint64_t: the tags set on the way to each state of `out`
+} closure;
+
+// follows the epsilon moves from `q` depth first, in priority order: the
+// first path reaching a state is the one a backtracking matcher would take.
+// only the states reading a byte, and the final one, are kept.
+static void close_from(closure *c, state_id_t q, const reg_t *regs,
+                       uint64_t tags) {
+  if (set_has(&c->seen, q))
+    return;
+  set_insert(&c->seen, q);
+  const tnfa_state *s = state_at(c->N, q);
+  if (s->paths.size || q == c->N->end) {
+    vec_insert(&c->out->q, &q);
+    for (unsigned t = 0; t < c->n_tags; t++)
+      vec_insert(&c->out->regs, &regs[t]);
+    vec_insert(&c->tags, &tags);
+  }
+  ITER(eps_move, e, &s->eps) {
+    close_from(c, e->to, regs,
+               e->tag < 0 ? tags : tags | (uint64_t)1 << e->tag);
+  }
+}
+
+static kernel new_kernel(void) {
+  return (kernel){.q = VEC(state_id_t, NULL), .regs = VEC(reg_t, NULL)};
+}
+
+static void delete_kernel(kernel *k) {
+  destroy(&k->q);
+  destroy(&k->regs);
+}
+
+// appends the parallel copies `moves` to `ops` one after the other, never
+// overwriting a register that is still to be read. cycles go through
+// REG_TEMP.
+static void sequentialize(vector *moves, vector *ops) {
+  reg_op *m = moves->ptr;
+  size_t n = moves->size;
+  while (n) {
+    size_t i = 0;
+    for (; i < n; i++) {
+      size_t j = 0;
+      while (j < n && m[j].src != m[i].dst)
+        j++;
+      if (j == n)
+        break;
+    }
+    if (i == n) {
+      const reg_op save = {.dst = REG_TEMP, .src = m[0].dst};
+      vec_insert(ops, &save);
+      for (size_t j = 0; j < n; j++)
+        if (m[j].src == save.src)
+          m[j].src = REG_TEMP;
+      continue;
+    }
+    vec_insert(ops, &m[i]);
+    m[i] = m[--n];
+  }
+}
+
+// gives the tags set by the closure `c` a new register each, then renames
+// the registers of its kernel 1, 2... in the order they first appear, so
+// that kernels that only differ by the names of their registers are equal.
+// `ops` gets the operations moving the registers of the previous state
+// under their new names. returns the number of registers of the kernel, or
+// -1 if there are too many.
+static int canonicalize(closure *c, reg_t *names, vector *ops) {
+  kernel *k = c->out;
+  reg_t *regs = k->regs.ptr;
+  uint64_t *tags = c->tags.ptr;
+  for (size_t i = 0; i < k->q.size; i++)
+    for (unsigned t = 0; t < c->n_tags; t++)
+      if (tags[i] >> t & 1)
+        regs[i * c->n_tags + t] = REG_FRESH + t;
+
+  vector renamed = VEC(reg_t, NULL);
+  unsigned n = 0;
+  for (size_t i = 0; i < k->regs.size; i++) {
+    if (regs[i] == REG_UNSET)
+      continue;
+    if (!names[regs[i]]) {
+      if (n + 1 == REG_FRESH)
+        break;
+      names[regs[i]] = ++n;
+      vec_insert(&renamed, &regs[i]);
+    }
+    regs[i] = names[regs[i]];
+  }
+
+  vector moves = VEC(reg_op, NULL);
+  vector stores = VEC(reg_op, NULL);
+  ITER(reg_t, r, &renamed) {
+    const reg_op op = {.dst = names[*r],
+                       .src = *r >= REG_FRESH ? REG_OFFSET : *r};
+    names[*r] = 0;
+    if (op.src == REG_OFFSET)
+      vec_insert(&stores, &op);
+    else if (op.src != op.dst)
+      vec_insert(&moves, &op);
+  }
+  sequentialize(&moves, ops);
+  ITER(reg_op, op, &stores) { vec_insert(ops, op); }
+  destroy(&moves);
+  destroy(&stores);
+  destroy(&renamed);
+  return n + 1 < REG_FRESH ? (int)n : -1;
+}
+
+static uint64_t kernel_hash(const kernel *k) {
+  uint64_t h = HASH_INIT;
+  ITER(state_id_t, q, &k->q) { h = hash_mix(h, *q); }
+  ITER(reg_t, r, &k->regs) { h = hash_mix(h, *r); }
+  return hash_finish(h);
+}
+
+// empty vectors have no storage.
+static int same_elems(const vector *a, const vector *b) {
+  return a->size == b->size &&
+         (!a->size || !memcmp(a->ptr, b->ptr, a->size * a->elem_size));
+}
+
+static int kernel_eq(const kernel *a, const kernel *b) {
+  return same_elems(&a->q, &b->q) && same_elems(&a->regs, &b->regs);
+}
+
+static unsigned intern_ops(tdfa *T, vector *ops) {
+  for (unsigned i = 0; i < T->op_lists.size; i++) {
+    if (same_elems(elem_at(&T->op_lists, i), ops)) {
+      destroy(ops);
+      return i;
+    }
+  }
+  vec_insert(&T->op_lists, ops);
+  return T->op_lists.size - 1;
+}
+
+// the states found so far, and a hash table over them.
+typedef struct {
+  vector kernels; // of `kernel`, by state id
+  state_id_t *table;
+  size_t mask;
+  int too_large;
+} kernel_set;
+
+// the id of `k`, which is added if it is new, or 0 if there is no room.
+// the kernel is consumed. `end` is the final state of the NFA.
+static state_id_t find_kernel(kernel_set *S, tdfa *T, kernel *k,
+                              state_id_t end) {
+  thread_counters.lookups++;
+  size_t i = kernel_hash(k) & S->mask;
+  for (; S->table[i]; i = (i + 1) & S->mask) {
+    if (kernel_eq(elem_at(&S->kernels, S->table[i]), k)) {
+      delete_kernel(k);
+      return S->table[i];
+    }
+  }
+  if (S->kernels.size >= MAX_NFA_SIZE) {
+    S->too_large = 1;
+    delete_kernel(k);
+    return 0;
+  }
+
+  state_id_t id = S->table[i] = S->kernels.size;
+  vec_insert(&S->kernels, k);
+  vector row = VEC(tagged_path, NULL);
+  vec_insert(&T->rows, &row);
+
+  // the match ends with the registers of the first final configuration.
+  reg_t none = REG_UNSET;
+  const state_id_t *q = k->q.ptr;
+  size_t c = 0;
+  while (c < k->q.size && q[c] != end)
+    c++;
+  for (unsigned t = 0; t < T->n_tags; t++)
+    vec_insert(&T->final, c < k->q.size ? elem_at(&k->regs, c * T->n_tags + t)
+                                         : &none);
+  if (c < k->q.size)
+    set_insert(&T->accepting_states, id);
+  return id;
+}
+
+// the state of the kernel built by `c`, and in `ops` the operations that
+// lead to it.
+static state_id_t finish_state(kernel_set *S, tdfa *T, closure *c,
+                               reg_t *names, unsigned *ops) {
+  vector list = VEC(reg_op, NULL);
+  int n_registers = canonicalize(c, names, &list);
+  destroy(&c->tags);
+  *ops = intern_ops(T, &list);
+  if (n_registers < 0) {
+    S->too_large = 1;
+    delete_kernel(c->out);
+    return 0;
+  }
+  if ((unsigned)n_registers > T->n_registers)
+    T->n_registers = n_registers;
+  return find_kernel(S, T, c->out, c->N->end);
+}
+
+// the state reached from `k` on `c`, or 0 if there is none.
+static state_id_t step(kernel_set *S, tdfa *T, const tnfa *N, const kernel *k,
+                       unsigned char c, reg_t *names, unsigned *ops) {
+  kernel next = new_kernel();
+  closure cl = {.N = N, .n_tags = T->n_tags, .out = &next,
+                .tags = VEC(uint64_t, NULL)};
+  thread_counters.closures++;
+  const state_id_t *q = k->q.ptr;
+  const reg_t *regs = k->regs.ptr;
+  for (size_t i = 0; i < k->q.size; i++) {
+    ITER(path, p, &state_at(N, q[i])->paths) {
+      if (p->first <= c && c <= p->last)
+        close_from(&cl, p->end_state, regs + i * T->n_tags, 0);
+    }
+  }
+  if (!next.q.size) {
+    destroy(&cl.tags);
+    delete_kernel(&next);
+    return 0;
+  }
+  return finish_state(S, T, &cl, names, ops);
+}
+
+// the subset construction, over kernels instead of sets of states. states
+// are numbered breadth first from the start.
+static tdfa *determinize(const tnfa *N, state_id_t start, unsigned n_tags) {
+  tdfa *T = calloc(1, sizeof(tdfa));
+  T->n_tags = n_tags;
+  T->rows = VEC(vector, NULL);
+  T->final = VEC(reg_t, NULL);
+  T->op_lists = VEC(vector, NULL);
+  vector no_ops = VEC(reg_op, NULL);
+  vec_insert(&T->op_lists, &no_ops);
+
+  size_t table_size = 1;
+  while (table_size < 2 * MAX_NFA_SIZE)
+    table_size *= 2;
+  kernel_set S = {.kernels = VEC(kernel, NULL),
+                  .table = calloc(table_size, sizeof(state_id_t)),
+                  .mask = table_size - 1};
+  reg_t *names = calloc(REG_FRESH + 64, sizeof(reg_t));
+
+  // the error state, which is not in the table: a start state that reads
+  // nothing is still state 1.
+  kernel error = new_kernel();
+  vector no_paths = VEC(tagged_path, NULL);
+  vec_insert(&S.kernels, &error);
+  vec_insert(&T->rows, &no_paths);
+  for (unsigned t = 0; t < n_tags; t++)
+    vec_insert(&T->final, &(reg_t){REG_UNSET});
+
+  kernel first = new_kernel();
+  reg_t *unset = calloc(n_tags + 1, sizeof(reg_t));
+  closure cl = {.N = N, .n_tags = n_tags, .out = &first,
+                .tags = VEC(uint64_t, NULL)};
+  thread_counters.closures++;
+  close_from(&cl, start, unset, 0);
+  free(unset);
+  finish_state(&S, T, &cl, names, &T->start_ops);
+
+  for (state_id_t id = 1; id < S.kernels.size && !S.too_large; id++) {
+    const kernel k = *(kernel *)elem_at(&S.kernels, id);
+
+    // bytes between two cuts lead to the same NFA states.
+    unsigned char cut[257] = {0};
+    ITER(state_id_t, q, &k.q) {
+      ITER(path, p, &state_at(N, *q)->paths) {
+        cut[p->first] = 1;
+        cut[p->last + 1] = 1;
+      }
+    }
+
+    vector row = VEC(tagged_path, NULL);
+    for (unsigned c = 1; c < 256;) {
+      unsigned next = c + 1;
+      while (next < 256 && !cut[next])
+        next++;
+      unsigned ops = 0;
+      state_id_t to = step(&S, T, N, &k, c, names, &ops);
+      tagged_path *last = row.size ? elem_at(&row, row.size - 1) : NULL;
+      if (!to) {
+        // nothing to do.
+      } else if (last && last->last + 1u == c && last->end_state == to &&
+                 last->ops == ops) {
+        last->last = next - 1;
+      } else {
+        const tagged_path p = {.first = c, .last = next - 1, .end_state = to,
+                               .ops = ops};
+        vec_insert(&row, &p);
+      }
+      c = next;
+    }
+    vector *slot = elem_at(&T->rows, id);
+    destroy(slot);
+    *slot = row;
+  }
+  T->n_states = S.kernels.size;
+
+  ITER(kernel, k, &S.kernels) { delete_kernel(k); }
+  destroy(&S.kernels);
+  free(S.table);
+  free(names);
+  if (S.too_large) {
+    delete_tdfa(T);
+    return NULL;
+  }
+  return T;
+}
+
+tdfa *ast_to_tdfa(const ast *a) {
+  tnfa N = {.states = VEC(tnfa_state, NULL)};
+  tnfa_state none = {.eps = VEC(eps_move, NULL), .paths = P_VEC()};
+  vec_insert(&N.states, &none);
+  fragment f = build(&N, a);
+  N.end = f.end;
+  tdfa *T = N.too_large ? NULL : determinize(&N, f.start, 2 * ast_groups(a, NULL));
+  delete_tnfa(&N);
+  return T;
+}
+
+// the partition of the states in `minimize_tdfa`. states are sorted by
+// their block and by what they do on every byte, states that compare equal
+// stay in the same block.
+typedef struct {
+  const tdfa *T;
+  const state_id_t *next; // 256 per state, 0 for none
+  const unsigned *ops;    // 256 per state
+  const state_id_t *block;
+} partition;
+
+static _Thread_local const partition *sorted;
+
+static int final_cmp(const void *a, const void *b) {
+  state_id_t x = *(const state_id_t *)a, y = *(const state_id_t *)b;
+  const tdfa *T = sorted->T;
+  int ax = set_has((bit_set *)&T->accepting_states, x);
+  int ay = set_has((bit_set *)&T->accepting_states, y);
+  if (ax != ay)
+    return ax - ay;
+  return memcmp(elem_at(&T->final, x * T->n_tags),
+                elem_at(&T->final, y * T->n_tags), T->n_tags * sizeof(reg_t));
+}
+
+static int row_cmp(const void *a, const void *b) {
+  state_id_t x = *(const state_id_t *)a, y = *(const state_id_t *)b;
+  const partition *P = sorted;
+  if (P->block[x] != P->block[y])
+    return P->block[x] - P->block[y];
+  for (unsigned c = 1; c < 256; c++) {
+    state_id_t bx = P->block[P->next[x * 256 + c]];
+    state_id_t by = P->block[P->next[y * 256 + c]];
+    if (bx != by)
+      return bx - by;
+    unsigned ox = P->ops[x * 256 + c], oy = P->ops[y * 256 + c];
+    if (ox != oy)
+      return ox < oy ? -1 : 1;
+  }
+  return 0;
+}
+
+// sorts `order` by `cmp`, and numbers the blocks of equal states from 1.
+// returns the number of blocks.
+static state_id_t number_blocks(state_id_t *order, state_id_t n,
+                                int (*cmp)(const void *, const void *),
+                                const partition *P, state_id_t *block) {
+  sorted = P;
+  qsort(order, n, sizeof(state_id_t), cmp);
+  state_id_t *numbered = malloc(n * sizeof(state_id_t));
+  state_id_t blocks = 0;
+  for (state_id_t i = 0; i < n; i++) {
+    if (!i || cmp(&order[i - 1], &order[i]))
+      blocks++;
+    numbered[i] = blocks;
+  }
+  for (state_id_t i = 0; i < n; i++)
+    block[order[i]] = numbered[i];
+  free(numbered);
+  return blocks;
+}
+
+tdfa *minimize_tdfa(const tdfa *T) {
+  state_id_t n = T->n_states;
+  state_id_t *next = calloc((size_t)n * 256, sizeof(state_id_t));
+  unsigned *ops = calloc((size_t)n * 256, sizeof(unsigned));
+  for (state_id_t id = 1; id < n; id++) {
+    ITER(tagged_path, p, (vector *)elem_at(&T->rows, id)) {
+      for (unsigned c = p->first; c <= p->last; c++) {
+        next[id * 256 + c] = p->end_state;
+        ops[id * 256 + c] = p->ops;
+      }
+    }
+  }
+
+  // the states that can not reach an accepting state are dropped. states
+  // are numbered breadth first, so going backwards settles most of them in
+  // one pass.
+  bit_set live = T->accepting_states;
+  for (int changed = 1; changed;) {
+    changed = 0;
+    for (state_id_t id = n - 1; id >= 1; id--) {
+      if (set_has(&live, id))
+        continue;
+      for (unsigned c = 1; c < 256; c++) {
+        if (next[id * 256 + c] && set_has(&live, next[id * 256 + c])) {
+          set_insert(&live, id);
+          changed = 1;
+          break;
+        }
+      }
+    }
+  }
+  for (size_t i = 0; i < (size_t)n * 256; i++) {
+    if (next[i] && !set_has(&live, next[i])) {
+      next[i] = 0;
+      ops[i] = 0;
+    }
+  }
+
+  // Moore's refinement, which also tells apart the states whose paths run
+  // different operations.
+  state_id_t *block = calloc(n, sizeof(state_id_t));
+  state_id_t *order = malloc(n * sizeof(state_id_t));
+  for (state_id_t id = 1; id < n; id++)
+    order[id - 1] = id;
+  partition P = {.T = T, .next = next, .ops = ops, .block = block};
+  state_id_t blocks = number_blocks(order, n - 1, final_cmp, &P, block);
+  for (;;) {
+    thread_counters.rounds++;
+    state_id_t refined = number_blocks(order, n - 1, row_cmp, &P, block);
+    if (refined == blocks)
+      break;
+    blocks = refined;
+  }
+
+  // the blocks are numbered breadth first from the start.
+  state_id_t *id_of = calloc(blocks + 1, sizeof(state_id_t));
+  state_id_t *member = calloc(blocks + 1, sizeof(state_id_t));
+  for (state_id_t id = n - 1; id >= 1; id--)
+    member[block[id]] = id;
+  state_id_t *queue = malloc((blocks + 1) * sizeof(state_id_t));
+  state_id_t n_found = 0;
+  queue[n_found++] = block[1];
+  id_of[block[1]] = n_found;
+  for (state_id_t i = 0; i < n_found; i++) {
+    state_id_t id = member[queue[i]];
+    for (unsigned c = 1; c < 256; c++) {
+      state_id_t b = block[next[id * 256 + c]];
+      if (next[id * 256 + c] && !id_of[b]) {
+        queue[n_found++] = b;
+        id_of[b] = n_found;
+      }
+    }
+  }
+
+  tdfa *M = calloc(1, sizeof(tdfa));
+  M->n_states = n_found + 1;
+  M->n_tags = T->n_tags;
+  M->n_registers = T->n_registers;
+  M->start_ops = T->start_ops;
+  M->rows = VEC(vector, NULL);
+  M->final = VEC(reg_t, NULL);
+  M->op_lists = VEC(vector, NULL);
+  ITER(vector, list, &T->op_lists) {
+    vector copy = VEC(reg_op, NULL);
+    ITER(reg_op, op, list) { vec_insert(&copy, op); }
+    vec_insert(&M->op_lists, &copy);
+  }
+  for (state_id_t new_id = 0; new_id <= n_found; new_id++) {
+    state_id_t id = new_id ? member[queue[new_id - 1]] : 0;
+    vector row = VEC(tagged_path, NULL);
+    for (unsigned c = 1; id && c < 256; c++) {
+      if (!next[id * 256 + c])
+        continue;
+      const tagged_path p = {.first = c, .last = c,
+                             .end_state = id_of[block[next[id * 256 + c]]],
+                             .ops = ops[id * 256 + c]};
+      tagged_path *last = row.size ? elem_at(&row, row.size - 1) : NULL;
+      if (last && last->last + 1u == c && last->end_state == p.end_state &&
+          last->ops == p.ops)
+        last->last = c;
+      else
+        vec_insert(&row, &p);
+    }
+    vec_insert(&M->rows, &row);
+    for (unsigned t = 0; t < T->n_tags; t++)
+      vec_insert(&M->final, elem_at(&T->final, id * T->n_tags + t));
+    if (id && set_has((bit_set *)&T->accepting_states, id))
+      set_insert(&M->accepting_states, new_id);
+  }
+
+  free(next);
+  free(ops);
+  free(block);
+  free(order);
+  free(id_of);
+  free(member);
+  free(queue);
+  return M;
+}
+
+void delete_tdfa(tdfa *T) {
+  ITER(vector, row, &T->rows) { destroy(row); }
+  ITER(vector, list, &T->op_lists) { destroy(list); }
+  destroy(&T->rows);
+  destroy(&T->final);
+  destroy(&T->op_lists);
+  free(T);
+}
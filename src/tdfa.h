@@ -0,0 +1,55 @@
+#ifndef TDFA_H_
+#define TDFA_H_
+#include "ast.h"
+#include "automata.h"
+
+// capture groups are reported by a tagged DFA (Laurikari's TDFA, in the
+// TDFA(0) form of Trafimovich): every group has a tag for its start and one
+// for its end, whose offsets are kept in registers. the transitions copy
+// registers and store the current offset in them, and every accepting state
+// knows which register holds each tag, so the groups are found in the same
+// pass as the match.
+//
+// of the ways of matching the longest match, the groups report the one a
+// backtracking matcher would find first: alternatives are tried from left to
+// right, and repetitions as many times as possible.
+
+typedef unsigned short reg_t;
+
+// registers are numbered from 1. 0 stands for a tag that is not set (-1).
+#define REG_UNSET 0
+#define REG_TEMP 0xfffe   // saves a register while registers are swapped
+#define REG_OFFSET 0xffff // the offset past the current byte
+
+// `dst = src`.
+typedef struct {
+  reg_t dst;
+  reg_t src;
+} reg_op;
+
+typedef struct {
+  unsigned char first;
+  unsigned char last;
+  state_id_t end_state;
+  unsigned ops; // the operations run on the way, an index in `op_lists`
+} tagged_path;
+
+typedef struct {
+  state_id_t n_states; // including the error state 0. the start is 1
+  unsigned n_tags;     // 2 per group, its start and then its end
+  unsigned n_registers;
+  vector rows;         // by state, vectors of `tagged_path` in byte order
+  vector final;        // of reg_t, n_tags per state: the tags of its match
+  bit_set accepting_states;
+  vector op_lists;     // of vectors of `reg_op`, the first one empty
+  unsigned start_ops;  // run before reading the first byte
+} tdfa;
+
+// NULL if the automaton would exceed MAX_NFA_SIZE states.
+tdfa *ast_to_tdfa(const ast *a);
+// merges the states that run the same operations on every byte into
+// equivalent states.
+tdfa *minimize_tdfa(const tdfa *T);
+void delete_tdfa(tdfa *T);
+
+#endif // TDFA_H_
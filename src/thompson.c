@@ -1,297 +1,231 @@
-#include "automata.h"
+#include "thompson.h"
+#include "product.h"
+#include "simplify.h"
 #include <stdio.h>
 
-void loop_regex(struct nfa *a) {
-  state_id_t head = a->end_id + 1;
-  state_id_t tail = head + 1;
-
-  line tail_line = {
-      .id = a->end_id,
-      .paths = P_VEC({.trigger = '\0', .end_state = tail},
-                     {.trigger = '\0', .end_state = a->start_id}),
-  };
-
-  line head_line = {
-      .id = head,
-      .paths = P_VEC({.trigger = '\0', .end_state = tail},
-                     {.trigger = '\0', .end_state = a->start_id}),
-  };
-
-  vec_insert_sorted(&a->t_matrix, &head_line);
-  vec_insert_sorted(&a->t_matrix, &tail_line);
-
-  a->start_id = head;
-  a->end_id = tail;
-}
-
-void adjoin_regex(struct nfa *a, struct nfa *b) {
-  // we assume that b was constructed after a and has no
-  // ids in common with a.
-  state_id_t head = b->end_id + 1;
-  state_id_t tail = head + 1;
-
-  // copy over the paths.
-  ITER(line, l, &b->t_matrix) { vec_insert(&a->t_matrix, l); }
-
-  // paths that connect head to the start of a and b
-  line head_paths = {
-      .id = head,
-      .paths = P_VEC({.trigger = '\0', .end_state = a->start_id},
-                     {.trigger = '\0', .end_state = b->start_id}),
-  };
-  // there should not be a line with this id in a.
-  vec_insert(&a->t_matrix, &head_paths);
-
-  // a's and b's end path has no paths exiting from it, so we can just add the
-  // lines.
-  path tail_path = {.trigger = '\0', .end_state = tail};
-  line a_line = {.id = a->end_id, .paths = P_VEC(tail_path)};
-  line b_line = {.id = b->end_id, .paths = P_VEC(tail_path)};
-
-  vec_insert_sorted(&a->t_matrix, &a_line);
-  vec_insert_sorted(&a->t_matrix, &b_line);
-
-  a->start_id = head;
-  a->end_id = tail;
-
-  destroy(&b->t_matrix);
-  *b = (struct nfa){0};
-}
-
-void concatenate_regex(struct nfa *a, struct nfa *b) {
-  if (a->t_matrix.size == 0) {
-    destroy(&a->t_matrix);
-    *a = *b;
-    *b = (struct nfa){0};
-    return;
+typedef struct {
+  state_id_t start;
+  state_id_t end;
+} fragment;
+
+typedef struct {
+  nfa *N;
+  state_id_t next_id;
+  int too_large; // set once the NFA runs out of state ids
+  counted_nfa *C; // where the counted repetitions go, NULL to unroll them
+} builder;
+
+// past the limit every new state is 0, and the NFA is thrown away at the end.
+static state_id_t new_state(builder *b) {
+  if (b->next_id + 1 >= MAX_NFA_SIZE) {
+    b->too_large = 1;
+    return 0;
   }
+  return ++b->next_id;
+}
 
-  line l = {.id = a->end_id, .paths = {0}};
-  line *ll = vec_find(&a->t_matrix, &l);
+static void add_path(nfa *N, state_id_t start, unsigned char first,
+                     unsigned char last, state_id_t end) {
+  const path p = {.first = first, .last = last, .end_state = end};
+  line l = {.id = start};
 
-  path p = {.trigger = '\0', .end_state = b->start_id};
+  line *ll = vec_find_sorted(&N->t_matrix, &l);
   if (ll) {
     vec_insert_sorted(&ll->paths, &p);
   } else {
     l.paths = P_VEC(p);
-    vec_insert(&a->t_matrix, &l);
+    vec_insert_sorted(&N->t_matrix, &l);
   }
-
-  ITER(line, ll, &b->t_matrix) { vec_insert(&a->t_matrix, ll); }
-
-  a->end_id = b->end_id;
-
-  destroy(&b->t_matrix);
-  *b = (struct nfa){0};
 }
 
-nfa clone_regex(const nfa *n) {
-  state_id_t offset = n->end_id;
-  nfa result = {
-      .start_id = n->start_id + offset,
-      .end_id = n->end_id + offset,
-      .t_matrix = L_VEC(),
-  };
-
-  ITER(line, l, &n->t_matrix) {
-    line ll = {
-        .id = l->id + offset,
-        .paths = P_VEC(),
-    };
+// copies the states of `D` into the NFA, and frees it.
+static fragment embed_dfa(builder *b, dfa *D) {
+  if (!D) {
+    b->too_large = 1;
+    return (fragment){0};
+  }
+  state_id_t *ids = calloc(D->n_states, sizeof(state_id_t));
+  for (state_id_t id = 1; id < D->n_states; id++)
+    ids[id] = new_state(b);
+
+  fragment f = {.start = ids[1], .end = new_state(b)};
+  for (state_id_t id = 1; id < D->n_states; id++)
+    if (set_has(&D->accepting_states, id))
+      add_path(b->N, ids[id], '\0', '\0', f.end);
+  ITER(line, l, &D->t_matrix) {
     ITER(path, p, &l->paths) {
-      path pp = {.trigger = p->trigger, .end_state = p->end_state + offset};
-      vec_insert_sorted(&ll.paths, &pp);
+      add_path(b->N, ids[l->id], p->first, p->last, ids[p->end_state]);
     }
-    vec_insert_sorted(&result.t_matrix, &ll);
   }
 
-  return result;
+  free(ids);
+  delete_dfa(D);
+  free(D);
+  return f;
 }
 
-const char escape_sequences[] = {
-    ['n'] = '\n',
-    ['t'] = '\t',
-    ['s'] = ' ',
-    ['('] = '(',
-    [')'] = ')',
-    ['*'] = '*',
-    ['+'] = '+',
-    ['['] = '[',
-    [']'] = ']',
-};
-
-struct nfa regex_to_nfa(const char *regex, size_t regex_len) {
-
-  struct nfa result = {.t_matrix = L_VEC(), .start_id = 0, .end_id = 0};
-  struct nfa tmp = {.t_matrix = L_VEC(), .start_id = 0, .end_id = 0};
-  struct nfa tmp2;
+static fragment build(builder *b, const ast *a);
 
-  size_t depth;
-  size_t j;
-  int escaped = 0;
-  for (size_t i = 0; i < regex_len; i++) {
-
-    if (escaped) {
-      escaped = 0;
-
-      char c = escape_sequences[(unsigned char)regex[i]];
+// whether `a` is a repetition long enough to be counted.
+static int counted(const ast *a) {
+  return a->kind == AST_REPEAT &&
+         (a->max == REPEAT_UNBOUNDED ? a->min : a->max) > COUNT_ABOVE;
+}
 
-      if (c == '\0') {
-        fprintf(stderr, "unknown char escape code: '\\%c' (%d)\n", c, c);
-        exit(1);
-      }
+int ast_has_counted(const ast *a) {
+  if (counted(a))
+    return 1;
+  ITER(ast *, c, &a->children) {
+    if (ast_has_counted(*c))
+      return 1;
+  }
+  return 0;
+}
 
-      if (tmp.t_matrix.size > 0)
-        concatenate_regex(&result, &tmp);
+static void add_count_move(builder *b, state_id_t from, state_id_t to,
+                           unsigned counter, count_kind kind) {
+  const count_move m = {from, to, counter, kind};
+  vec_insert(&b->C->moves, &m);
+}
 
-      tmp = (struct nfa){
-          .t_matrix = L_VEC({
-              .id = result.end_id + 1,
-              .paths = P_VEC({
-                  .trigger = c,
-                  .end_state = result.end_id + 2,
-              }),
-          }),
-          .start_id = result.end_id + 1,
-          .end_id = result.end_id + 2,
-      };
+// a single copy of the child, counted by a counter of `b->C`.
+static fragment build_counted(builder *b, const ast *a) {
+  fragment f = {.start = new_state(b), .end = new_state(b)};
+  state_id_t loop = new_state(b);
+  unsigned k = b->C->n_counters++;
+  fragment c = build(b, ast_child(a, 0));
+  b->C->counters[k] = (counter){a->min, a->max, loop, b->next_id};
+  add_count_move(b, f.start, c.start, k, COUNT_ENTER);
+  if (!a->min)
+    add_path(b->N, f.start, '\0', '\0', f.end);
+  add_path(b->N, c.end, '\0', '\0', loop);
+  add_count_move(b, loop, c.start, k, COUNT_LOOP);
+  add_count_move(b, loop, f.end, k, COUNT_EXIT);
+  return f;
+}
 
-      continue;
+static fragment build(builder *b, const ast *a) {
+  fragment f = {0};
+  fragment c;
+
+  switch (a->kind) {
+  case AST_EMPTY:
+    f.start = new_state(b);
+    f.end = new_state(b);
+    add_path(b->N, f.start, '\0', '\0', f.end);
+    break;
+  case AST_SET:
+    f.start = new_state(b);
+    f.end = new_state(b);
+    // one path per run of consecutive bytes in the set.
+    for (unsigned ch = 1; ch < 256; ch++) {
+      if (!byte_set_has(&a->set, ch))
+        continue;
+      unsigned last = ch;
+      while (last < 255 && byte_set_has(&a->set, last + 1))
+        last++;
+      add_path(b->N, f.start, ch, last, f.end);
+      ch = last;
     }
-
-    switch (regex[i]) {
-    case '|':
-      if (tmp.t_matrix.size > 0)
-        concatenate_regex(&result, &tmp);
-      else if (result.t_matrix.size == 0) {
-        result.t_matrix = L_VEC({.id = 1,
-                                 .paths = P_VEC({
-                                     .trigger = '\0',
-                                     .end_state = 2,
-                                 })});
-        result.start_id = 1;
-        result.end_id = 2;
-      }
-
-      tmp = regex_to_nfa(regex + i + 1, regex_len - i - 1);
-
-      tmp.start_id += result.end_id;
-      tmp.end_id += result.end_id;
-      ITER(line, l, &tmp.t_matrix) {
-        l->id += result.end_id;
-        ITER(path, p, &l->paths) { p->end_state += result.end_id; }
-      }
-
-      adjoin_regex(&result, &tmp);
-      return result;
-    case '(':
-      depth = 1;
-      for (j = i + 1; j < regex_len && depth > 0; j++) {
-
-        if (escaped) {
-          escaped = 0;
-          continue;
-        }
-
-        switch (regex[j]) {
-        case '(':
-          depth++;
-          break;
-        case ')':
-          depth--;
-          break;
-        case '\\':
-          escaped = 1;
-          break;
-        default:
-          break;
-        }
-      }
-
-      assert(depth == 0 && "unclosed parentheses");
-
-      if (tmp.t_matrix.size > 0)
-        concatenate_regex(&result, &tmp);
-
-      tmp = regex_to_nfa(regex + i + 1, j - i - 2);
-
-      // update the state ids;
-      tmp.start_id += result.end_id;
-      tmp.end_id += result.end_id;
-      ITER(line, l, &tmp.t_matrix) {
-        l->id += result.end_id;
-        ITER(path, p, &l->paths) { p->end_state += result.end_id; }
-      }
-
-      i = j - 1; // consume up to the last parentheses;
-      break;
-    case ')':
-      assert(0 && "Closing parentheses without opening.");
-    case '\\':
-      escaped = 1;
-      break;
-    case '[':
-      do {
-        char start = regex[++i];
-        assert(regex[++i] == '-');
-        char end = regex[++i];
-        assert(regex[++i] == ']');
-
-        if (tmp.t_matrix.size > 0)
-          concatenate_regex(&result, &tmp);
-
-        line l = {
-            .id = result.end_id + 1,
-            .paths = P_VEC(),
-        };
-
-        for (char c = start; c <= end; c++) {
-          path p = {.trigger = c, .end_state = result.end_id + 2};
-          vec_insert_sorted(&l.paths, &p);
-        }
-
-        tmp = (struct nfa){
-            .t_matrix = L_VEC(l),
-            .start_id = result.end_id + 1,
-            .end_id = result.end_id + 2,
-        };
-
-      } while (0);
-      break;
-
-    case ']':
-      assert(0 && "Closing square brackets without opening.");
-
-    case '*':
-      loop_regex(&tmp);
-      break;
-    case '+':
-      tmp2 = clone_regex(&tmp);
-      loop_regex(&tmp2);
-      concatenate_regex(&tmp, &tmp2);
-      break;
-    case '\0':
-      assert(0 && "The string is shorter than expected");
-    default:
-      if (tmp.t_matrix.size > 0)
-        concatenate_regex(&result, &tmp);
-      tmp = (struct nfa){
-          .t_matrix = L_VEC({
-              .id = result.end_id + 1,
-              .paths = P_VEC({
-                  .trigger = regex[i],
-                  .end_state = result.end_id + 2,
-              }),
-          }),
-          .start_id = result.end_id + 1,
-          .end_id = result.end_id + 2,
-      };
-      break;
+    break;
+  case AST_CONCAT:
+    if (a->children.size == 0) {
+      ast empty = {.kind = AST_EMPTY};
+      return build(b, &empty);
+    }
+    f = build(b, ast_child(a, 0));
+    for (size_t i = 1; i < a->children.size; i++) {
+      c = build(b, ast_child(a, i));
+      add_path(b->N, f.end, '\0', '\0', c.start);
+      f.end = c.end;
     }
+    break;
+  case AST_ALT:
+    f.start = new_state(b);
+    f.end = new_state(b);
+    ITER(ast *, child, &a->children) {
+      c = build(b, *child);
+      add_path(b->N, f.start, '\0', '\0', c.start);
+      add_path(b->N, c.end, '\0', '\0', f.end);
+    }
+    break;
+  case AST_STAR:
+  case AST_PLUS:
+    f.start = new_state(b);
+    f.end = new_state(b);
+    c = build(b, ast_child(a, 0));
+    add_path(b->N, f.start, '\0', '\0', c.start);
+    add_path(b->N, c.end, '\0', '\0', c.start);
+    add_path(b->N, c.end, '\0', '\0', f.end);
+    if (a->kind == AST_STAR)
+      add_path(b->N, f.start, '\0', '\0', f.end);
+    break;
+  case AST_AND:
+  case AST_DIFF:
+  case AST_NOT:
+    return embed_dfa(b, ast_to_dfa(a));
+  case AST_CAPTURE:
+    return build(b, ast_child(a, 0));
+  case AST_REPEAT: {
+    if (b->C && b->C->n_counters < MAX_COUNTERS && counted(a))
+      return build_counted(b, a);
+    // copies of the child in sequence. `x{n,}` loops on its last copy, and
+    // every optional copy of `x{n,m}` can skip straight to the end.
+    int unbounded = a->max == REPEAT_UNBOUNDED;
+    unsigned copies = unbounded ? (a->min ? a->min : 1) : a->max;
+    f.start = new_state(b);
+    f.end = new_state(b);
+    state_id_t end = f.start;
+    for (unsigned i = 0; i < copies && !b->too_large; i++) {
+      if (i >= a->min)
+        add_path(b->N, end, '\0', '\0', f.end);
+      c = build(b, ast_child(a, 0));
+      add_path(b->N, end, '\0', '\0', c.start);
+      if (unbounded && i + 1 == copies)
+        add_path(b->N, c.end, '\0', '\0', c.start);
+      end = c.end;
+    }
+    add_path(b->N, end, '\0', '\0', f.end);
+    break;
   }
+  }
+  return f;
+}
 
-  if (tmp.t_matrix.size > 0)
-    concatenate_regex(&result, &tmp);
+struct nfa ast_to_nfa(const ast *a) {
+  nfa result = {.t_matrix = L_VEC()};
+  builder b = {.N = &result, .next_id = 0};
+  fragment f = build(&b, a);
+  if (b.too_large) {
+    delete_nfa(&result);
+    return (nfa){.t_matrix = L_VEC()};
+  }
+  result.start_id = f.start;
+  result.end_id = f.end;
+  return result;
+}
 
+counted_nfa ast_to_counted_nfa(const ast *a) {
+  counted_nfa C = {.N = {.t_matrix = L_VEC()}, .moves = VEC(count_move, NULL)};
+  builder b = {.N = &C.N, .next_id = 0, .C = &C};
+  fragment f = build(&b, a);
+  if (b.too_large) {
+    delete_counted_nfa(&C);
+    return (counted_nfa){.N = {.t_matrix = L_VEC()},
+                         .moves = VEC(count_move, NULL)};
+  }
+  C.N.start_id = f.start;
+  C.N.end_id = f.end;
+  return C;
+}
+
+struct nfa regex_to_nfa(const char *regex, size_t regex_len) {
+  parse_error err;
+  ast *a = parse_regex(regex, regex_len, &err);
+  if (!a)
+    return (nfa){.t_matrix = L_VEC()};
+  a = simplify(a);
+  nfa result = ast_to_nfa(a);
+  ast_free(a);
   return result;
 }
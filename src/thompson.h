@@ -1,7 +1,18 @@
 #ifndef THOMPSON_H_
 #define THOMPSON_H_
+#include "ast.h"
 #include "automata.h"
+#include "counted.h"
 
+// both return an NFA with `start_id == 0`, and no transitions, if the regex
+// is malformed or the NFA would exceed MAX_NFA_SIZE states.
+struct nfa ast_to_nfa(const ast *a);
 struct nfa regex_to_nfa(const char *regex, size_t regex_len);
+// the same, with a counter for each repetition of more than COUNT_ABOVE
+// copies, up to MAX_COUNTERS of them.
+counted_nfa ast_to_counted_nfa(const ast *a);
+// whether `a` has a repetition of more than COUNT_ABOVE copies, which the
+// modes without counters unroll.
+int ast_has_counted(const ast *a);
 
 #endif // THOMPSON_H_
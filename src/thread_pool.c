@@ -0,0 +1,109 @@
+#define _POSIX_C_SOURCE 200809L
+#include "thread_pool.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// the tasks [next, end) still to be run by one thread.
+typedef struct {
+  pthread_mutex_t lock;
+  size_t next;
+  size_t end;
+} share;
+
+typedef struct {
+  share *shares;
+  unsigned n_threads;
+  void (*run)(void *arg, size_t task);
+  void *arg;
+} pool;
+
+typedef struct {
+  pool *p;
+  unsigned self;
+} worker;
+
+static int take(share *s, size_t *task) {
+  pthread_mutex_lock(&s->lock);
+  int found = s->next < s->end;
+  if (found)
+    *task = s->next++;
+  pthread_mutex_unlock(&s->lock);
+  return found;
+}
+
+// moves the upper half of `victim`'s tasks to the empty share `thief`.
+static int steal(share *victim, share *thief) {
+  pthread_mutex_lock(&victim->lock);
+  size_t left = victim->end - victim->next;
+  size_t end = victim->end;
+  victim->end -= (left + 1) / 2;
+  size_t next = victim->end;
+  pthread_mutex_unlock(&victim->lock);
+  if (!left)
+    return 0;
+
+  pthread_mutex_lock(&thief->lock);
+  thief->next = next;
+  thief->end = end;
+  pthread_mutex_unlock(&thief->lock);
+  return 1;
+}
+
+static void *work(void *arg) {
+  worker *w = arg;
+  pool *p = w->p;
+  share *own = &p->shares[w->self];
+
+  for (;;) {
+    size_t task;
+    while (take(own, &task))
+      p->run(p->arg, task);
+
+    // tasks are never added, so once every share is empty we are done.
+    int stolen = 0;
+    for (unsigned i = 1; i < p->n_threads && !stolen; i++)
+      stolen = steal(&p->shares[(w->self + i) % p->n_threads], own);
+    if (!stolen)
+      return NULL;
+  }
+}
+
+void parallel_for(size_t n_tasks, unsigned n_threads,
+                  void (*run)(void *arg, size_t task), void *arg) {
+  if (n_threads > n_tasks)
+    n_threads = n_tasks;
+  if (n_threads <= 1) {
+    for (size_t task = 0; task < n_tasks; task++)
+      run(arg, task);
+    return;
+  }
+
+  pool p = {.n_threads = n_threads, .run = run, .arg = arg};
+  p.shares = calloc(n_threads, sizeof(share));
+  worker *workers = calloc(n_threads, sizeof(worker));
+  pthread_t *threads = calloc(n_threads, sizeof(pthread_t));
+  for (unsigned i = 0; i < n_threads; i++) {
+    pthread_mutex_init(&p.shares[i].lock, NULL);
+    p.shares[i].next = n_tasks * i / n_threads;
+    p.shares[i].end = n_tasks * (i + 1) / n_threads;
+    workers[i] = (worker){.p = &p, .self = i};
+  }
+
+  for (unsigned i = 1; i < n_threads; i++)
+    pthread_create(&threads[i], NULL, work, &workers[i]);
+  work(&workers[0]);
+  for (unsigned i = 1; i < n_threads; i++)
+    pthread_join(threads[i], NULL);
+
+  for (unsigned i = 0; i < n_threads; i++)
+    pthread_mutex_destroy(&p.shares[i].lock);
+  free(threads);
+  free(workers);
+  free(p.shares);
+}
+
+unsigned available_threads(void) {
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return n > 0 ? (unsigned)n : 1;
+}
@@ -0,0 +1,15 @@
+#ifndef THREAD_POOL_H_
+#define THREAD_POOL_H_
+#include <stddef.h>
+
+// calls `run(arg, task)` for every task in [0, n_tasks), on `n_threads`
+// threads including the calling one, and returns once all of them are done.
+// every thread starts on its own contiguous share of the tasks, and steals
+// half of the remaining share of another thread when it runs out.
+void parallel_for(size_t n_tasks, unsigned n_threads,
+                  void (*run)(void *arg, size_t task), void *arg);
+
+// the number of online processors, at least 1.
+unsigned available_threads(void);
+
+#endif // THREAD_POOL_H_
@@ -0,0 +1,334 @@
+#include "trie.h"
+
+int literal_cmp(const void *a, const void *b) {
+  const literal *aa = a;
+  const literal *bb = b;
+  size_t n = aa->len < bb->len ? aa->len : bb->len;
+  // the bytes of an empty literal are NULL.
+  int r = n ? memcmp(aa->bytes, bb->bytes, n) : 0;
+  if (r)
+    return r;
+  return (aa->len > bb->len) - (aa->len < bb->len);
+}
+
+static int single_byte(const byte_set *s, unsigned char *out) {
+  int found = 0;
+  for (unsigned c = 1; c < 256; c++) {
+    if (byte_set_has(s, c)) {
+      if (found)
+        return 0;
+      *out = c;
+      found = 1;
+    }
+  }
+  return found;
+}
+
+// appends the bytes of a concatenation of single bytes to `l`.
+static int append_bytes(const ast *a, literal *l) {
+  unsigned char c;
+  switch (a->kind) {
+  case AST_EMPTY:
+    return 1;
+  case AST_SET:
+    if (!single_byte(&a->set, &c))
+      return 0;
+    l->bytes = realloc(l->bytes, l->len + 1);
+    l->bytes[l->len++] = c;
+    return 1;
+  case AST_CONCAT:
+    ITER(ast *, child, &a->children) {
+      if (!append_bytes(*child, l))
+        return 0;
+    }
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+int ast_literals(const ast *a, vector *literals) {
+  if (a->kind == AST_ALT) {
+    ITER(ast *, child, &a->children) {
+      if (!ast_literals(*child, literals))
+        return 0;
+    }
+    return 1;
+  }
+
+  literal l = {0};
+  if (!append_bytes(a, &l)) {
+    free(l.bytes);
+    return 0;
+  }
+  vec_insert(literals, &l);
+  return 1;
+}
+
+void delete_literals(vector *literals) {
+  ITER(literal, l, literals) { free(l->bytes); }
+  destroy(literals);
+}
+
+// states of the automaton under construction. they use plain `unsigned` ids,
+// as the unminimized tail of the last literal may temporarily exceed the
+// range of `state_id_t`.
+typedef struct {
+  unsigned char trigger;
+  unsigned end_state;
+} edge;
+
+typedef struct {
+  vector edges; // sorted by trigger
+  int final;
+} node;
+
+#define E_VEC(...) VEC(edge, NULL, ##__VA_ARGS__)
+
+static node *node_at(vector *nodes, unsigned id) { return elem_at(nodes, id); }
+
+static unsigned new_node(vector *nodes) {
+  node n = {.edges = E_VEC(), .final = 0};
+  vec_insert(nodes, &n);
+  return nodes->size - 1;
+}
+
+static edge *last_edge(node *n) {
+  return n->edges.size ? elem_at(&n->edges, n->edges.size - 1) : NULL;
+}
+
+static uint64_t node_hash(node *n) {
+  uint64_t h = hash_mix(HASH_INIT, n->final);
+  ITER(edge, e, &n->edges) {
+    h = hash_mix(h, e->trigger);
+    h = hash_mix(h, e->end_state);
+  }
+  return hash_finish(h);
+}
+
+static int node_equal(node *a, node *b) {
+  if (a->final != b->final || a->edges.size != b->edges.size)
+    return 0;
+  for (size_t i = 0; i < a->edges.size; i++) {
+    edge *ea = elem_at(&a->edges, i);
+    edge *eb = elem_at(&b->edges, i);
+    if (ea->trigger != eb->trigger || ea->end_state != eb->end_state)
+      return 0;
+  }
+  return 1;
+}
+
+// the register of Daciuk et al.: an open addressing hash set of the
+// canonical representatives of the states built so far.
+typedef struct {
+  unsigned *slots; // node id + 1, 0 marks an empty slot
+  size_t cap;
+  size_t size;
+} node_register;
+
+static unsigned *register_slot(node_register *r, vector *nodes, unsigned id) {
+  node *n = node_at(nodes, id);
+  size_t i = node_hash(n) & (r->cap - 1);
+  while (r->slots[i] && !node_equal(node_at(nodes, r->slots[i] - 1), n))
+    i = (i + 1) & (r->cap - 1);
+  return &r->slots[i];
+}
+
+static void register_grow(node_register *r, vector *nodes) {
+  node_register bigger = {.cap = r->cap ? r->cap * 2 : 64};
+  bigger.slots = calloc(bigger.cap, sizeof(unsigned));
+  for (size_t i = 0; i < r->cap; i++)
+    if (r->slots[i])
+      *register_slot(&bigger, nodes, r->slots[i] - 1) = r->slots[i];
+  bigger.size = r->size;
+  free(r->slots);
+  *r = bigger;
+}
+
+static void replace_or_register(vector *nodes, node_register *r,
+                                unsigned state) {
+  edge *e = last_edge(node_at(nodes, state));
+  unsigned child = e->end_state;
+  if (node_at(nodes, child)->edges.size)
+    replace_or_register(nodes, r, child);
+
+  if (2 * (r->size + 1) > r->cap)
+    register_grow(r, nodes);
+
+  unsigned *slot = register_slot(r, nodes, child);
+  if (*slot) {
+    // the child is equivalent to a state we already have: drop it.
+    last_edge(node_at(nodes, state))->end_state = *slot - 1;
+    destroy(&node_at(nodes, child)->edges);
+  } else {
+    *slot = child + 1;
+    r->size++;
+  }
+}
+
+dfa *literals_to_dfa(vector *literals) {
+  vec_sort(literals);
+
+  vector nodes = VEC(node, NULL);
+  node_register reg = {0};
+  unsigned root = new_node(&nodes);
+
+  ITER(literal, l, literals) {
+    // literals are sorted, so the prefix shared with the ones before is
+    // always along the last edges, which are not registered yet.
+    unsigned state = root;
+    size_t i = 0;
+    for (; i < l->len; i++) {
+      edge *e = last_edge(node_at(&nodes, state));
+      if (!e || e->trigger != l->bytes[i])
+        break;
+      state = e->end_state;
+    }
+
+    if (node_at(&nodes, state)->edges.size)
+      replace_or_register(&nodes, &reg, state);
+
+    for (; i < l->len; i++) {
+      unsigned next = new_node(&nodes);
+      edge e = {.trigger = l->bytes[i], .end_state = next};
+      vec_insert(&node_at(&nodes, state)->edges, &e);
+      state = next;
+    }
+    node_at(&nodes, state)->final = 1;
+  }
+  if (node_at(&nodes, root)->edges.size)
+    replace_or_register(&nodes, &reg, root);
+  free(reg.slots);
+
+  // number the surviving states breadth first, the root being state 1.
+  unsigned *ids = calloc(nodes.size, sizeof(unsigned));
+  vector queue = VEC(unsigned, NULL, root);
+  ids[root] = 1;
+  for (size_t head = 0; head < queue.size; head++) {
+    node *n = node_at(&nodes, *(unsigned *)elem_at(&queue, head));
+    ITER(edge, e, &n->edges) {
+      if (!ids[e->end_state]) {
+        ids[e->end_state] = queue.size + 1;
+        vec_insert(&queue, &e->end_state);
+      }
+    }
+  }
+
+  dfa *result = NULL;
+  if (queue.size + 1 > MAX_NFA_SIZE)
+    goto done;
+
+  result = calloc(sizeof(dfa), 1);
+  result->t_matrix = L_VEC();
+  result->n_states = queue.size + 1; // 1 for the ERR state
+  result->accepting_states = (bit_set){0};
+
+  ITER(unsigned, id, &queue) {
+    node *n = node_at(&nodes, *id);
+    if (n->final)
+      set_insert(&result->accepting_states, ids[*id]);
+    ITER(edge, e, &n->edges) {
+      transition_matrix_insert(&result->t_matrix, ids[*id], e->trigger,
+                               e->trigger, ids[e->end_state]);
+    }
+  }
+
+done:
+  ITER(unsigned, id, &queue) { destroy(&node_at(&nodes, *id)->edges); }
+  destroy(&queue);
+  destroy(&nodes);
+  free(ids);
+  return result;
+}
+
+aho_corasick literals_to_aho_corasick(const vector *literals) {
+  aho_corasick A = {.n_states = 1, .t_matrix = L_VEC()};
+
+  // the trie.
+  vector finals = VEC(state_id_t, st_cmp);
+  ITER(literal, l, literals) {
+    state_id_t state = 1;
+    for (size_t i = 0; i < l->len; i++) {
+      state_id_t next = transition_matrix_find(&A.t_matrix, state, l->bytes[i]);
+      if (!next) {
+        if (A.n_states == (state_id_t)-1) {
+          destroy(&finals);
+          delete_aho_corasick(&A);
+          return (aho_corasick){0};
+        }
+        next = ++A.n_states;
+        transition_matrix_insert(&A.t_matrix, state, l->bytes[i], l->bytes[i],
+                                 next);
+      }
+      state = next;
+    }
+    vec_insert(&finals, &state);
+  }
+
+  A.fail = calloc(A.n_states + 1, sizeof(state_id_t));
+  A.output = calloc(A.n_states + 1, 1);
+  ITER(state_id_t, f, &finals) { A.output[*f] = 1; }
+  destroy(&finals);
+
+  // failure links, breadth first so that the link of a state is always
+  // known before its children are visited.
+  vector queue = VEC(state_id_t, NULL, 1);
+  A.fail[1] = 1;
+  for (size_t head = 0; head < queue.size; head++) {
+    state_id_t s = *(state_id_t *)elem_at(&queue, head);
+    line key = {.id = s};
+    line *l = vec_find_sorted(&A.t_matrix, &key);
+    if (!l)
+      continue;
+
+    ITER(path, p, &l->paths) {
+      // trie states never share children, so every range is a single byte.
+      assert(p->first == p->last);
+      state_id_t target = 0;
+      if (s != 1) {
+        state_id_t f = A.fail[s];
+        while (!(target = transition_matrix_find(&A.t_matrix, f, p->first)) &&
+               f != 1)
+          f = A.fail[f];
+      }
+      A.fail[p->end_state] = target ? target : 1;
+      A.output[p->end_state] |= A.output[A.fail[p->end_state]];
+      vec_insert(&queue, &p->end_state);
+    }
+  }
+  destroy(&queue);
+  return A;
+}
+
+state_id_t *aho_corasick_delta(const aho_corasick *A) {
+  state_id_t *delta = malloc((size_t)(A->n_states + 1) * 256 * sizeof(state_id_t));
+  for (unsigned c = 0; c < 256; c++)
+    delta[256 + c] = 1;
+
+  // breadth first, the row of the failure link of a state is complete before
+  // the state copies it.
+  vector queue = VEC(state_id_t, NULL, 1);
+  for (size_t head = 0; head < queue.size; head++) {
+    state_id_t s = *(state_id_t *)elem_at(&queue, head);
+    if (s != 1)
+      memcpy(&delta[(size_t)s * 256], &delta[(size_t)A->fail[s] * 256],
+             256 * sizeof(state_id_t));
+    line key = {.id = s};
+    line *l = vec_find_sorted(&A->t_matrix, &key);
+    if (!l)
+      continue;
+    ITER(path, p, &l->paths) {
+      delta[(size_t)s * 256 + p->first] = p->end_state;
+      vec_insert(&queue, &p->end_state);
+    }
+  }
+  destroy(&queue);
+  return delta;
+}
+
+void delete_aho_corasick(aho_corasick *A) {
+  ITER(line, l, &A->t_matrix) { destroy(&l->paths); }
+  destroy(&A->t_matrix);
+  free(A->fail);
+  free(A->output);
+}
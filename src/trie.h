@@ -0,0 +1,40 @@
+#ifndef TRIE_H_
+#define TRIE_H_
+#include "ast.h"
+#include "automata.h"
+
+typedef struct {
+  unsigned char *bytes;
+  size_t len;
+} literal;
+
+#define LIT_VEC(...) VEC(literal, literal_cmp, ##__VA_ARGS__)
+int literal_cmp(const void *a, const void *b);
+
+typedef struct {
+  state_id_t n_states;
+  vector t_matrix;       // the trie, state 1 is the root.
+  state_id_t *fail;      // failure link of every state.
+  unsigned char *output; // whether some literal is a suffix of the state.
+} aho_corasick;
+
+// if `a` is an alternation of literal strings, collects them in
+// `literals` and returns 1.
+int ast_literals(const ast *a, vector *literals);
+void delete_literals(vector *literals);
+
+// the minimal DFA for the set of `literals`, built without intermediate
+// automata. the vector is sorted in place. NULL if the DFA would exceed
+// MAX_NFA_SIZE states.
+dfa *literals_to_dfa(vector *literals);
+
+// `n_states` is 0 if the trie has more states than `state_id_t` can number.
+aho_corasick literals_to_aho_corasick(const vector *literals);
+
+// the goto function with the failure links resolved: state `s` goes to
+// `delta[s * 256 + c]` on byte `c`, the root if no literal goes on with it.
+// the array has `(n_states + 1) * 256` entries and is freed by the caller.
+state_id_t *aho_corasick_delta(const aho_corasick *A);
+void delete_aho_corasick(aho_corasick *A);
+
+#endif // TRIE_H_
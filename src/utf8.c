@@ -0,0 +1,113 @@
+#include "utf8.h"
+
+size_t utf8_encode(uint32_t cp, unsigned char out[4]) {
+  if (cp < 0x80) {
+    out[0] = cp;
+    return 1;
+  }
+  if (cp < 0x800) {
+    out[0] = 0xC0 | (cp >> 6);
+    out[1] = 0x80 | (cp & 0x3F);
+    return 2;
+  }
+  if (cp < 0x10000) {
+    out[0] = 0xE0 | (cp >> 12);
+    out[1] = 0x80 | ((cp >> 6) & 0x3F);
+    out[2] = 0x80 | (cp & 0x3F);
+    return 3;
+  }
+  out[0] = 0xF0 | (cp >> 18);
+  out[1] = 0x80 | ((cp >> 12) & 0x3F);
+  out[2] = 0x80 | ((cp >> 6) & 0x3F);
+  out[3] = 0x80 | (cp & 0x3F);
+  return 4;
+}
+
+size_t utf8_decode(const unsigned char *s, size_t len, uint32_t *cp) {
+  size_t n;
+  uint32_t min;
+  if (len == 0)
+    return 0;
+  if (s[0] < 0x80) {
+    *cp = s[0];
+    return 1;
+  } else if ((s[0] & 0xE0) == 0xC0) {
+    n = 2, min = 0x80, *cp = s[0] & 0x1F;
+  } else if ((s[0] & 0xF0) == 0xE0) {
+    n = 3, min = 0x800, *cp = s[0] & 0x0F;
+  } else if ((s[0] & 0xF8) == 0xF0) {
+    n = 4, min = 0x10000, *cp = s[0] & 0x07;
+  } else {
+    return 0;
+  }
+
+  if (len < n)
+    return 0;
+  for (size_t i = 1; i < n; i++) {
+    if ((s[i] & 0xC0) != 0x80)
+      return 0;
+    *cp = (*cp << 6) | (s[i] & 0x3F);
+  }
+  // overlong encodings, surrogates and values past the last code point.
+  if (*cp < min || (*cp >= 0xD800 && *cp <= 0xDFFF) || *cp > UTF8_MAX)
+    return 0;
+  return n;
+}
+
+// the last code point encoded with each length.
+static const uint32_t length_limits[] = {0x7F, 0x7FF, 0xFFFF, UTF8_MAX};
+
+void utf8_sequences(uint32_t first, uint32_t last, ast *alt) {
+  if (first > last)
+    return;
+
+  // surrogates have no encoding.
+  if (first <= 0xDFFF && last >= 0xD800) {
+    if (first < 0xD800)
+      utf8_sequences(first, 0xD7FF, alt);
+    if (last > 0xDFFF)
+      utf8_sequences(0xE000, last, alt);
+    return;
+  }
+
+  // both ends must be encoded with the same number of bytes.
+  for (size_t i = 0; i < 3; i++) {
+    if (first <= length_limits[i] && last > length_limits[i]) {
+      utf8_sequences(first, length_limits[i], alt);
+      utf8_sequences(length_limits[i] + 1, last, alt);
+      return;
+    }
+  }
+
+  // the range is a product of byte ranges only if the continuation bytes of
+  // `first` are all minimal and those of `last` are all maximal, from the
+  // first position where they differ onwards.
+  for (unsigned i = 1; i < 4; i++) {
+    uint32_t m = ((uint32_t)1 << (6 * i)) - 1;
+    if ((first & ~m) == (last & ~m))
+      continue;
+    if ((first & m) != 0) {
+      utf8_sequences(first, first | m, alt);
+      utf8_sequences((first | m) + 1, last, alt);
+      return;
+    }
+    if ((last & m) != m) {
+      utf8_sequences(first, (last & ~m) - 1, alt);
+      utf8_sequences(last & ~m, last, alt);
+      return;
+    }
+  }
+
+  unsigned char lo[4], hi[4];
+  size_t n = utf8_encode(first, lo);
+  utf8_encode(last, hi);
+
+  ast *seq = ast_new(AST_CONCAT);
+  for (size_t i = 0; i < n; i++) {
+    byte_set s = {0};
+    for (unsigned c = lo[i]; c <= hi[i]; c++)
+      byte_set_insert(&s, c);
+    ast_append(seq, ast_new_set(&s));
+  }
+  ast_append(alt, seq);
+}
@@ -0,0 +1,19 @@
+#ifndef UTF8_H_
+#define UTF8_H_
+#include "ast.h"
+
+#define UTF8_MAX 0x10FFFF
+
+// writes the encoding of `cp` to `out` and returns its length.
+size_t utf8_encode(uint32_t cp, unsigned char out[4]);
+
+// decodes the code point at the start of `s`, and returns the number of
+// bytes it takes, or 0 if `s` does not start with valid UTF-8.
+size_t utf8_decode(const unsigned char *s, size_t len, uint32_t *cp);
+
+// appends to the alternation `alt` the byte sequences whose UTF-8 decoding
+// is a code point in [first, last]. the range is split so that each
+// sequence is a concatenation of byte ranges.
+void utf8_sequences(uint32_t first, uint32_t last, ast *alt);
+
+#endif // UTF8_H_
@@ -1,6 +1,165 @@
 #include "util.h"
 #include <stdio.h>
 
+_Thread_local work_counters thread_counters;
+_Thread_local arena *thread_arena;
+
+#define MIN_BLOCK_SIZE ((size_t)64 << 10)
+#define MAX_BLOCK_SIZE ((size_t)1 << 20)
+// larger allocations get a block of their own, which can be resized and
+// freed, so that growing vectors do not leave their old copies behind.
+#define LARGE_ALLOC MIN_BLOCK_SIZE
+
+struct arena_block {
+  arena_block *next;
+  arena_block *prev; // only kept for large blocks
+  size_t size;
+  size_t used;
+  max_align_t data[];
+};
+
+static size_t align(size_t size) {
+  const size_t a = _Alignof(max_align_t);
+  return (size + a - 1) / a * a;
+}
+
+static arena_block *large_block(void *ptr) {
+  return (arena_block *)((char *)ptr - offsetof(arena_block, data));
+}
+
+static void link_large(arena *a, arena_block *b) {
+  b->prev = NULL;
+  b->next = a->large;
+  if (a->large)
+    a->large->prev = b;
+  a->large = b;
+}
+
+static void unlink_large(arena *a, arena_block *b) {
+  if (b->prev)
+    b->prev->next = b->next;
+  else
+    a->large = b->next;
+  if (b->next)
+    b->next->prev = b->prev;
+}
+
+uint64_t hash_bytes(const void *data, size_t size) {
+  const unsigned char *bytes = data;
+  uint64_t h = HASH_INIT;
+  for (size_t i = 0; i < size; i++)
+    h = hash_mix(h, bytes[i]);
+  return hash_finish(h);
+}
+
+arena *arena_new(void) { return calloc(sizeof(arena), 1); }
+
+void arena_delete(arena *a) {
+  if (!a)
+    return;
+  arena_block *lists[] = {a->blocks, a->large};
+  for (size_t i = 0; i < 2; i++) {
+    for (arena_block *b = lists[i], *next; b; b = next) {
+      next = b->next;
+      free(b);
+    }
+  }
+  free(a);
+}
+
+arena *arena_swap(arena *a) {
+  arena *previous = thread_arena;
+  thread_arena = a;
+  return previous;
+}
+
+void *arena_alloc(arena *a, size_t size) {
+  size = align(size);
+  if (size >= LARGE_ALLOC) {
+    arena_block *b = malloc(sizeof(arena_block) + size);
+    *b = (arena_block){.size = size, .used = size};
+    link_large(a, b);
+    return b->data;
+  }
+
+  arena_block *b = a->blocks;
+  if (!b || b->used + size > b->size) {
+    size_t block_size = b ? b->size * 2 : MIN_BLOCK_SIZE;
+    if (block_size > MAX_BLOCK_SIZE)
+      block_size = MAX_BLOCK_SIZE;
+    b = malloc(sizeof(arena_block) + block_size);
+    *b = (arena_block){.next = a->blocks, .size = block_size};
+    a->blocks = b;
+  }
+  a->last = (char *)b->data + b->used;
+  b->used += size;
+  return a->last;
+}
+
+void *arena_realloc(arena *a, void *ptr, size_t old_size, size_t size) {
+  if (ptr && align(old_size) >= LARGE_ALLOC) {
+    arena_block *b = large_block(ptr);
+    unlink_large(a, b);
+    b = realloc(b, sizeof(arena_block) + align(size));
+    b->size = b->used = align(size);
+    link_large(a, b);
+    return b->data;
+  }
+
+  arena_block *b = a->blocks;
+  if (ptr && ptr == a->last && align(size) < LARGE_ALLOC) {
+    size_t start = (char *)ptr - (char *)b->data;
+    if (start + align(size) <= b->size) {
+      b->used = start + align(size);
+      return ptr;
+    }
+  }
+  void *result = arena_alloc(a, size);
+  if (old_size)
+    memcpy(result, ptr, old_size);
+  arena_free(a, ptr, old_size);
+  return result;
+}
+
+void arena_free(arena *a, void *ptr, size_t size) {
+  if (!ptr)
+    return;
+  if (align(size) >= LARGE_ALLOC) {
+    arena_block *b = large_block(ptr);
+    unlink_large(a, b);
+    free(b);
+  } else if (ptr == a->last) {
+    a->blocks->used = (char *)ptr - (char *)a->blocks->data;
+    a->last = NULL;
+  }
+}
+
+void *vec_alloc(size_t size) {
+  if (!size)
+    return NULL;
+  thread_counters.bytes += size;
+  return thread_arena ? arena_alloc(thread_arena, size) : malloc(size);
+}
+
+// makes room for at least one more element.
+static void vec_grow(vector *vec) {
+  const size_t s = vec->elem_size;
+  const size_t cap = vec->cap * 2 + 1;
+  thread_counters.bytes += (vec->cap + 1) * s;
+  if (vec->arena)
+    vec->ptr = arena_realloc(vec->arena, vec->ptr, vec->cap * s, cap * s);
+  else
+    vec->ptr = realloc(vec->ptr, cap * s);
+  vec->cap = cap;
+}
+
+void vec_sort(vector *vec) {
+  assert(vec != NULL);
+  assert(vec->compar != NULL);
+  if (vec->size > 1)
+    qsort(vec->ptr, vec->size, vec->elem_size, vec->compar);
+}
+
 void *vec_find_sorted(const vector *vec, const void *element) {
   assert(vec != NULL);
   if (vec->size == 0)
@@ -31,10 +190,8 @@ void vec_insert(vector *vec, const void *element) {
   assert(element != NULL);
 
   const size_t s = vec->elem_size;
-  if (vec->size + 1 >= vec->cap) {
-    vec->cap = vec->cap * 2 + 1;
-    vec->ptr = realloc(vec->ptr, vec->cap * s);
-  }
+  if (vec->size + 1 >= vec->cap)
+    vec_grow(vec);
   memcpy((char*)vec->ptr + (vec->size++) * s, element, s);
 }
 
@@ -43,10 +200,8 @@ void vec_insert_sorted(vector *vec, const void *element) {
   assert(element != NULL);
 
   const size_t s = vec->elem_size;
-  if (vec->size + 1 >= vec->cap) {
-    vec->cap = vec->cap * 2 + 1;
-    vec->ptr = realloc(vec->ptr, vec->cap * s);
-  }
+  if (vec->size + 1 >= vec->cap)
+    vec_grow(vec);
 
   char *const p = vec->ptr;
   vec->size++;
@@ -75,7 +230,10 @@ void* elem_at(const vector *vec, size_t index) {
 
 void destroy(vector *vec) {
     assert(vec != NULL);
-    free(vec->ptr);
+    if (vec->arena)
+      arena_free(vec->arena, vec->ptr, vec->cap * vec->elem_size);
+    else
+      free(vec->ptr);
     *vec = (vector){0};
 }
 
@@ -89,7 +247,7 @@ bit_set set_iota(state_id_t start, state_id_t end) {
     assert(end <= MAX_NFA_SIZE);
     for(int i = start; i < end; i++) {
         result.data[i / BS_BLOCK_SIZ] |= 
-            1 << (i % BS_BLOCK_SIZ); 
+            (bitset_block_t)1 << (i % BS_BLOCK_SIZ);
     }
     return result;
 }
@@ -1,12 +1,31 @@
 #ifndef UTIL_H_
 #define UTIL_H_
 #include <assert.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 
-#define MAX_NFA_SIZE 1000
+// bounds the number of states of every automaton, as sets of states are
+// fixed size bitsets. can be raised up to 65535 at build time.
+#ifndef MAX_NFA_SIZE
+#define MAX_NFA_SIZE 4096
+#endif
+
+// 64-bit FNV-1a. a hash starts from HASH_INIT and takes one value at a time
+// with `hash_mix`. `hash_finish` folds the high bits, which are the best
+// mixed, into the low ones that pick a slot of a table.
+#define HASH_INIT 0xcbf29ce484222325u
+
+static inline uint64_t hash_mix(uint64_t h, uint64_t x) {
+  return (h ^ x) * 0x100000001b3u;
+}
+
+static inline uint64_t hash_finish(uint64_t h) { return h ^ (h >> 29); }
+
+// the finished hash of `size` bytes, mixed one at a time.
+uint64_t hash_bytes(const void *data, size_t size);
 
 #define UNIMPLEMENTED                                                          \
   {                                                                            \
@@ -14,25 +33,64 @@
     exit(1);                                                                   \
   }
 
+// the work done building automata, counted for each thread so that `--stats`
+// can attribute it to a rule.
+typedef struct {
+  size_t closures; // epsilon closures computed
+  size_t lookups;  // searches for a subset among the DFA states found so far
+  size_t rounds;   // refinement rounds of `minimize`
+  size_t bytes;    // allocated for the elements of vectors
+} work_counters;
+
+extern _Thread_local work_counters thread_counters;
+
+// memory carved out of a few large blocks, which are all freed at once by
+// `arena_delete`. a compilation allocates its automata and worklists in one,
+// instead of a block for every vector.
+typedef struct arena_block arena_block;
+typedef struct {
+  arena_block *blocks; // the newest first, allocations are carved from it
+  arena_block *large;  // one for each allocation of LARGE_ALLOC or more bytes
+  char *last;          // the latest allocation, which can grow in place
+} arena;
+
+// vectors created by this thread allocate from it, or with malloc if NULL.
+// an arena is only used by one thread at a time.
+extern _Thread_local arena *thread_arena;
+
+arena *arena_new(void);
+void arena_delete(arena *a);
+// makes `a` the arena of this thread, and returns the one it replaces.
+arena *arena_swap(arena *a);
+void *arena_alloc(arena *a, size_t size);
+// moves the allocation of `old_size` bytes at `ptr` to one of `size` bytes.
+void *arena_realloc(arena *a, void *ptr, size_t old_size, size_t size);
+// gives the space back if `ptr` is large or the latest allocation.
+void arena_free(arena *a, void *ptr, size_t size);
+
 typedef struct {
   size_t elem_size;
   size_t size;
   size_t cap;
   void *ptr;
   int (*compar)(const void *, const void *);
+  arena *arena; // where `ptr` comes from, NULL if from malloc
 } vector;
 
+// no space is allocated for an empty vector.
 #define VEC(T, C, ...)                                                         \
   ({                                                                           \
     const T tmp_arr[] = {__VA_ARGS__};                                         \
-    void *const tmp_p = malloc(sizeof(tmp_arr));                               \
-    memcpy(tmp_p, tmp_arr, sizeof(tmp_arr));                                   \
+    void *const tmp_p = vec_alloc(sizeof(tmp_arr));                            \
+    if (sizeof(tmp_arr))                                                       \
+      memcpy(tmp_p, tmp_arr, sizeof(tmp_arr));                                 \
     (vector){                                                                  \
         .elem_size = sizeof(T),                                                \
         .size = sizeof(tmp_arr) / sizeof(tmp_arr[0]),                          \
         .cap = sizeof(tmp_arr) / sizeof(tmp_arr[0]),                           \
         .ptr = tmp_p,                                                          \
         .compar = (C),                                                         \
+        .arena = thread_arena,                                                 \
     };                                                                         \
   })
 
@@ -67,6 +125,7 @@ typedef struct {
 
 int st_cmp(const void *a, const void *b);
 
+void *vec_alloc(size_t size);
 void vec_sort(vector *vec);
 void *vec_find_sorted(const vector *vec, const void *element);
 void *vec_find(const vector *vec, const void *element);
@@ -0,0 +1,128 @@
+// counted repetitions keep a counter instead of a copy of their body per
+// count: the size of their DFA does not depend on the bounds, and it matches
+// what the unrolled DFA of the library matches.
+#include "counted.h"
+#include "regex_automata.h"
+#include "simplify.h"
+#include "thompson.h"
+#include <stdio.h>
+#include <string.h>
+
+static int failures;
+
+static counted_dfa *counted(const char *regex) {
+  parse_error err;
+  ast *a = simplify(parse_regex(regex, strlen(regex), &err));
+  counted_nfa C = ast_to_counted_nfa(a);
+  ast_free(a);
+  counted_dfa *D = C.n_counters ? counted_to_dfa(&C, 0) : NULL;
+  delete_counted_nfa(&C);
+  return D;
+}
+
+static void delete(counted_dfa *D) {
+  if (D)
+    delete_counted_dfa(D);
+  free(D);
+}
+
+static int in_case(const counter *k, unsigned r, count_case x) {
+  int below = r + 1 < k->min;
+  int top = k->max != REPEAT_UNBOUNDED && r + 1 >= k->max;
+  return x == COUNT_BELOW ? below : x == COUNT_TOP ? top : !below && !top;
+}
+
+// the length of the longest match at the start of `s`, or -1, as the
+// generated scanner finds it.
+static long run(counted_dfa *D, const char *s) {
+  unsigned r[MAX_COUNTERS] = {0};
+  long last = -1;
+  state_id_t id = 1;
+  for (size_t i = 0;; i++) {
+    if (set_has(&D->accepting_states, id))
+      last = i;
+    const counted_path *p = NULL;
+    ITER(counted_path, q, (vector *)elem_at(&D->rows, id)) {
+      if (q->first <= (unsigned char)s[i] && (unsigned char)s[i] <= q->last)
+        p = q;
+    }
+    if (!p)
+      return last;
+    const count_arm *a = p->arms.ptr;
+    for (const count_arm *end = a + p->arms.size - 1; a < end; a++) {
+      int holds = 1;
+      for (unsigned k = 0; k < D->n_counters; k++)
+        holds &= !a->cases[k] || in_case(&D->counters[k], r[k], a->cases[k]);
+      if (holds)
+        break;
+    }
+    for (unsigned k = 0; k < D->n_counters; k++)
+      r[k] = a->ops[k] == COUNT_INC ? r[k] + 1
+             : a->ops[k] == COUNT_RESET ? 0
+                                        : r[k];
+    if (!(id = a->end_state))
+      return last;
+  }
+}
+
+static void expect_same_size(const char *small, const char *large) {
+  counted_dfa *S = counted(small), *L = counted(large);
+  if (!S || !L || S->n_states != L->n_states) {
+    fprintf(stderr, "FAIL: \"%s\" and \"%s\" have %d and %d states\n", small,
+            large, S ? S->n_states : -1, L ? L->n_states : -1);
+    failures++;
+  }
+  delete(S);
+  delete(L);
+}
+
+static void expect_same_matches(const char *regex, const char *const *texts) {
+  counted_dfa *D = counted(regex);
+  ra_regex *re;
+  if (!D || ra_compile(regex, strlen(regex), 0, &re, NULL) != RA_OK) {
+    fprintf(stderr, "FAIL: \"%s\" does not compile\n", regex);
+    failures++;
+    delete(D);
+    return;
+  }
+  for (; *texts; texts++) {
+    size_t len;
+    long expected = ra_match(re, *texts, strlen(*texts), &len) ? (long)len : -1;
+    long got = run(D, *texts);
+    if (got != expected) {
+      fprintf(stderr, "FAIL: \"%s\" on \"%s\": %ld instead of %ld\n", regex,
+              *texts, got, expected);
+      failures++;
+    }
+  }
+  ra_free(re);
+  delete(D);
+}
+
+int main(void) {
+  expect_same_size("[0-9]{1,50}", "[0-9]{1,5000}");
+  expect_same_size("([a-z][0-9]){20}x", "([a-z][0-9]){2000}x");
+  expect_same_size("[a-z]{10,}@[a-z]{1,20}", "[a-z]{1000,}@[a-z]{1,2000}");
+
+  const char *digits[] = {"", "1", "12345678", "123456789012", "1234567890123",
+                          "12a", NULL};
+  expect_same_matches("[0-9]{1,12}", digits);
+  expect_same_matches("[0-9]{9,}", digits);
+  expect_same_matches("[0-9]{0,10}1", digits);
+  const char *pairs[] = {"a1b2c3d4e5f6g7h8i9j0x", "a1b2c3d4e5f6g7h8i9j0",
+                         "a1b2c3d4e5f6g7h8i9x", "a1b2c3d4e5f6g7h8i9j0k1x", NULL};
+  expect_same_matches("([a-z][0-9]){10}x", pairs);
+  expect_same_matches("(([a-z][0-9]){3}){1,9}", pairs);
+  const char *words[] = {"abcdefghij@k", "abcdefghi@k", "abcdefghijkl@abc",
+                         "abcdefghij@", NULL};
+  expect_same_matches("[a-z]{10,}@[a-z]{1,10}", words);
+
+  // the library unrolls them, and says so when that is too large.
+  ra_regex *re;
+  if (ra_compile("[0-9]{1,5000}", 13, 0, &re, NULL) != RA_ERR_COUNTED) {
+    fprintf(stderr, "FAIL: \"[0-9]{1,5000}\" is not refused as counted\n");
+    failures++;
+  }
+
+  return failures != 0;
+}
@@ -0,0 +1,46 @@
+// a backslash followed by a byte that is not an escape code is a syntax
+// error, whatever the byte.
+#include "regex_automata.h"
+#include <stdio.h>
+#include <string.h>
+
+static int failures;
+
+static void expect_error(const char *regex, const char *message) {
+  ra_regex *re;
+  ra_error err = {0};
+  ra_status status = ra_compile(regex, strlen(regex), 0, &re, &err);
+  if (status != RA_ERR_SYNTAX || !err.message || strcmp(err.message, message)) {
+    fprintf(stderr, "FAIL: \"%s\": expected \"%s\", got %s (%s)\n", regex,
+            message, ra_strerror(status), err.message ? err.message : "");
+    failures++;
+  }
+  if (status == RA_OK)
+    ra_free(re);
+}
+
+static void expect_match(const char *regex, const char *text) {
+  ra_regex *re;
+  size_t len = 0;
+  if (ra_compile(regex, strlen(regex), 0, &re, NULL) != RA_OK) {
+    fprintf(stderr, "FAIL: \"%s\" does not compile\n", regex);
+    failures++;
+    return;
+  }
+  if (!ra_match(re, text, strlen(text), &len) || len != strlen(text)) {
+    fprintf(stderr, "FAIL: \"%s\" does not match \"%s\"\n", regex, text);
+    failures++;
+  }
+  ra_free(re);
+}
+
+int main(void) {
+  expect_error("a\\q", "unknown char escape code");
+  expect_error("a\\\x7f", "unknown char escape code");
+  expect_error("a\\\x80", "unknown char escape code");
+  expect_error("a\\\xc3\xa9", "unknown char escape code");
+  expect_error("a\\\xff", "unknown char escape code");
+  expect_match("a\\}\\n", "a}\n");
+  expect_match("\\x41\\u{e9}", "A\xc3\xa9");
+  return failures != 0;
+}
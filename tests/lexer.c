@@ -0,0 +1,112 @@
+// a token that looked far ahead only slows down the edits it covers while it
+// is there: once it is gone, an edit only looks back at the tokens next to
+// it.
+#include "regex_automata.h"
+#include <stdio.h>
+#include <string.h>
+
+#define WORDS 100000
+
+static int failures;
+
+// words, /* comments */ and single bytes. a `/*` without an end reads to the
+// end of the buffer, and reaching the end counts as reading one more byte.
+static unsigned long scan(const char *buf, unsigned long len,
+                          unsigned long *start, unsigned *rule,
+                          unsigned long *read) {
+  *start = 0;
+  if (!len) {
+    *read = 1;
+    return 0;
+  }
+  if (buf[0] == '/' && len > 1 && buf[1] == '*') {
+    for (unsigned long i = 2; i + 1 < len; i++) {
+      if (buf[i] == '*' && buf[i + 1] == '/') {
+        *rule = 1;
+        *read = i + 2;
+        return i + 2;
+      }
+    }
+    *rule = 2;
+    *read = len + 1;
+    return 1;
+  }
+  unsigned long n = 0;
+  while (n < len && buf[n] >= 'a' && buf[n] <= 'z')
+    n++;
+  if (n) {
+    *rule = 0;
+    *read = n + 1;
+    return n;
+  }
+  *rule = 2;
+  *read = buf[0] == '/' ? 2 : 1;
+  return 1;
+}
+
+static char buf[4 * WORDS + 2];
+static size_t len;
+
+static ra_relex_result edit(ra_lexer *L, size_t at, size_t removed,
+                            const char *text) {
+  size_t inserted = strlen(text);
+  memmove(buf + at + inserted, buf + at + removed, len - at - removed);
+  memcpy(buf + at, text, inserted);
+  len = len - removed + inserted;
+  return ra_relex(L, buf, at, removed, inserted);
+}
+
+static void expect_same(ra_lexer *L) {
+  ra_lexer *F = ra_lexer_new(scan);
+  ra_lex(F, buf, len);
+  size_t n = ra_lexer_count(L);
+  int same = n == ra_lexer_count(F);
+  for (size_t i = 0; same && i < n; i++) {
+    ra_token a = ra_lexer_token(L, i), b = ra_lexer_token(F, i);
+    same = a.offset == b.offset && a.length == b.length && a.rule == b.rule;
+  }
+  if (!same) {
+    fprintf(stderr, "FAIL: the tokens differ from a new scan\n");
+    failures++;
+  }
+  ra_lexer_free(F);
+}
+
+// edits words in the middle, each of which should only look back at a few
+// tokens.
+static void expect_local_edits(ra_lexer *L, const char *when) {
+  size_t most = 0;
+  for (size_t i = 0; i < 100; i++) {
+    ra_relex_result r = edit(L, len / 2 + 4 * i, 1, "x");
+    if (r.visited > most)
+      most = r.visited;
+  }
+  if (most > 2) {
+    fprintf(stderr, "FAIL: %s, an edit looked back at %zu tokens\n", when,
+            most);
+    failures++;
+  }
+}
+
+int main(void) {
+  for (size_t i = 0; i < WORDS; i++)
+    memcpy(buf + 4 * i, "abc ", 4);
+  len = 4 * WORDS;
+  ra_lexer *L = ra_lexer_new(scan);
+  ra_lex(L, buf, len);
+  expect_local_edits(L, "before the comment");
+
+  // while the comment is open, its `/` covers everything after it.
+  edit(L, 0, 0, "/*");
+  ra_relex_result r = edit(L, len / 2, 1, "y");
+  if (r.first != 0) {
+    fprintf(stderr, "FAIL: the open comment was not scanned again\n");
+    failures++;
+  }
+  edit(L, 0, 2, "");
+  expect_local_edits(L, "after the comment");
+  expect_same(L);
+
+  ra_lexer_free(L);
+  return failures != 0;
+}